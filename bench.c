@@ -0,0 +1,895 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/token.h"
+#include "src/ast.h"
+#include "src/runtime.h"
+#include "src/scan.h"
+#include "src/bytecode.h"
+#include "src/vm.h"
+#include "src/jit.h"
+#include "src/optimize.h"
+#include "src/memo.h"
+#include "src/ast_operations.h"
+#include "src/primes.h"
+
+#define MEGABYTE (1024 * 1024)
+
+typedef struct
+{
+    const char *name;
+    const char *description;
+    void (*run)(void);
+} Benchmark;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// concatenates pattern until the result is at least size bytes long
+static char *repeat_pattern(const char *pattern, size_t size)
+{
+    size_t pattern_len = strlen(pattern);
+    size_t count = size / pattern_len + 1;
+    char *input = malloc(count * pattern_len + 1);
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(input + i * pattern_len, pattern, pattern_len);
+    }
+    input[count * pattern_len] = '\0';
+    return input;
+}
+
+static size_t tokenize_all(const char *input)
+{
+    size_t index = 0;
+    size_t count = 0;
+    Token token;
+    while (next_token(input, &index, &token))
+    {
+        count++;
+    }
+    return count;
+}
+
+static void bench_tokenize_input(const char *label, const char *pattern, size_t size)
+{
+    char *input = repeat_pattern(pattern, size);
+    size_t input_len = strlen(input);
+
+    // warm up caches and page in the input
+    size_t token_count = tokenize_all(input);
+
+    const int runs = 5;
+    double best = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        double start = now_seconds();
+        tokenize_all(input);
+        double elapsed = now_seconds() - start;
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("  %-10s %6.1f MB %10zu tokens %8.2f Mtokens/s %8.1f MB/s\n", label,
+           (double) input_len / MEGABYTE, token_count, token_count / best / 1e6,
+           input_len / best / MEGABYTE);
+    free(input);
+}
+
+static void bench_tokenize(void)
+{
+    ScanImpl best = scan_best_impl();
+    for (int impl = SCAN_SCALAR; impl < SCAN_IMPL_COUNT; impl++)
+    {
+        if (!scan_set_impl(impl))
+            continue;
+
+        printf(" run scanner: %s\n", scan_impl_name(impl));
+        bench_tokenize_input("mixed", "1234 + 56.78 * foo - (bar / 9) ^ 2 % qux == 3, z = 1; ", 16 * MEGABYTE);
+        bench_tokenize_input("literals", "123456 + 7890.125 + ", 16 * MEGABYTE);
+        bench_tokenize_input("symbols", "alpha * betagamma + ", 16 * MEGABYTE);
+        bench_tokenize_input("spaces", "1          +          ", 16 * MEGABYTE);
+        bench_tokenize_input("long-lits", "123456789012345678901234567890.12345678901234567890 + ", 16 * MEGABYTE);
+        bench_tokenize_input("long-syms", "abcdefghijklmnopqrstuvwxyzabcdefghijklmnop + ", 16 * MEGABYTE);
+        bench_tokenize_input("indented", "1 +                                        2 ;", 16 * MEGABYTE);
+    }
+    scan_set_impl(best);
+}
+
+static void bench_stream_input(const char *label, const char *input, bool chunked)
+{
+    size_t input_len = strlen(input);
+    const int runs = 5;
+    double best = 0;
+    size_t token_count = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        MemoryInput memory = {.data = input, .len = input_len, .pos = 0};
+        Lexer lexer;
+        if (chunked)
+            lexer_init(&lexer, read_memory, &memory);
+        else
+            lexer_init_string(&lexer, input);
+
+        Arena arena = {0};
+        Tokens tokens = {.arena = &arena};
+        double start = now_seconds();
+        tokenize(&lexer, &tokens);
+        double elapsed = now_seconds() - start;
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+
+        token_count = tokens.count;
+        arena_free(&arena);
+        lexer_free(&lexer);
+    }
+
+    printf("  %-10s %6.1f MB %10zu tokens %8.2f Mtokens/s %8.1f MB/s\n", label,
+           (double) input_len / MEGABYTE, token_count, token_count / best / 1e6,
+           input_len / best / MEGABYTE);
+}
+
+static void bench_stream(void)
+{
+    for (size_t size = MEGABYTE; size <= 16 * MEGABYTE; size *= 4)
+    {
+        char *input = repeat_pattern("12 + ab * (3.5 - c);\n", size);
+        printf(" %zu MB script:\n", size / MEGABYTE);
+        bench_stream_input("string", input, false);
+        bench_stream_input("chunked", input, true);
+        free(input);
+    }
+}
+
+// statements of a few hundred operators each, large enough for the AST to fall out of L1/L2
+static char *build_program(size_t statement_count, size_t terms)
+{
+    const char *term = "12 * 3.5 - 7 / 2 + ";
+    size_t term_len = strlen(term);
+    size_t statement_len = terms * term_len + 3;
+    char *program = malloc(statement_count * statement_len + 1);
+    char *cursor = program;
+    for (size_t i = 0; i < statement_count; i++)
+    {
+        for (size_t j = 0; j < terms; j++)
+        {
+            memcpy(cursor, term, term_len);
+            cursor += term_len;
+        }
+        memcpy(cursor, "1; ", 3);
+        cursor += 3;
+    }
+    cursor[-2] = '\0';
+    return program;
+}
+
+static void bench_eval(void)
+{
+    const size_t terms = 256;
+    for (size_t statements = 64; statements <= 4096; statements *= 8)
+    {
+        char *program = build_program(statements, terms);
+        size_t program_len = strlen(program);
+        evaluate_input(program);
+
+        const int runs = 5;
+        double best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            evaluate_input(program);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("  %5zu statements %6.1f MB %10.2f ms %8.2f Mterms/s\n", statements,
+               (double) program_len / MEGABYTE, best * 1e3, statements * terms / best / 1e6);
+        free(program);
+    }
+}
+
+// one function called once per term, the tree walker re-walks its body on every call
+static void bench_calls(void)
+{
+    const char *definition = "def f(x, y) = x * y + x - y / 2 + (x + 1) * (y - 1) - x * x + 3 * y; ";
+    const char *call = "f(3, 4.5) + ";
+    const size_t calls = 10000;
+    size_t definition_len = strlen(definition);
+    size_t call_len = strlen(call);
+    char *input = malloc(definition_len + calls * call_len + 2);
+    memcpy(input, definition, definition_len);
+    for (size_t i = 0; i < calls; i++)
+        memcpy(input + definition_len + i * call_len, call, call_len);
+    strcpy(input + definition_len + calls * call_len, "0");
+
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+    Program *program = compile_ast(&ast, &arena);
+
+    // parsing and compiling are left out, the JIT translates the function on every run
+    const char *engines[] = {"vm", "jit", "tree-walk"};
+    for (int engine = 0; engine < 3; engine++)
+    {
+        if (engine == 1 && !jit_supported())
+            continue;
+
+        const int runs = 5;
+        const int repeat = 20;
+        double best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            for (int j = 0; j < repeat; j++)
+            {
+                if (engine == 0)
+                    vm_run(program, &run_arena);
+                else if (engine == 1)
+                    jit_run(program, &run_arena);
+                else
+                    interpret_ast(&ast, &run_arena);
+                arena_reset(&run_arena);
+            }
+            double elapsed = (now_seconds() - start) / repeat;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("  %-10s %8zu calls %10.2f ms %8.2f ns/call\n", engines[engine], calls, best * 1e3,
+               best * 1e9 / calls);
+    }
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+    free(input);
+}
+
+static void bench_recursion_program(const char *label, const char *input, size_t calls)
+{
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+    Program *program = compile_ast(&ast, &arena);
+
+    const char *engines[] = {"vm", "jit", "tree-walk"};
+    for (int engine = 0; engine < 3; engine++)
+    {
+        if (engine == 1 && !jit_supported())
+            continue;
+
+        const int runs = 5;
+        double best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            if (engine == 0)
+                vm_run(program, &run_arena);
+            else if (engine == 1)
+                jit_run(program, &run_arena);
+            else
+                interpret_ast(&ast, &run_arena);
+            arena_reset(&run_arena);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("  %-6s %-10s %8zu calls %10.2f ms %8.2f ns/call\n", label, engines[engine], calls, best * 1e3,
+               best * 1e9 / calls);
+    }
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+}
+
+static void bench_recursion(void)
+{
+    // fib(25) makes 242785 calls, at most 25 deep
+    bench_recursion_program("fib", "def fib(n) = if(n == 0, 0, if(n == 1, 1, fib(n - 1) + fib(n - 2))) ; fib(25)",
+                            242785);
+    // tail calls, the frame of the first call is reused by every other
+    bench_recursion_program("count", "def count(n, acc) = if(n == 0, acc, count(n - 1, acc + 1)) ; count(1000000, 0)",
+                            1000001);
+}
+
+// the calls of fib(25) without and with --memo, which leaves 26 of them computed
+static void bench_memo(void)
+{
+    const char *input = "def fib(n) = if(n == 0, 0, if(n == 1, 1, fib(n - 1) + fib(n - 2))) ; fib(25)";
+    bench_recursion_program("plain", input, 242785);
+    MEMOIZE = 1;
+    MemoStats before = MEMO_STATS;
+    bench_recursion_program("memo", input, 242785);
+    MEMOIZE = 0;
+    printf("  memo hits %zu, misses %zu\n", MEMO_STATS.hits - before.hits, MEMO_STATS.misses - before.misses);
+}
+
+// a loop calling max on its arguments 10^6 times and the same loop without the call: the
+// arguments of a builtin are read where they were evaluated, the calls allocate nothing
+static void bench_builtins_program(const char *label, const char *input, size_t calls)
+{
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+    Program *program = compile_ast(&ast, &arena);
+
+    const char *engines[] = {"vm", "jit", "tree-walk"};
+    for (int engine = 0; engine < 3; engine++)
+    {
+        if (engine == 1 && !jit_supported())
+            continue;
+
+        const int runs = 5;
+        double best = 0;
+        size_t mallocs = 0;
+        size_t used = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            size_t mallocs_before = ALLOC_STATS.mallocs;
+            double start = now_seconds();
+            if (engine == 0)
+                vm_run(program, &run_arena);
+            else if (engine == 1)
+                jit_run(program, &run_arena);
+            else
+                interpret_ast(&ast, &run_arena);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+            mallocs = ALLOC_STATS.mallocs - mallocs_before;
+            used = arena_used(&run_arena);
+            arena_reset(&run_arena);
+        }
+
+        printf("  %-6s %-10s %8zu calls %10.2f ms %8.2f ns/call %8.4f mallocs/call %8.4f arena bytes/call\n",
+               label, engines[engine], calls, best * 1e3, best * 1e9 / calls, (double) mallocs / calls,
+               (double) used / calls);
+    }
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+}
+
+static void bench_builtins(void)
+{
+    bench_builtins_program("loop", "def loop(n, x, y) = if(n == 0, x, loop(n - 1, x, y)) ; loop(1000000, 1, 2.5)",
+                           1000000);
+    bench_builtins_program("max", "def loop(n, x, y) = if(n == 0, x, loop(n - 1, max(x, y), y)) ; loop(1000000, 1, 2.5)",
+                           1000000);
+}
+
+// the isprime of the builtins before the sieve and Miller-Rabin
+static bool trial_division(uint64_t n)
+{
+    if (n < 2)
+        return false;
+    for (uint64_t d = 2; d * d <= n; d++)
+    {
+        if (n % d == 0)
+            return false;
+    }
+    return true;
+}
+
+// ns per call of test on count odd numbers from first, the number of primes found in *found
+static double bench_prime_test(bool (*test)(uint64_t), uint64_t first, int count, int *found)
+{
+    double start = now_seconds();
+    *found = 0;
+    for (int i = 0; i < count; i++)
+        *found += test(first + 2 * (uint64_t)i);
+    return (now_seconds() - start) / count * 1e9;
+}
+
+// isprime from the sieve, by Miller-Rabin and by trial division, then primepi past the sieve on
+// one thread and on every processor
+static void bench_primes(void)
+{
+    int found;
+    double trial = bench_prime_test(trial_division, 2147483647u - 20000, 10000, &found);
+    printf("  near 2^31  trial division %10.1f ns/call %5d primes\n", trial, found);
+    double miller_rabin = bench_prime_test(is_prime, 2147483647u - 20000, 10000, &found);
+    printf("  near 2^31  Miller-Rabin   %10.1f ns/call %5d primes\n", miller_rabin, found);
+    double large = bench_prime_test(is_prime, 1000000000000000001u, 100000, &found);
+    printf("  near 10^18 Miller-Rabin   %10.1f ns/call %5d primes\n", large, found);
+    double sieve = bench_prime_test(is_prime, 1, 500000, &found);
+    printf("  below 10^6 sieve          %10.1f ns/call %5d primes\n", sieve, found);
+
+    double start = now_seconds();
+    uint64_t cached = prime_pi(SIEVE_CACHE_LIMIT - 1);
+    printf("  primepi(2^26)     %10.1f ms to fill the sieve, %llu primes\n", (now_seconds() - start) * 1e3,
+           (unsigned long long)cached);
+    const uint64_t ns[] = {1000000000u, 4000000000u};
+    const int threads[] = {1, 0};
+    for (size_t n = 0; n < sizeof(ns) / sizeof(ns[0]); n++)
+    {
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+        {
+            SIEVE_THREADS = threads[t];
+            start = now_seconds();
+            uint64_t count = prime_pi(ns[n]);
+            printf("  primepi(%llu) %-12s %10.1f ms %llu primes\n", (unsigned long long)ns[n],
+                   threads[t] ? "one thread" : "every thread", (now_seconds() - start) * 1e3, (unsigned long long)count);
+        }
+    }
+    SIEVE_THREADS = 0;
+}
+
+// name(n) for each of the count ns, the printing of the result timed apart
+static void bench_big_builtin(const char *name, const int *ns, size_t count)
+{
+    for (size_t n = 0; n < count; n++)
+    {
+        char input[32];
+        snprintf(input, sizeof(input), "%s(%d)", name, ns[n]);
+        Arena arena = {0};
+        Arena run_arena = {0};
+        Tokens tokens = {.arena = &arena};
+        Lexer lexer;
+        lexer_init_string(&lexer, input);
+        tokenize(&lexer, &tokens);
+        AST ast = build_AST(&tokens, &arena);
+        Program *program = compile_ast(&ast, &arena);
+
+        const int runs = 5;
+        double best = 0;
+        double best_print = 0;
+        size_t digits = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            Result result = vm_run(program, &run_arena);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+
+            start = now_seconds();
+            char *string = ast_result_string(result);
+            elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best_print)
+                best_print = elapsed;
+            digits = strlen(string);
+            mem_free(string);
+            arena_reset(&run_arena);
+        }
+
+        printf("  %s(%6d) %6zu digits %10.4f ms %10.4f ms to print\n", name, ns[n], digits, best * 1e3, best_print * 1e3);
+        lexer_free(&lexer);
+        arena_free(&run_arena);
+        arena_free(&arena);
+    }
+}
+
+// fibo(n) from ints to big integers of 10^4 digits
+static void bench_fibo(void)
+{
+    const int ns[] = {30, 46, 90, 1000, 10000, 100000};
+    bench_big_builtin("fibo", ns, sizeof(ns) / sizeof(ns[0]));
+}
+
+// facto(n) from ints to big integers of 10^5 digits, whose products go through Karatsuba
+static void bench_facto(void)
+{
+    const int ns[] = {12, 20, 100, 1000, 10000, 30000};
+    bench_big_builtin("facto", ns, sizeof(ns) / sizeof(ns[0]));
+}
+
+// one formula repeating the same subterm five times, run with and without the AST optimizations
+static void bench_cse(void)
+{
+    const char *definition = "def f(a, b) = (a * a + b * b) * (a * a + b * b) - (a * a + b * b) / (a * a + b * b)"
+                             " + (a * a + b * b) * 2; ";
+    const char *call = "f(3, 4.5) + ";
+    const size_t calls = 10000;
+    size_t definition_len = strlen(definition);
+    size_t call_len = strlen(call);
+    char *input = malloc(definition_len + calls * call_len + 2);
+    memcpy(input, definition, definition_len);
+    for (size_t i = 0; i < calls; i++)
+        memcpy(input + definition_len + i * call_len, call, call_len);
+    strcpy(input + definition_len + calls * call_len, "0");
+
+    for (int optimized = 0; optimized < 2; optimized++)
+    {
+        Arena arena = {0};
+        Arena run_arena = {0};
+        Tokens tokens = {.arena = &arena};
+        Lexer lexer;
+        lexer_init_string(&lexer, input);
+        tokenize(&lexer, &tokens);
+        AST ast = build_AST(&tokens, &arena);
+        if (optimized)
+            optimize_ast(&ast);
+        Program *program = compile_ast(&ast, &arena);
+
+        const char *engines[] = {"vm", "jit", "tree-walk"};
+        for (int engine = 0; engine < 3; engine++)
+        {
+            if (engine == 1 && !jit_supported())
+                continue;
+
+            const int runs = 5;
+            const int repeat = 20;
+            double best = 0;
+            for (int i = 0; i < runs; i++)
+            {
+                double start = now_seconds();
+                for (int j = 0; j < repeat; j++)
+                {
+                    if (engine == 0)
+                        vm_run(program, &run_arena);
+                    else if (engine == 1)
+                        jit_run(program, &run_arena);
+                    else
+                        interpret_ast(&ast, &run_arena);
+                    arena_reset(&run_arena);
+                }
+                double elapsed = (now_seconds() - start) / repeat;
+                if (i == 0 || elapsed < best)
+                    best = elapsed;
+            }
+
+            printf("  %-10s %-12s %8zu calls %10.2f ms %8.2f ns/call\n", engines[engine],
+                   optimized ? "optimized" : "as parsed", calls, best * 1e3, best * 1e9 / calls);
+        }
+        lexer_free(&lexer);
+        arena_free(&run_arena);
+        arena_free(&arena);
+    }
+    free(input);
+}
+
+static void bench_dispatch_program(const char *label, const char *input)
+{
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+
+    for (int fused = 0; fused <= 1; fused++)
+    {
+        SUPERINSTRUCTIONS = fused;
+        Program *program = compile_ast(&ast, &arena);
+        size_t instructions = program->chunks[0].count;
+
+        for (int dispatch = 0; dispatch < VM_DISPATCH_COUNT; dispatch++)
+        {
+            if (!vm_set_dispatch(dispatch))
+                continue;
+
+            const int runs = 5;
+            const int repeat = 200;
+            double best = 0;
+            for (int i = 0; i < runs; i++)
+            {
+                double start = now_seconds();
+                for (int j = 0; j < repeat; j++)
+                {
+                    vm_run(program, &run_arena);
+                    arena_reset(&run_arena);
+                }
+                double elapsed = (now_seconds() - start) / repeat;
+                if (i == 0 || elapsed < best)
+                    best = elapsed;
+            }
+
+            printf("  %-8s %-8s %-14s %7zu instructions %8.2f us %6.2f ns/instruction\n", label,
+                   vm_dispatch_name(dispatch), fused ? "superinstr" : "plain", instructions, best * 1e6,
+                   best * 1e9 / instructions);
+        }
+
+    }
+    SUPERINSTRUCTIONS = 1;
+    vm_set_dispatch(vm_best_dispatch());
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+}
+
+static void bench_dispatch(void)
+{
+    // few enough literals for every constant index to fit in a fused instruction
+    const size_t terms = 1000;
+    char *arith = repeat_pattern("x * y + z - 7 / 2 + x * 2 + ", terms * 28);
+    strcpy(arith + terms * 28, "1");
+    char *program = malloc(strlen(arith) + 32);
+    sprintf(program, "x = 3; y = 4.5; z = 2; %s", arith);
+    bench_dispatch_program("arith", program);
+    free(program);
+    free(arith);
+
+    // loads and pops only, close to the bare cost of dispatching an instruction
+    char *loads = repeat_pattern("x; y; z; ", terms * 9);
+    strcpy(loads + terms * 9, "x");
+    program = malloc(strlen(loads) + 32);
+    sprintf(program, "x = 3; y = 4; z = 2; %s", loads);
+    bench_dispatch_program("loads", program);
+    free(program);
+    free(loads);
+}
+
+static void bench_typed_program(const char *label, const char *input)
+{
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+
+    for (int typed = 0; typed <= 1; typed++)
+    {
+        TYPED_INSTRUCTIONS = typed;
+        Program *program = compile_ast(&ast, &arena);
+        size_t instructions = program->chunks[0].count;
+
+        const int runs = 5;
+        const int repeat = 200;
+        double best = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            for (int j = 0; j < repeat; j++)
+            {
+                vm_run(program, &run_arena);
+                arena_reset(&run_arena);
+            }
+            double elapsed = (now_seconds() - start) / repeat;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        printf("  %-8s %-8s %7zu instructions %8.2f us %6.2f ns/instruction\n", label,
+               typed ? "typed" : "generic", instructions, best * 1e6, best * 1e9 / instructions);
+    }
+    TYPED_INSTRUCTIONS = 1;
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+}
+
+static void bench_typed(void)
+{
+    // the types of the globals are known at every use, only ints then ints mixed with floats
+    const size_t terms = 1000;
+    char *arith = repeat_pattern("x * y + z - x / z + x * 2 + ", terms * 28);
+    strcpy(arith + terms * 28, "1");
+    char *program = malloc(strlen(arith) + 32);
+    sprintf(program, "x = 3; y = 4; z = 2; %s", arith);
+    bench_typed_program("int", program);
+    sprintf(program, "x = 3; y = 4.5; z = 2; %s", arith);
+    bench_typed_program("mixed", program);
+    free(program);
+    free(arith);
+}
+
+// name of the i-th variable, letters only with a prefix keeping it from spelling def
+static const char *variable_name(char name[8], size_t i)
+{
+    size_t length = 0;
+    name[length++] = 'v';
+    for (size_t n = i; length == 1 || n > 0; n /= 26)
+        name[length++] = 'a' + n % 26;
+    name[length] = '\0';
+    return name;
+}
+
+// one assignment per variable: evaluation time and arena bytes per variable of each engine
+static void bench_values(void)
+{
+    const size_t variables = 10000;
+    char *input = malloc(variables * 16 + 1);
+    char *cursor = input;
+    for (size_t i = 0; i < variables; i++)
+    {
+        char name[8];
+        cursor += sprintf(cursor, "%s = %s; ", variable_name(name, i), i % 2 ? "1.5" : "3");
+    }
+    cursor[-2] = '\0';
+    printf("  sizeof(Result) %zu bytes\n", sizeof(Result));
+
+    Arena arena = {0};
+    Arena run_arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+    Program *program = compile_ast(&ast, &arena);
+
+    const char *engines[] = {"vm", "tree-walk"};
+    for (int engine = 0; engine < 2; engine++)
+    {
+        const int runs = 5;
+        double best = 0;
+        size_t used = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            if (engine == 0)
+                vm_run(program, &run_arena);
+            else
+                interpret_ast(&ast, &run_arena);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+            used = arena_used(&run_arena);
+            arena_reset(&run_arena);
+        }
+
+        printf("  %-10s %7zu variables %8.2f ms %8.2f ns/variable %6.1f bytes/variable\n", engines[engine],
+               variables, best * 1e3, best * 1e9 / variables, (double) used / variables);
+    }
+    lexer_free(&lexer);
+    arena_free(&run_arena);
+    arena_free(&arena);
+    free(input);
+}
+
+// n assignments then n reads of distinct names, from the source: names are interned when
+// parsed and resolved to slots before the run, the time per name should not grow with n
+static void bench_names(void)
+{
+    for (size_t variables = 1000; variables <= 100000; variables *= 10)
+    {
+        char *input = malloc(variables * 20 + 1);
+        char *cursor = input;
+        char name[8];
+        for (size_t i = 0; i < variables; i++)
+            cursor += sprintf(cursor, "%s = %zu; ", variable_name(name, i), i % 100);
+        for (size_t i = 0; i < variables; i++)
+            cursor += sprintf(cursor, "%s; ", variable_name(name, i));
+        cursor[-2] = '\0';
+
+        const char *engines[] = {"vm", "tree-walk"};
+        for (int engine = 0; engine < 2; engine++)
+        {
+            const int runs = 5;
+            double best = 0;
+            Arena arena = {0};
+            for (int i = 0; i < runs; i++)
+            {
+                double start = now_seconds();
+                Tokens tokens = {.arena = &arena};
+                Lexer lexer;
+                lexer_init_string(&lexer, input);
+                tokenize(&lexer, &tokens);
+                AST ast = build_AST(&tokens, &arena);
+                if (engine == 0)
+                    vm_run(compile_ast(&ast, &arena), &arena);
+                else
+                    interpret_ast(&ast, &arena);
+                double elapsed = now_seconds() - start;
+                if (i == 0 || elapsed < best)
+                    best = elapsed;
+                lexer_free(&lexer);
+                arena_reset(&arena);
+            }
+            printf("  %-10s %7zu names %8.2f ms %8.2f ns/name\n", engines[engine], variables, best * 1e3,
+                   best * 1e9 / variables);
+            arena_free(&arena);
+        }
+        free(input);
+    }
+}
+
+static void bench_parse(void)
+{
+    // one expression, twice the operators should take twice the time
+    for (size_t operators = 10000; operators <= 1000000; operators *= 10)
+    {
+        char *input = repeat_pattern("1+2*3-4/5+", 2 * operators + 1);
+        input[operators * 2 + 1] = '\0';
+
+        Arena arena = {0};
+        Arena ast_arena = {0};
+        Tokens tokens = {.arena = &arena};
+        Lexer lexer;
+        lexer_init_string(&lexer, input);
+        tokenize(&lexer, &tokens);
+
+        const int runs = 5;
+        double best = 0;
+        size_t node_count = 0;
+        for (int i = 0; i < runs; i++)
+        {
+            double start = now_seconds();
+            AST ast = build_AST(&tokens, &ast_arena);
+            double elapsed = now_seconds() - start;
+            if (i == 0 || elapsed < best)
+                best = elapsed;
+            node_count = ast.count - 1;
+            arena_reset(&ast_arena);
+        }
+
+        printf("  %8zu operators %9zu nodes %10.2f ms %8.2f ns/operator\n", operators, node_count,
+               best * 1e3, best * 1e9 / operators);
+        lexer_free(&lexer);
+        arena_free(&ast_arena);
+        arena_free(&arena);
+        free(input);
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    {"tokenize", "next_token throughput on 16 MB inputs", bench_tokenize},
+    {"stream", "tokenize() into a token buffer from a string and from 64 KB chunks", bench_stream},
+    {"parse", "build_AST on a single expression of 10^4 to 10^6 operators", bench_parse},
+    {"eval", "tokenize, parse and evaluate programs of 256 term statements", bench_eval},
+    {"dispatch", "run straight-line bytecode with each VM dispatch, with and without superinstructions", bench_dispatch},
+    {"calls", "run 10^4 calls of a user function on the VM, the JIT and the tree walker", bench_calls},
+    {"cse", "run 10^4 calls of a function repeating a subterm, with and without the AST optimizations", bench_cse},
+    {"recursion", "run a recursive fib and a tail recursive loop on the VM, the JIT and the tree walker", bench_recursion},
+    {"memo", "run a recursive fib with and without caching the results of pure functions", bench_memo},
+    {"builtins", "run 10^6 calls of max(x, y) in a loop, time and allocations per call", bench_builtins},
+    {"fibo", "compute and print fibo(n) for n from 30 to 10^5", bench_fibo},
+    {"facto", "compute and print facto(n) for n from 12 to 30000", bench_facto},
+    {"primes", "isprime by the sieve, Miller-Rabin and trial division, primepi up to 4 10^9 on one and every thread", bench_primes},
+    {"values", "assign 10^4 variables on the VM and the tree walker, time and memory per variable", bench_values},
+    {"names", "tokenize, parse and run 10^3 to 10^5 assignments of distinct names then reads of them", bench_names},
+    {"typed", "run straight-line bytecode on globals of known types, with generic and typed instructions", bench_typed},
+};
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static void print_usage(void)
+{
+    fprintf(stderr, "Usage: ./bench [benchmark...]\n");
+    fprintf(stderr, "Benchmarks:\n");
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++)
+        fprintf(stderr, "  %-20s %s\n", benchmarks[i].name, benchmarks[i].description);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        for (size_t i = 0; i < BENCHMARK_COUNT; i++)
+        {
+            printf("%s:\n", benchmarks[i].name);
+            benchmarks[i].run();
+        }
+        return 0;
+    }
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        size_t i = 0;
+        while (i < BENCHMARK_COUNT && strcmp(argv[arg], benchmarks[i].name) != 0)
+            i++;
+
+        if (i == BENCHMARK_COUNT)
+        {
+            fprintf(stderr, "Unknown benchmark: %s\n", argv[arg]);
+            print_usage();
+            return 1;
+        }
+        printf("%s:\n", benchmarks[i].name);
+        benchmarks[i].run();
+    }
+    return 0;
+}
@@ -4,20 +4,32 @@
 #include <errno.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include "./src/token.h"
 #include "./src/ast.h"
 #include "./src/runtime.h"
+#include "./src/ast_operations.h"
+#include "./src/bytecode.h"
+#include "./src/memo.h"
 
 void print_usage() {
     fprintf(stderr, "Usage:\n");
     fprintf(stderr, "  ./main <input> [options]          Run input\n");
+    fprintf(stderr, "  ./main --file <path> [options]    Run script file ('-' reads stdin)\n");
     fprintf(stderr, "  ./main --repl                     Run in REPL mode\n");
     // fprintf(stderr, "  ./main test run                   Run tests\n");
     // fprintf(stderr, "  ./main test save                  Save expected results\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  --debug                           Print debug informations\n");
     fprintf(stderr, "  --graph                           Generate AST graph\n");
+    fprintf(stderr, "  --profile                         Print allocation counters\n");
+    fprintf(stderr, "  --tree-walk                       Evaluate the AST instead of running bytecode\n");
+    fprintf(stderr, "  --jit                             Compile the bytecode to x86-64 machine code\n");
+    fprintf(stderr, "  --no-optimize                     Run the AST as parsed, without folding constants or typed instructions\n");
+    fprintf(stderr, "  --dump-optimized                  Print the AST after optimization\n");
+    fprintf(stderr, "  --memo                            Cache the results of pure functions\n");
+    fprintf(stderr, "  --max-depth <n>                   Reject input or calls nested deeper than n levels\n");
     exit(1);
 }
 
@@ -49,8 +61,12 @@ void repl_mode() {
             Result result = evaluate_input(input);
             if (result.type == RESULT_INT) {
                 printf("> %d\n", result.vali);
-            } else {
+            } else if (result.type == RESULT_FLOAT) {
                 printf("> %f\n", result.valf);
+            } else {
+                char* string = ast_result_string(result);
+                printf("> %s\n", string);
+                mem_free(string);
             }
         }
     }
@@ -64,15 +80,22 @@ int main(int argc, char** argv) {
     // TODO: ideas:
     //       - add some math functions
     // TODO: beautify debug graph
-    // TODO: use automaton to tokenize
     /*
     Usage:
         ./main <input> [options]: run input
+        ./main --file <path> [options]: run script file
         ./main test run : run tests
         ./main test save : save expected results
     Options:
         --graph  Generate AST graph
         --debug  Prints debug information
+        --profile  Prints allocation counters
+        --tree-walk  Evaluates the AST instead of running bytecode
+        --jit  Compiles the bytecode to x86-64 machine code
+        --no-optimize  Runs the AST as parsed, without folding constants or typed instructions
+        --dump-optimized  Prints the AST after optimization
+        --memo  Caches the results of pure functions
+        --max-depth <n>  Rejects input or calls nested deeper than n levels
     */
     if (argc >= 2) {
         // test
@@ -100,18 +123,57 @@ int main(int argc, char** argv) {
         }
         // run user input
         else {
-            char* input = argv[1];
-            for (int i = 2; i < argc; i++) {
+            bool from_file = strcmp(argv[1], "--file") == 0;
+            if (from_file && argc < 3) {
+                fprintf(stderr, "Missing script path\n");
+                print_usage();
+            }
+            char* input = from_file ? argv[2] : argv[1];
+            for (int i = from_file ? 3 : 2; i < argc; i++) {
                 if (strcmp(argv[i], "--debug") == 0) {
                     DEBUG_MODE = 1;
                 } else if (strcmp(argv[i], "--graph") == 0) {
                     GENERATE_GRAPH = 1;
+                } else if (strcmp(argv[i], "--profile") == 0) {
+                    PROFILE_MODE = 1;
+                } else if (strcmp(argv[i], "--tree-walk") == 0) {
+                    TREE_WALK_MODE = 1;
+                } else if (strcmp(argv[i], "--jit") == 0) {
+                    JIT_MODE = 1;
+                } else if (strcmp(argv[i], "--no-optimize") == 0) {
+                    OPTIMIZE_MODE = 0;
+                    TYPED_INSTRUCTIONS = 0;
+                } else if (strcmp(argv[i], "--dump-optimized") == 0) {
+                    DUMP_OPTIMIZED = 1;
+                } else if (strcmp(argv[i], "--memo") == 0) {
+                    MEMOIZE = 1;
+                } else if (strcmp(argv[i], "--max-depth") == 0) {
+                    char* end = NULL;
+                    if (i + 1 >= argc || (MAX_NESTING_DEPTH = strtoull(argv[i + 1], &end, 10)) == 0 || *end != '\0') {
+                        fprintf(stderr, "--max-depth expects a positive number\n");
+                        print_usage();
+                    }
+                    i++;
                 } else {
                     fprintf(stderr, "Unknown argument: %s\n", argv[i]);
                     print_usage();
                 }
             }
-            run(input);
+
+            if (!from_file) {
+                run(input);
+            } else if (strcmp(input, "-") == 0) {
+                int fd = STDIN_FILENO;
+                run_stream(read_fd, &fd);
+            } else {
+                FILE* file = fopen(input, "r");
+                if (file == NULL) {
+                    fprintf(stderr, "Could not open file '%s': %s\n", input, strerror(errno));
+                    exit(1);
+                }
+                run_stream(read_file, file);
+                fclose(file);
+            }
         }
     } else {
         fprintf(stderr, "Not enough arguments\n");
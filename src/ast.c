@@ -6,452 +6,636 @@
 #include <string.h>
 #include "./ast.h"
 #include "./ast_operations.h"
+#include "./resolve.h"
+#include "./memo.h"
+#include "./builtins.h"
+#include "./bigint.h"
 
-const OpPrecedence OPERATOR_PRECEDENCE[NODE_COUNT + 1] = {-1, -1, OP_UPLUS, OP_UMINUS, OP_PLUS, OP_MINUS, OP_DIV, OP_MULT, OP_EXP, OP_MOD, OP_EQUALITY, OP_ASSIGN, -1, -1, -1, -1, -1, -1};
+const OpPrecedence OPERATOR_PRECEDENCE[NODE_COUNT + 1] = {-1, -1, -1, OP_UPLUS, OP_UMINUS, OP_PLUS, OP_MINUS, OP_DIV, OP_MULT, OP_EXP, OP_MOD, OP_EQUALITY, OP_ASSIGN, -1, -1, -1, -1, -1, -1, -1, -1};
 
-const bool IS_OPERATOR[NODE_COUNT + 1] = {false, false, true, true, true, true, true, true, true, true, true, true, false, false, false, false, false, false, false};
+const bool IS_OPERATOR[NODE_COUNT + 1] = {false, false, false, true, true, true, true, true, true, true, true, true, true, false, false, false, false, false, false, false, false, false};
 
-const char* NODE_NAMES[NODE_COUNT + 1] = {"NodeInt", "NodeFloat", "NodeUplus", "NodeUminus", "NodePlus", "NodeMinus", "NodeDiv", "NodeMult", "NodeExp", "NodeMod", "NodeEquality", "NodeAssign", "NodeBuiltinFunction", "NodeFunction", "NodeSymbol", "NodeExpr", "NodeProgram", "NodeFuncdef", "!NodeCount!"};
+const char* NODE_NAMES[NODE_COUNT + 1] = {"NodeInt", "NodeFloat", "NodeBig", "NodeUplus", "NodeUminus", "NodePlus", "NodeMinus", "NodeDiv", "NodeMult", "NodeExp", "NodeMod", "NodeEquality", "NodeAssign", "NodeBuiltinFunction", "NodeFunction", "NodeSymbol", "NodeExpr", "NodeProgram", "NodeFuncdef", "NodeIf", "NodeShared", "NodeReuse", "!NodeCount!"};
 
 const NodeType NODE_TYPES[TOKEN_COUNT + 1] = {
     NODE_INT, NODE_FLOAT, NODE_PLUS, NODE_MINUS, NODE_MULT, NODE_DIV, NODE_EXP, NODE_MOD, NODE_EQUALITY, NODE_ASSIGN, NODE_COUNT, NODE_COUNT, NODE_SYMBOL, NODE_COUNT, NODE_COUNT, NODE_COUNT
 };
 
-const OpArity OPERATOR_ARITY[NODE_COUNT + 1] = {-1, -1, AR_UMINUS, AR_UPLUS, AR_PLUS, AR_MINUS, AR_DIV, AR_MULT, AR_EXP, AR_MOD, AR_EQUALITY, AR_ASSIGN, -1, -1, -1, -1, -1};
+const OpArity OPERATOR_ARITY[NODE_COUNT + 1] = {-1, -1, -1, AR_UMINUS, AR_UPLUS, AR_PLUS, AR_MINUS, AR_DIV, AR_MULT, AR_EXP, AR_MOD, AR_EQUALITY, AR_ASSIGN, -1, -1, -1, -1, -1, -1, -1};
 
-// Function linked list with sentinel
-typedef struct Function {
-    char* name;
-    size_t arity;
-    ASTNode* body;
-    ASTNode* args;
-    struct EvalScope* scope;
-    struct Function* next;
-} Function;
-
-// Variable linked list with sentinel
-typedef struct Variable {
-    Result value;
-    char* name;
-    struct Variable* next;
-} Variable;
+size_t MAX_NESTING_DEPTH = DEFAULT_MAX_NESTING_DEPTH;
 
+// a ^ b ^ c = a ^ (b ^ c) and a = b = c assigns c to both
+const bool IS_RIGHT_ASSOCIATIVE[NODE_COUNT + 1] = {[NODE_EXP] = true, [NODE_ASSIGN] = true};
 
-typedef struct EvalScope {
-    Variable* variables;
-    Function* functions;
-    struct EvalScope* parent;
-} EvalScope;
+// Functions are kept by the slot resolve_variables() gave their name, in the evaluation arena
+typedef struct {
+    size_t arity;
+    size_t temps;  // variables and shared values of the body, kept after the arguments of a call
+    ASTNode* body; // NULL while the function is not defined
+    bool pure;     // memoizing, the result only depends on the arguments and is cached
+} Function;
 
 /*
 program = funcdef | expr
 
 funcdef = 'def' symbol '(' symbol {, symbol} ')' = expr
 
-expr = [unary] operand {operator operand}
+expr = prefix {operator prefix}, parsed with an explicit operator stack
+
+prefix = [unary] operand
+
+"(" expr ")" right after an operand is multiplied with it: 2(1 + 3) = 2 * (1 + 3)
 
 operand = number
         | '(' expr ')'
         | symbol'(' expr {',' expr} ')'
+        | 'if' '(' expr ',' expr ',' expr ')'
+        | symbol
 
 operator = + | - | * | / | ^ | % | ==
 */
-ASTNode* ast_next_expr(Token** tokens);
-ASTNode* ast_next_operator(Token** tokens);
-ASTNode* ast_next_operand(Token** tokens);
-ASTNode* ast_next_number(Token** tokens);
-ASTNode* ast_next_funcdef(Token** tokens);
-void dump_tokens(Token** tokens);
-Function* get_function(EvalScope* scope, const char* name);
-void free_scope(EvalScope* scope);
-
-void dump_scope(EvalScope* scope) {
-    printf("Functions: ");
-    for (Function* func = scope->functions->next; func; func = func->next) {
-        printf("%s, ", func->name);
+NodeIndex ast_next_expr(Parser* parser);
+NodeIndex ast_next_subexpr(Parser* parser);
+NodeIndex ast_next_operand(Parser* parser);
+NodeIndex ast_next_number(Parser* parser);
+NodeIndex ast_next_funcdef(Parser* parser);
+void dump_tokens(Parser* parser);
+size_t ast_count_children(const AST* ast, ASTNode* node) {
+    size_t count = 0;
+    for (ASTNode* child = ast_first_child(ast, node); child; child = ast_next_sibling(ast, child)) {
+        count++;
     }
-    printf("\nVariables: ");
-    for (Variable* var = scope->variables->next; var; var = var->next) {
-        printf("%s, ", var->name);
+    return count;
+}
+
+// index of the parameter of function called name, -1 if it is not one
+int ast_find_parameter(const AST* ast, ASTNode* function, Symbol name) {
+    if (function == NULL) {
+        return -1;
     }
-    printf("\n");
+    int index = 0;
+    for (ASTNode* param = ast_first_child(ast, function); param; param = ast_next_sibling(ast, param)) {
+        if (param->value.symbol == name) {
+            return index;
+        }
+        index++;
+    }
+    return -1;
 }
 
-size_t ast_count_children(ASTNode* node) {
-    size_t count = 0;
-    for (ASTNode* child = node->children; child; child = child->next) {
-        count++;
+bool ast_is_tail_child(const AST* ast, const ASTNode* parent, const ASTNode* child) {
+    switch (parent->type) {
+    case NODE_UPLUS:
+    case NODE_EXPR: {
+        return ast_next_sibling(ast, child) == NULL;
+    }
+    case NODE_IF: {
+        return child != ast_first_child(ast, parent);
+    }
+    default: {
+        return false;
+    }
     }
-    return count;
 }
 
-bool check_token_type(Token* token, TokenType expected) {
-    return token != NULL && token->type == expected;
+// node of a function body whose children are being walked by ast_function_locals()
+typedef struct {
+    ASTNode* node;
+    ASTNode* next_child;
+    size_t children;     // walked so far
+    bool* before;        // NODE_IF: locals assigned before the branches
+    size_t before_count;
+    bool* then;          // NODE_IF: locals assigned after the then branch
+    size_t then_count;
+} LocalsFrame;
+
+static bool* copy_assigned(const bool* assigned, size_t count) {
+    bool* copy = mem_alloc(count * sizeof(bool));
+    for (size_t i = 0; i < count; i++) {
+        copy[i] = assigned[i];
+    }
+    return copy;
+}
+
+// an assignment only evaluates its value
+static ASTNode* evaluated_child(const AST* ast, const ASTNode* node) {
+    ASTNode* first = ast_first_child(ast, node);
+    return node->type == NODE_ASSIGN ? ast_next_sibling(ast, first) : first;
 }
 
-void advance_tokens(Token** tokens) {
-    Token* next = (*tokens)->next;
-    TokenType type = (*tokens)->type;
-    if (type == TOKEN_OPARENTHESIS || type == TOKEN_CPARENTHESIS
-        || type == TOKEN_COMMA) {
-        if ((*tokens)->value) {
-            free((*tokens)->value);
+int32_t* ast_function_locals(const AST* ast, Arena* arena) {
+    int32_t* locals = arena_alloc(arena, ast->count * sizeof(int32_t));
+    Symbol symbol_count = 1;
+    for (size_t i = 0; i < ast->count; i++) {
+        if (ast->nodes[i].type == NODE_SYMBOL && ast->nodes[i].value.symbol >= symbol_count) {
+            symbol_count = ast->nodes[i].value.symbol + 1;
         }
-        free(*tokens);
     }
-    // if ((*tokens)->value) {
-    //     free((*tokens)->value);
-    // }
-    // free(*tokens);
-    *tokens = next;
-}
 
+    // the names assigned at the top level and the definitions, whose bodies are walked next
+    bool* global = mem_calloc(symbol_count, sizeof(bool));
+    size_t capacity = 64;
+    size_t count = 0;
+    ASTNode** stack = mem_alloc(capacity * sizeof(ASTNode*));
+    size_t def_count = 0;
+    size_t def_capacity = 16;
+    ASTNode** defs = mem_alloc(def_capacity * sizeof(ASTNode*));
+    stack[count++] = ast_node(ast, ast->root);
+    while (count > 0) {
+        ASTNode* node = stack[--count];
+        if (node->type == NODE_FUNCDEF) {
+            if (def_count >= def_capacity) {
+                def_capacity *= 2;
+                defs = mem_realloc(defs, def_capacity * sizeof(ASTNode*));
+            }
+            defs[def_count++] = node;
+            continue;
+        }
+        ASTNode* child = ast_first_child(ast, node);
+        if (node->type == NODE_ASSIGN && child->type == NODE_SYMBOL) {
+            global[child->value.symbol] = true;
+        }
+        for (; child; child = ast_next_sibling(ast, child)) {
+            if (count >= capacity) {
+                capacity *= 2;
+                stack = mem_realloc(stack, capacity * sizeof(ASTNode*));
+            }
+            stack[count++] = child;
+        }
+    }
+    mem_free(stack);
+
+    // each body in evaluation order, a branch only keeps the assignments both branches make
+    int32_t* local_of = mem_alloc(symbol_count * sizeof(int32_t)); // by symbol, -1 for none
+    for (Symbol symbol = 0; symbol < symbol_count; symbol++) {
+        local_of[symbol] = -1;
+    }
+    Symbol* names = mem_alloc(symbol_count * sizeof(Symbol)); // by local
+    bool* assigned = mem_alloc(symbol_count * sizeof(bool));  // by local
+    size_t frame_capacity = 64;
+    LocalsFrame* frames = mem_alloc(frame_capacity * sizeof(LocalsFrame));
+    for (size_t i = 0; i < def_count; i++) {
+        ASTNode* function = ast_first_child(ast, defs[i]);
+        int32_t local_count = 0;
+        size_t frame_count = 0;
+        ASTNode* body = ast_next_sibling(ast, function);
+        frames[frame_count++] = (LocalsFrame) {.node = body, .next_child = evaluated_child(ast, body)};
+
+        while (frame_count > 0) {
+            LocalsFrame* frame = &frames[frame_count - 1];
+            ASTNode* node = frame->node;
+            ASTNode* child = frame->next_child;
+            if (child != NULL) {
+                frame->next_child = ast_next_sibling(ast, child);
+                if (node->type == NODE_IF && frame->children == 1) {
+                    frame->before = copy_assigned(assigned, local_count);
+                    frame->before_count = local_count;
+                } else if (node->type == NODE_IF && frame->children == 2) {
+                    frame->then = copy_assigned(assigned, local_count);
+                    frame->then_count = local_count;
+                    for (int32_t local = 0; local < local_count; local++) {
+                        assigned[local] = (size_t) local < frame->before_count && frame->before[local];
+                    }
+                }
+                frame->children++;
 
-void advance_free_tokens(Token** tokens) {
-    Token* next = (*tokens)->next;
-    if ((*tokens)->value) {
-        free((*tokens)->value);
+                if (frame_count >= frame_capacity) {
+                    frame_capacity *= 2;
+                    frames = mem_realloc(frames, frame_capacity * sizeof(LocalsFrame));
+                }
+                frames[frame_count++] = (LocalsFrame) {.node = child, .next_child = evaluated_child(ast, child)};
+                continue;
+            }
+            frame_count--;
+
+            if (node->type == NODE_SYMBOL) {
+                Symbol name = node->value.symbol;
+                bool local = !global[name] && local_of[name] >= 0 && assigned[local_of[name]]
+                             && ast_find_parameter(ast, function, name) < 0;
+                locals[node - ast->nodes] = local ? local_of[name] : -1;
+            } else if (node->type == NODE_ASSIGN && ast_first_child(ast, node)->type == NODE_SYMBOL) {
+                ASTNode* target = ast_first_child(ast, node);
+                Symbol name = target->value.symbol;
+                locals[target - ast->nodes] = -1;
+                if (!global[name] && ast_find_parameter(ast, function, name) < 0) {
+                    if (local_of[name] < 0) {
+                        names[local_count] = name;
+                        local_of[name] = local_count++;
+                    }
+                    assigned[local_of[name]] = true;
+                    locals[target - ast->nodes] = local_of[name];
+                }
+            } else if (node->type == NODE_IF) {
+                for (int32_t local = 0; local < local_count; local++) {
+                    assigned[local] = assigned[local] && (size_t) local < frame->then_count && frame->then[local];
+                }
+                mem_free(frame->before);
+                mem_free(frame->then);
+            }
+        }
+
+        for (int32_t local = 0; local < local_count; local++) {
+            local_of[names[local]] = -1;
+        }
+        locals[defs[i] - ast->nodes] = local_count;
     }
-    free(*tokens);
-    *tokens = next;
+
+    mem_free(frames);
+    mem_free(assigned);
+    mem_free(names);
+    mem_free(local_of);
+    mem_free(defs);
+    mem_free(global);
+    return locals;
 }
 
-ASTNode* create_node(Token* token, int type) {
-    ASTNode* node = calloc(1, sizeof(ASTNode));
-    node->token = token;
-    node->type = type;
-    return node;
+bool check_token_type(Token* token, TokenType expected) {
+    return token != NULL && token->type == expected;
 }
 
-void append_child(ASTNode* node, ASTNode* child) {
-    ASTNode* last_child = node->children;
-    if (last_child == NULL) {
-        node->children = child;
-        return;
+Token* current_token(Parser* parser) {
+    if (parser->cursor >= parser->tokens->count) {
+        return NULL;
     }
-    for (; last_child->next; last_child = last_child->next) {}
-    last_child->next = child;
+    return &parser->tokens->items[parser->cursor];
 }
 
-#define BUILTIN_FUNC_COUNT 7
-const char* BUILTIN_FUNCS[BUILTIN_FUNC_COUNT] = {"sqrt", "facto", "fibo", "min", "max", "isprime", "gcd"};
-bool is_builtin_function(const char* func_name) {
-    for (int i = 0; i < BUILTIN_FUNC_COUNT; i++) {
-        if (strcmp(BUILTIN_FUNCS[i], func_name) == 0) {
-            return true;
-        }
-    }
-    return false;
+void advance_tokens(Parser* parser) {
+    parser->cursor++;
 }
 
+// Parsing functions hold on to indices rather than pointers: creating a node may move the array.
+ASTNode* parser_node(Parser* parser, NodeIndex index) {
+    return ast_node(parser->ast, index);
+}
 
-int get_builtin_function_arity(ASTNode* func) {
-    char* func_name = (char*) func->token->value;
-#ifdef _DEBUG
-    if (func_name == NULL) {
-        fprintf(stderr, "[ERROR] func_name = NULL");
-        exit(1);
+NodeIndex ast_append_node(AST* ast, ASTNode node) {
+    if (ast->count >= ast->capacity) {
+        size_t capacity = ast->capacity ? ast->capacity * 2 : 64;
+        ast->nodes = arena_grow(ast->arena, ast->nodes, ast->capacity * sizeof(ASTNode), capacity * sizeof(ASTNode));
+        ast->capacity = capacity;
     }
-#endif
 
-    if (strcmp(func_name, "sqrt") == 0) {
-        return 1;
-    }
-    else if (strcmp(func_name, "facto") == 0) {
-        return 1;
-    }
-    else if (strcmp(func_name, "fibo") == 0) {
-        return 1;
-    }
-    else if (strcmp(func_name, "min") == 0) {
-        return 2;
-    }
-    else if (strcmp(func_name, "max") == 0) {
-        return 2;
-    }
-    else if (strcmp(func_name, "isprime") == 0) {
-        return 1;
-    }
-    else if (strcmp(func_name, "gcd") == 0) {
-        return 2;
-    }
-#ifdef _DEBUG
-    else {
-        // should print to stderr
-        printf("[ERROR] Arity not implemented for: ");
-        print_node(func);
-        printf("\n");
-        exit(1);
-    }
-#endif
-    exit(1); // unreachable
+    NodeIndex index = ast->count++;
+    ast->nodes[index] = node;
+    return index;
 }
 
-int get_function_arity(EvalScope* scope, ASTNode* func_node) {
-    if (is_builtin_function(func_node->token->value)) {
-        return get_builtin_function_arity(func_node);
+NodeIndex create_node(Parser* parser, Token* token, int type) {
+    ASTNode node = {
+        .token = token,
+        .type = type
+    };
+    if (token && token->type == TOKEN_SYMBOL) {
+        node.value.symbol = intern(token->value);
     }
+    return ast_append_node(parser->ast, node);
+}
 
-    Function* func = get_function(scope, func_node->token->value);
-    return func->arity;
+void append_child(Parser* parser, NodeIndex node_index, NodeIndex child) {
+    if (child == 0) {
+        return;
+    }
+    ASTNode* node = parser_node(parser, node_index);
+    if (node->children == 0) {
+        node->children = child;
+    } else {
+        parser_node(parser, node->last_child)->next = child;
+    }
+    node->last_child = child;
 }
 
 bool ast_is_operator(ASTNode* node) {
     return IS_OPERATOR[node->type];
 }
 
-OpArity get_operator_arity(ASTNode* optor) {
-    OpArity ar = OPERATOR_ARITY[optor->type];
-#ifdef _DEBUG
-    if ((int) ar == -1) {
-        printf("[ERROR] Operator arity not implemented for: ");
-        print_node(optor);
-        printf("\n");
-        exit(1);
+// strtod needs a NUL terminated string, the literal is copied to the stack unless it is unreasonably long
+double sv_to_double(String_View sv) {
+    char buffer[64];
+    char* str = buffer;
+    if (sv.count >= sizeof(buffer)) {
+        str = mem_alloc(sv.count + 1);
     }
-#endif
-    return ar;
-}
+    memcpy(str, sv.data, sv.count);
+    str[sv.count] = '\0';
 
-OpPrecedence get_operator_precedence(ASTNode* optor) {
-    OpPrecedence prec = OPERATOR_PRECEDENCE[optor->type];
-#ifdef _DEBUG
-    if ((int) prec == -1) {
-        printf("[ERROR] Operator precedence not implemented for: ");
-        print_node(optor);
-        printf("\n");
-        exit(1);
+    double value = strtod(str, NULL);
+    if (str != buffer) {
+        mem_free(str);
     }
-#endif
-    return prec;
+    return value;
 }
 
-ASTNode* ast_next_number(Token** tokens) {
-    if (*tokens == NULL) {
-        return NULL;
+NodeIndex ast_next_number(Parser* parser) {
+    Token* token = current_token(parser);
+    if (token == NULL) {
+        return 0;
     }
 
-    ASTNode* number = create_node(*tokens, -1);
-    switch ((*tokens)->type) {
+    NodeIndex number;
+    switch (token->type) {
     case TOKEN_INT: {
-        number->type = NODE_INT;
-        int* value = malloc(sizeof(int));
-        *value = atoi(number->token->value);
-        number->value = (void*) value;
+        String_View digits = token->value;
+        while (digits.count > 1 && digits.data[0] == '0') {
+            sv_chop_left(&digits, 1);
+        }
+        // more than 10 digits never fit, sv_to_u64 would overflow on 20
+        if (digits.count <= 10 && sv_to_u64(digits) <= INT_MAX) {
+            number = create_node(parser, token, NODE_INT);
+            parser_node(parser, number)->value.vali = (int) sv_to_u64(digits);
+        } else {
+            number = create_node(parser, token, NODE_BIG);
+            parser_node(parser, number)->value.valb = big_from_decimal(digits, parser->ast->arena);
+        }
     }
     break;
     case TOKEN_FLOAT: {
-        number->type = NODE_FLOAT;
-        double* value = malloc(sizeof(double));
-        *value = atof(number->token->value);
-        number->value = (void*) value;
+        number = create_node(parser, token, NODE_FLOAT);
+        parser_node(parser, number)->value.valf = sv_to_double(token->value);
     }
     break;
     default: {
-        free(number);
-        return NULL;
+        return 0;
     }
     }
 
-    advance_tokens(tokens);
+    advance_tokens(parser);
     return number;
 }
 
 
-ASTNode* ast_next_operand(Token** tokens) {
-    //operand = number
-    //        | ( expr )
-    //        | symbol'(' expr {',' expr} ')'
-    //        | symbol
-    if (*tokens == NULL) {
-        return NULL;
+NodeIndex ast_next_unary(Parser* parser) {
+    NodeIndex unary;
+    switch (current_token(parser)->type) {
+    case TOKEN_PLUS: {
+        unary = create_node(parser, current_token(parser), NODE_UPLUS);
     }
-
-    // number
-    ASTNode* op = ast_next_number(tokens);
-    if (op) {
-        return op;
+    break;
+    case TOKEN_MINUS: {
+        unary = create_node(parser, current_token(parser), NODE_UMINUS);
     }
-
-    // symbol'(' {expr {',' expr}} ')'
-    if ((*tokens)->type == TOKEN_SYMBOL) {
-        ASTNode* symbol = create_node(*tokens, -1);
-        advance_tokens(tokens);
-
-        // function call
-        if (check_token_type(*tokens, TOKEN_OPARENTHESIS)) {
-            if (is_builtin_function(symbol->token->value)) {
-                symbol->type = NODE_BUILTIN_FUNCTION;
-            } else {
-                symbol->type = NODE_FUNCTION;
-            }
-            advance_tokens(tokens);
-
-            ASTNode* expr;
-            while (!check_token_type(*tokens, TOKEN_CPARENTHESIS)) {
-                expr = ast_next_expr(tokens);
-                append_child(symbol, expr);
-
-                if (check_token_type(*tokens, TOKEN_COMMA)) {
-                    advance_tokens(tokens);    // skip comma
-                }
-            }
-            advance_tokens(tokens); // skip CPAR
-        }
-        // variable
-        else {
-            symbol->type = NODE_SYMBOL;
-        }
-        return symbol;
+    break;
+    default: {
+        return 0;
     }
+    }
+    advance_tokens(parser);
+    return unary;
+}
 
-    if ((*tokens)->type == TOKEN_OPARENTHESIS) {
-        advance_tokens(tokens);
-
-        op = ast_next_expr(tokens);
-
-        if (*tokens == NULL || (*tokens)->type != TOKEN_CPARENTHESIS) {
-            printf("[ERROR] Mismatched parenthesis\n");
-            dump_tokens(tokens);
-            printf("\n");
-            exit(1);
+NodeIndex ast_expect_operand(Parser* parser, NodeIndex operand) {
+    if (operand == 0) {
+        fprintf(stderr, "[ERROR] Expected an operand but found: ");
+        if (current_token(parser)) {
+            print_token(stderr, current_token(parser));
+        } else {
+            fprintf(stderr, "end of input");
         }
-
-        advance_tokens(tokens);
-        return op;
+        fprintf(stderr, "\n");
+        exit(1);
     }
-
-    return NULL;
+    return operand;
 }
 
-
-ASTNode* ast_next_operator(Token** tokens) {
-    if (*tokens == NULL) {
-        return NULL;
+void push_operand(Parser* parser, NodeIndex operand) {
+    if (parser->operand_count >= parser->operand_capacity) {
+        parser->operand_capacity = parser->operand_capacity ? parser->operand_capacity * 2 : 64;
+        parser->operands = mem_realloc(parser->operands, parser->operand_capacity * sizeof(NodeIndex));
     }
+    parser->operands[parser->operand_count++] = operand;
+}
 
-    NodeType node_type = NODE_TYPES[(*tokens)->type];
-    if (!IS_OPERATOR[node_type]) {
-        return NULL;
+void push_operator(Parser* parser, NodeIndex node, NodeType type) {
+    if (parser->operator_count >= MAX_NESTING_DEPTH) {
+        fprintf(stderr, "[ERROR] Expression nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+        exit(1);
     }
+    if (parser->operator_count >= parser->operator_capacity) {
+        parser->operator_capacity = parser->operator_capacity ? parser->operator_capacity * 2 : 64;
+        parser->operators = mem_realloc(parser->operators, parser->operator_capacity * sizeof(PendingOperator));
+    }
+    parser->operators[parser->operator_count++] = (PendingOperator) {
+        .node = node,
+        .type = type
+    };
+}
 
-    ASTNode* optor = create_node(*tokens, node_type);
-
-    size_t token_len = strlen((char*) (*tokens)->value);
-    void* value = calloc(token_len + 1, sizeof(char));
-    memcpy(value, (*tokens)->value, token_len);
-    optor->value = value;
-    advance_tokens(tokens);
-    return optor;
+bool is_pending_group(PendingOperator* optor) {
+    return optor->type == NODE_COUNT;
 }
 
-ASTNode* ast_next_unary(Token** tokens) {
-    ASTNode* unary;
-    switch ((*tokens)->type) {
-    case TOKEN_PLUS: {
-        unary = create_node(*tokens, NODE_UPLUS);
-    }
-    break;
-    case TOKEN_MINUS: {
-        unary = create_node(*tokens, NODE_UMINUS);
-    }
-    break;
-    default: {
-        return NULL;
+// pops the operator on top of the stack with its operands and pushes the resulting node
+void reduce_operator(Parser* parser) {
+    PendingOperator optor = parser->operators[--parser->operator_count];
+    size_t arity = OPERATOR_ARITY[optor.type];
+    if (parser->operand_count < arity) {
+        fprintf(stderr, "[ERROR] Missing operand for operator: ");
+        print_token(stderr, parser_node(parser, optor.node)->token);
+        fprintf(stderr, "\n");
+        exit(1);
     }
+
+    // operands have no parent yet, they are linked as the children of the operator in one go
+    parser->operand_count -= arity;
+    NodeIndex* operands = &parser->operands[parser->operand_count];
+    for (size_t i = 0; i + 1 < arity; i++) {
+        parser_node(parser, operands[i])->next = operands[i + 1];
     }
-    size_t token_len = strlen((char*) (*tokens)->value);
-    void* value = calloc(token_len + 1, sizeof(char));
-    memcpy(value, (*tokens)->value, token_len);
-    unary->value = value;
-    advance_tokens(tokens);
-    return unary;
+    ASTNode* node = parser_node(parser, optor.node);
+    node->children = operands[0];
+    node->last_child = operands[arity - 1];
+    parser->operands[parser->operand_count++] = optor.node;
 }
 
-void ast_add_operator(ASTNode* optor, ASTNode* root) {
-    if (ast_is_operator(root->children)) {
-        // root->children replace with last operator
-        if (get_operator_precedence(root->children) < get_operator_precedence(optor)) {
-            ASTNode* before_last_operand = root->children->children;
-            for (int i = 0; i < (int) (get_operator_arity(root->children) - 2); i++) {
-                before_last_operand = before_last_operand->next;
-            }
-            optor->children = before_last_operand->next;
-            before_last_operand->next = NULL;
-            append_child(root->children, optor);
-        }
-        else {
-            optor->children = root->children;
-            root->children = NULL;
-            append_child(root, optor);
+// reduces operators down to the innermost open parenthesis or call, returns NULL if there is none
+PendingOperator* reduce_group(Parser* parser, size_t base) {
+    while (parser->operator_count > base) {
+        PendingOperator* top = &parser->operators[parser->operator_count - 1];
+        if (is_pending_group(top)) {
+            return top;
         }
+        reduce_operator(parser);
     }
-    else {
-        optor->children = root->children;
-        root->children = NULL;
-        append_child(root, optor);
-    }
+    return NULL;
 }
 
-ASTNode* ast_next_expr(Token** tokens) {
-    if (*tokens == NULL) {
-        return NULL;
-    }
-    // expr = [+ | -] operand {(operator operand) | ("(" operand ")")}
-    ASTNode* expr = create_node(NULL, NODE_EXPR);
+// the argument on top of the operand stack is wrapped in an expression node and given to the call
+void append_argument(Parser* parser, NodeIndex call) {
+    NodeIndex expr = create_node(parser, NULL, NODE_EXPR);
+    append_child(parser, expr, parser->operands[--parser->operand_count]);
+    append_child(parser, call, expr);
+}
 
-    // [+ | -]
-    ASTNode* unary = ast_next_unary(tokens);
+// the arguments of if are not evaluated like those of a function, they must all be there
+void check_call(Parser* parser, NodeIndex call) {
+    ASTNode* node = parser_node(parser, call);
+    if (node->type == NODE_IF && ast_count_children(parser->ast, node) != 3) {
+        fprintf(stderr, "[ERROR] Expected if(condition, then, else)\n");
+        exit(1);
+    }
+}
 
-    // operand
-    ASTNode* operand = ast_next_operand(tokens);
-    if (operand == NULL) {
-        return NULL;
+NodeIndex ast_next_operand(Parser* parser) {
+    //operand = number
+    //        | symbol
+    // calls and parenthesis are opened here and closed by ast_next_subexpr
+    NodeIndex op = ast_next_number(parser);
+    if (op) {
+        return op;
     }
 
-    if (unary) {
-        append_child(unary, operand);
-        append_child(expr, unary);
-    } else {
-        append_child(expr, operand);
+    if (current_token(parser)->type != TOKEN_SYMBOL) {
+        return 0;
     }
 
-    // {operator }
-    ASTNode* optor = ast_next_operator(tokens);
-    if (optor != NULL) {
-        while (optor != NULL) {
-            ast_add_operator(optor, expr);
+    NodeIndex symbol = create_node(parser, current_token(parser), NODE_SYMBOL);
+    advance_tokens(parser);
+    return symbol;
+}
 
-            operand = ast_next_operand(tokens);
-            append_child(optor, operand);
+// Shunting-yard: operators wait on an explicit stack until one binding looser shows up, parenthesis
+// and calls are markers on the same stack. Nesting costs stack entries instead of C stack frames,
+// every token is looked at once.
+NodeIndex ast_next_subexpr(Parser* parser) {
+    size_t operator_base = parser->operator_count;
+    size_t operand_base = parser->operand_count;
+    bool expect_operand = true;
+
+    for (;;) {
+        Token* token = current_token(parser);
+        if (expect_operand) {
+            if (token == NULL) {
+                ast_expect_operand(parser, 0);
+            }
 
-            optor = ast_next_operator(tokens);
+            NodeIndex unary = ast_next_unary(parser);
+            if (unary) {
+                push_operator(parser, unary, parser_node(parser, unary)->type);
+                continue;
+            }
+
+            if (token->type == TOKEN_OPARENTHESIS) {
+                push_operator(parser, 0, NODE_COUNT);
+                advance_tokens(parser);
+                continue;
+            }
+
+            NodeIndex operand = ast_expect_operand(parser, ast_next_operand(parser));
+            if (check_token_type(current_token(parser), TOKEN_OPARENTHESIS)
+                    && parser_node(parser, operand)->type == NODE_SYMBOL) {
+                // symbol'(' {expr {',' expr}} ')'
+                ASTNode* call = parser_node(parser, operand);
+                const Builtin* builtin = find_builtin(call->token->value);
+                if (builtin) {
+                    call->type = NODE_BUILTIN_FUNCTION;
+                    call->value.builtin = builtin;
+                } else if (sv_eq(call->token->value, SV("if"))) {
+                    call->type = NODE_IF;
+                } else {
+                    call->type = NODE_FUNCTION;
+                }
+                advance_tokens(parser);
+
+                if (!check_token_type(current_token(parser), TOKEN_CPARENTHESIS)) {
+                    push_operator(parser, operand, NODE_COUNT);
+                    continue;
+                }
+                advance_tokens(parser); // no arguments
+                check_call(parser, operand);
+            }
+            push_operand(parser, operand);
+            expect_operand = false;
+            continue;
         }
-    }
 
-    // "(" operand ")"
-    while (*tokens != NULL && (*tokens)->type == TOKEN_OPARENTHESIS) {
-        optor = create_node(NULL, NODE_MULT);
-        ast_add_operator(optor, expr);
+        if (token == NULL) {
+            break;
+        }
+
+        if (token->type == TOKEN_CPARENTHESIS || token->type == TOKEN_COMMA) {
+            PendingOperator* group = reduce_group(parser, operator_base);
+            if (group == NULL) {
+                break; // belongs to the caller
+            }
+            NodeIndex call = group->node;
+            if (call == 0 && token->type == TOKEN_COMMA) {
+                fprintf(stderr, "[ERROR] Unexpected ',' inside parenthesis\n");
+                exit(1);
+            }
+            if (call) {
+                append_argument(parser, call);
+            }
+            advance_tokens(parser);
+
+            if (token->type == TOKEN_COMMA) {
+                expect_operand = true;
+            } else {
+                parser->operator_count--;
+                if (call) {
+                    check_call(parser, call);
+                    push_operand(parser, call);
+                }
+            }
+            continue;
+        }
 
-        advance_tokens(tokens);
+        bool implicit_product = token->type == TOKEN_OPARENTHESIS;
+        NodeType node_type = implicit_product ? NODE_MULT : NODE_TYPES[token->type];
+        if (!IS_OPERATOR[node_type]) {
+            break;
+        }
 
-        operand = ast_next_operand(tokens);
-        append_child(optor, operand);
+        // operators of a higher level, or of the same level if it is left associative, are complete
+        int precedence = OPERATOR_PRECEDENCE[node_type];
+        while (parser->operator_count > operator_base) {
+            PendingOperator* top = &parser->operators[parser->operator_count - 1];
+            if (is_pending_group(top)) {
+                break;
+            }
+            int top_precedence = OPERATOR_PRECEDENCE[top->type];
+            if (top_precedence < precedence || (top_precedence == precedence && IS_RIGHT_ASSOCIATIVE[node_type])) {
+                break;
+            }
+            reduce_operator(parser);
+        }
 
-        if ((*tokens)->type != TOKEN_CPARENTHESIS) {
-            fprintf(stderr, "Mismatched parenthesis");
-            exit(1);
+        if (implicit_product) {
+            // the parenthesis is left for the right operand
+            push_operator(parser, create_node(parser, NULL, NODE_MULT), NODE_MULT);
+        } else {
+            push_operator(parser, create_node(parser, token, node_type), node_type);
+            advance_tokens(parser);
         }
-        advance_tokens(tokens);
+        expect_operand = true;
+    }
 
+    if (reduce_group(parser, operator_base) != NULL) {
+        PendingOperator* group = &parser->operators[parser->operator_count - 1];
+        if (group->node) {
+            fprintf(stderr, "[ERROR] Expected ')' to close the arguments of '" SV_Fmt "'\n",
+                    SV_Arg(parser_node(parser, group->node)->token->value));
+        } else {
+            fprintf(stderr, "[ERROR] Mismatched parenthesis\n");
+        }
+        exit(1);
     }
 
+    assert(parser->operand_count == operand_base + 1);
+    return parser->operands[--parser->operand_count];
+}
+
+NodeIndex ast_next_expr(Parser* parser) {
+    if (current_token(parser) == NULL) {
+        return 0;
+    }
+    NodeIndex expr = create_node(parser, NULL, NODE_EXPR);
+    append_child(parser, expr, ast_next_subexpr(parser));
     return expr;
 }
 
 
-ASTNode* ast_next_funcdef(Token** tokens) {
+NodeIndex ast_next_funcdef(Parser* parser) {
     // funcdef = 'def' symbol '(' {symbol {, symbol}} ')' = expr
 
     // create func def node
@@ -459,371 +643,426 @@ ASTNode* ast_next_funcdef(Token** tokens) {
     // retrieve func args
     // parse func definition
     // funcdef node -> {{func node}, {func definition}}
-    if (!check_token_type(*tokens, TOKEN_FUNCDEF)) {
-        return NULL;
+    if (!check_token_type(current_token(parser), TOKEN_FUNCDEF)) {
+        return 0;
     }
-    ASTNode* funcdef = create_node(*tokens, NODE_FUNCDEF);
-    advance_tokens(tokens);
+    NodeIndex funcdef = create_node(parser, current_token(parser), NODE_FUNCDEF);
+    advance_tokens(parser);
 
-    if (!check_token_type(*tokens, TOKEN_SYMBOL)) {
+    if (!check_token_type(current_token(parser), TOKEN_SYMBOL)) {
         fprintf(stderr, "Expected function name but found: ");
-        print_token(stderr, *tokens);
+        print_token(stderr, current_token(parser));
         exit(1);
     }
-    ASTNode* func = create_node(*tokens, NODE_FUNCTION);
-    append_child(funcdef, func);
-    advance_tokens(tokens);
+    NodeIndex func = create_node(parser, current_token(parser), NODE_FUNCTION);
+    append_child(parser, funcdef, func);
+    advance_tokens(parser);
 
-    if (!check_token_type(*tokens, TOKEN_OPARENTHESIS)) {
+    if (!check_token_type(current_token(parser), TOKEN_OPARENTHESIS)) {
         fprintf(stderr, "Expected open parenthesis after function declaration but found: ");
-        print_token(stderr, *tokens);
+        print_token(stderr, current_token(parser));
         exit(1);
     }
-    advance_tokens(tokens);
+    advance_tokens(parser);
 
     // parse func args
-    while (!check_token_type(*tokens, TOKEN_CPARENTHESIS)) {
-        if (!check_token_type(*tokens, TOKEN_SYMBOL)) {
+    while (!check_token_type(current_token(parser), TOKEN_CPARENTHESIS)) {
+        if (!check_token_type(current_token(parser), TOKEN_SYMBOL)) {
             fprintf(stderr, "Expected symbol but found: ");
-            print_token(stderr, *tokens);
+            print_token(stderr, current_token(parser));
             exit(1);
         }
 
-        ASTNode* arg = create_node(*tokens, NODE_SYMBOL);
-        append_child(func, arg);
-        advance_tokens(tokens); // skip symbol
+        NodeIndex arg = create_node(parser, current_token(parser), NODE_SYMBOL);
+        append_child(parser, func, arg);
+        advance_tokens(parser); // skip symbol
 
-        if (check_token_type(*tokens, TOKEN_COMMA)) {
-            advance_tokens(tokens);    // skip comma
+        if (check_token_type(current_token(parser), TOKEN_COMMA)) {
+            advance_tokens(parser);    // skip comma
         }
     }
-    advance_tokens(tokens);
+    advance_tokens(parser);
 
-    if (!check_token_type(*tokens, TOKEN_ASSIGN)) {
+    if (!check_token_type(current_token(parser), TOKEN_ASSIGN)) {
         fprintf(stderr, "Expected '=' after function declaration but found: ");
-        print_token(stderr, *tokens);
+        print_token(stderr, current_token(parser));
         exit(1);
     }
-    advance_free_tokens(tokens);
+    advance_tokens(parser);
 
     // parse func body
-    ASTNode* body = ast_next_expr(tokens);
-    if (body == NULL) {
+    NodeIndex body = ast_next_expr(parser);
+    if (body == 0) {
         fprintf(stderr, "Expected function body but found nothing.");
         exit(1);
     }
-    append_child(funcdef, body);
+    append_child(parser, funcdef, body);
 
     return funcdef;
 }
 
-void dump_tokens(Token** tokens) {
-    while (*tokens) {
-        print_token(stdout, *tokens);
+void dump_tokens(Parser* parser) {
+    while (current_token(parser)) {
+        print_token(stdout, current_token(parser));
         printf(" | ");
-        advance_tokens(tokens);
+        advance_tokens(parser);
     }
 }
 
-ASTNode* build_AST(Token** tokens) {
-    // parenthesis tokens will be freed during this process
-    ASTNode* ast = calloc(1, sizeof(ASTNode));
-    ast->type = NODE_PROGRAM;
-
-    ASTNode* node = ast_next_funcdef(tokens);
-    if (node == NULL) {
-        node = ast_next_expr(tokens);
-    }
-    append_child(ast, node);
-
-    while (check_token_type(*tokens, TOKEN_SEMICOLON)) {
-        advance_free_tokens(tokens);
-        ASTNode* node = ast_next_funcdef(tokens);
-        if (node == NULL) {
-            node = ast_next_expr(tokens);
+AST build_AST(Tokens* tokens, Arena* arena) {
+    // most tokens make one node, punctuation making up for expression nodes and implicit products
+    AST ast = {
+        .capacity = tokens->count + 2,
+        .arena = arena
+    };
+    ast.nodes = arena_alloc(arena, ast.capacity * sizeof(ASTNode));
+    ast.count = 1; // index 0 is reserved
+
+    Parser parser_state = {
+        .tokens = tokens,
+        .cursor = 0,
+        .ast = &ast
+    };
+    Parser* parser = &parser_state;
+
+    ast.root = create_node(parser, NULL, NODE_PROGRAM);
+
+    NodeIndex node = ast_next_funcdef(parser);
+    if (node == 0) {
+        node = ast_next_expr(parser);
+    }
+    append_child(parser, ast.root, node);
+
+    while (check_token_type(current_token(parser), TOKEN_SEMICOLON)) {
+        advance_tokens(parser);
+        NodeIndex node = ast_next_funcdef(parser);
+        if (node == 0) {
+            node = ast_next_expr(parser);
         }
-        append_child(ast, node);
+        append_child(parser, ast.root, node);
     }
 
-    if (*tokens) {
+    if (current_token(parser)) {
         printf("[ERROR] Leftover tokens: ");
-        dump_tokens(tokens);
+        dump_tokens(parser);
         printf("\n");
         exit(1);
     }
 
+    mem_free(parser->operators);
+    mem_free(parser->operands);
     return ast;
 }
 
-Result* build_function_arguments(EvalScope* scope, ASTNode* func) {
-    int arity = get_function_arity(scope, func);
-
-    int child_count = 0;
-    for (ASTNode* child = func->children; child; child = child->next) {
-        child_count++;
-    }
-
-    if (child_count != arity) {
-        printf("[ERROR] Invalid number of arguments for function: ");
-        print_node(func);
-        printf("\n");
-        exit(EXIT_FAILURE);
+// Evaluation state of a node whose children are being evaluated
+typedef struct {
+    ASTNode* node;
+    ASTNode* next_child;
+    size_t locals;  // index on the value stack of the arguments of the running call
+    size_t argc;    // values pushed by the children evaluated so far
+    bool returning; // NODE_FUNCTION: the body is running, its value replaces the arguments
+    bool memo;      // returning: the value is cached, keyed on the arguments
+} EvalFrame;
+
+// The evaluator walks the tree with explicit stacks of frames and of intermediate values.
+// Variables are read and written through the slots resolve_variables() gave them. A call
+// leaves its arguments on the value stack, where the body finds them, followed by its variables
+// and shared values. A call in tail position moves its arguments over those of the running call and
+// reuses its frames.
+typedef struct {
+    const AST* ast;
+    EvalFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+    Result* values;
+    size_t value_count;
+    size_t value_capacity;
+    Result* shared; // values of the NODE_SHARED nodes of the top level by slot
+    size_t call_depth; // calls running, counted against MAX_NESTING_DEPTH like the frames of the VM
+    Resolution resolution;
+    Result* globals;
+    bool* defined;
+    Function* functions; // by slot
+    bool* pure;          // by node index, see memo_pure_functions(), NULL when not memoizing
+    MemoTable* memo;
+} Evaluator;
+
+void dump_variables(const Evaluator* evaluator) {
+    printf("Functions: ");
+    for (size_t i = 0; i < evaluator->resolution.functions.count; i++) {
+        if (evaluator->functions[i].body) {
+            printf(SV_Fmt ", ", SV_Arg(symbol_name(evaluator->resolution.functions.symbols[i])));
+        }
     }
-
-    Result* args = malloc(child_count * sizeof(Result));
-    int i = 0;
-    for (ASTNode* child = func->children; child; child = child->next) {
-        args[i] = interpret_ast(child);
-        i++;
+    printf("\nVariables: ");
+    for (size_t i = 0; i < evaluator->resolution.globals.count; i++) {
+        if (evaluator->defined[i]) {
+            printf(SV_Fmt ", ", SV_Arg(symbol_name(evaluator->resolution.globals.symbols[i])));
+        }
     }
-    return args;
+    printf("\n");
 }
 
-EvalScope* create_scope(EvalScope* parent) {
-    EvalScope* scope = calloc(1, sizeof(EvalScope));
-    scope->functions = calloc(1, sizeof(Function));
-    scope->variables = calloc(1, sizeof(Variable));
-    scope->parent = parent;
-    return scope;
+Function* get_function(Evaluator* evaluator, ASTNode* func_node) {
+    return &evaluator->functions[evaluator->resolution.slots[func_node - evaluator->ast->nodes].slot];
 }
 
-Variable* get_variable(EvalScope* scope, const char* name) {
-    for (; scope; scope = scope->parent) {
-        for (Variable* var = scope->variables->next; var; var = var->next) {
-            if (strcmp(var->name, name) == 0) {
-                return var;
-            }
-        }
-    }
-    return NULL;
+void add_function(Evaluator* evaluator, ASTNode* funcdef_node, size_t arity) {
+    ASTNode* func_node = ast_first_child(evaluator->ast, funcdef_node);
+    // a redefinition replaces the function in place
+    Function* func = get_function(evaluator, func_node);
+    if (func->body && evaluator->memo) {
+        memo_clear(evaluator->memo);
+    }
+    func->arity = arity;
+    func->temps = evaluator->resolution.slots[funcdef_node - evaluator->ast->nodes].slot;
+    func->body = ast_next_sibling(evaluator->ast, func_node);
+    func->pure = evaluator->pure && evaluator->pure[funcdef_node - evaluator->ast->nodes];
 }
 
-void set_variable_value(EvalScope* scope, const char* name, Result value) {
-    Variable* existing = get_variable(scope, name);
-    if (existing != NULL) {
-        existing->value = value;
-        return;
+// the frames of one body nest no deeper than the parser allows, only calls are counted
+EvalFrame* push_frame(Evaluator* evaluator, ASTNode* node, size_t locals) {
+    if (evaluator->frame_count >= evaluator->frame_capacity) {
+        evaluator->frame_capacity = evaluator->frame_capacity ? evaluator->frame_capacity * 2 : 64;
+        evaluator->frames = mem_realloc(evaluator->frames, evaluator->frame_capacity * sizeof(EvalFrame));
     }
 
-    Variable* last = scope->variables;
-    for (; last->next; last = last->next) { }
-
-    Variable* new_var = calloc(1, sizeof(Variable));
-    new_var->value = value;
-
-    size_t name_len = strlen(name);
-    new_var->name = malloc(name_len + 1);
-    new_var->name[name_len] = '\0';
-    memcpy(new_var->name, name, name_len);
-
-    last->next = new_var;
-}
-
-Function* get_function(EvalScope* scope, const char* name) {
-    EvalScope* starting_scope = scope;
-    for (; scope; scope = scope->parent) {
-        for (Function* func = scope->functions->next; func; func = func->next) {
-            if (strcmp(func->name, name) == 0) {
-                if (starting_scope == func->scope) {
-                    fprintf(stderr, "[ERROR] Recursion is not allowed.");
-                    exit(1);
-                }
-                return func;
-            }
-        }
+    ASTNode* first_child = NULL;
+    switch (node->type) {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_BIG:
+    case NODE_SYMBOL:
+    case NODE_FUNCDEF: {
+    }
+    break;
+    case NODE_ASSIGN: {
+        // only the value is evaluated
+        first_child = ast_next_sibling(evaluator->ast, ast_first_child(evaluator->ast, node));
+    }
+    break;
+    default: {
+        first_child = ast_first_child(evaluator->ast, node);
+    }
     }
-    return NULL;
-}
-
-void free_function_fields(Function* func) {
-    free(func->name);
-    free_scope(func->scope);
-}
 
-void redefine_function(Function* old, EvalScope* scope, ASTNode* funcdef_node, int arity) {
-    free_scope(old->scope);
-    old->arity = arity;
-    old->scope = create_scope(scope);
-    old->args = funcdef_node->children->children;
-    old->body = funcdef_node->children->next;
+    evaluator->frames[evaluator->frame_count] = (EvalFrame) {
+        .node = node,
+        .next_child = first_child,
+        .locals = locals
+    };
+    return &evaluator->frames[evaluator->frame_count++];
 }
 
-Function* add_function(EvalScope* scope, ASTNode* funcdef_node, int arity) {
-    Function* existing = get_function(scope, funcdef_node->children->token->value);
-    if (existing != NULL) {
-        redefine_function(existing, scope, funcdef_node, arity);
-        return existing;
+void push_value(Evaluator* evaluator, Result value) {
+    if (evaluator->value_count >= evaluator->value_capacity) {
+        evaluator->value_capacity = evaluator->value_capacity ? evaluator->value_capacity * 2 : 64;
+        evaluator->values = mem_realloc(evaluator->values, evaluator->value_capacity * sizeof(Result));
     }
-
-    Function* new_func = calloc(1, sizeof(Function));
-    Function* last = scope->functions;
-    for (; last->next; last = last->next) { }
-
-    ASTNode* func_node = funcdef_node->children;
-
-    size_t name_len = strlen(func_node->token->value);
-    new_func->name = malloc(name_len + 1);
-    new_func->name[name_len] = '\0';
-    memcpy(new_func->name, func_node->token->value, name_len);
-
-    new_func->arity = arity;
-    new_func->scope = create_scope(scope);
-    new_func->args = funcdef_node->children->children;
-    new_func->body = funcdef_node->children->next;
-
-    last->next = new_func;
-
-    return new_func;
+    evaluator->values[evaluator->value_count++] = value;
 }
 
-Result _interpret_ast(EvalScope* scope, ASTNode* node);
+// called once every child of frame has been evaluated, their values are on top of the value stack
+void evaluate_node(Evaluator* evaluator, EvalFrame* frame) {
+    const AST* ast = evaluator->ast;
+    ASTNode* node = frame->node;
+    Result* argv = &evaluator->values[evaluator->value_count - frame->argc];
 
-Result interpret_ast(ASTNode* node) {
-    EvalScope* top_scope = create_scope(NULL);
-
-    Result res = _interpret_ast(top_scope, node);
-    free_scope(top_scope);
-    return res;
-}
-
-Result _interpret_ast(EvalScope* scope, ASTNode* node) {
     switch (node->type) {
-    case NODE_PROGRAM: {
-        ASTNode* expr;
-        for (expr = node->children; expr->next; expr = expr->next) {
-            _interpret_ast(scope, expr);
-        }
-        return _interpret_ast(scope, expr);
-    }
+    case NODE_PROGRAM:
     case NODE_UPLUS:
     case NODE_EXPR: {
-        return _interpret_ast(scope, node->children);
+        // the value of the (last) child is the value of the node
     }
+    break;
     case NODE_UMINUS: {
-        return ast_neg(_interpret_ast(scope, node->children));
+        argv[0] = ast_neg(argv[0]);
     }
+    break;
     case NODE_PLUS: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_add(a, b);
-        return result;
+        argv[0] = ast_add(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_MINUS: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_sub(a, b);
-        return result;
+        argv[0] = ast_sub(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_MULT: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_mul(a, b);
-        return result;
+        argv[0] = ast_mul(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_DIV: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_div(a, b);
-        return result;
+        argv[0] = ast_div(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_EXP: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_exp(a, b);
-        return result;
+        argv[0] = ast_exp(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_MOD: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_mod(a, b);
-        return result;
+        argv[0] = ast_mod(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_EQUALITY: {
-        Result a = _interpret_ast(scope, node->children);
-        Result b = _interpret_ast(scope, node->children->next);
-        Result result = ast_equal(a, b);
-        return result;
+        argv[0] = ast_equal(argv[0], argv[1]);
+        evaluator->value_count--;
     }
+    break;
     case NODE_FLOAT:
-    case NODE_INT: {
-        return create_result_from_node(node);
+    case NODE_INT:
+    case NODE_BIG: {
+        push_value(evaluator, create_result_from_node(node));
+    }
+    break;
+    case NODE_SHARED: {
+        VariableSlot shared = evaluator->resolution.shared[node->value.slot];
+        if (shared.local) {
+            evaluator->values[frame->locals + shared.slot] = argv[0];
+        } else {
+            evaluator->shared[shared.slot] = argv[0];
+        }
+    }
+    break;
+    case NODE_REUSE: {
+        VariableSlot shared = evaluator->resolution.shared[node->value.slot];
+        if (shared.local) {
+            push_value(evaluator, evaluator->values[frame->locals + shared.slot]);
+        } else {
+            push_value(evaluator, evaluator->shared[shared.slot]);
+        }
     }
+    break;
+    case NODE_IF: {
+        // the value of the branch evaluated is the value of the node
+    }
+    break;
     case NODE_BUILTIN_FUNCTION: {
-        if (!is_builtin_function(node->token->value)) {
-            fprintf(stderr, "Unknown function: '%s'\n", node->token->value);
-            exit(20);
-        }
-        Result* argv = build_function_arguments(scope, node);
-        assert(node->token != NULL);
-        Result result = ast_evaluate_builtin_function(
-                            node->token->value,
-                            get_function_arity(scope, node),
-                            argv);
-        free(argv);
-        return result;
+        const Builtin* builtin = node->value.builtin;
+        if ((int) frame->argc != builtin->arity) {
+            printf("[ERROR] Invalid number of arguments for function: ");
+            print_node(node);
+            printf("\n");
+            exit(EXIT_FAILURE);
+        }
+        // the arguments are read in place from the value stack
+        Result result = builtin->function(argv);
+        evaluator->value_count -= frame->argc;
+        push_value(evaluator, result);
     }
+    break;
     case NODE_SYMBOL: {
-        Variable* var =  get_variable(scope, node->token->value);
-        Result* var_value = &var->value;
-        if (var_value != NULL) {
-            return *var_value;
+        VariableSlot variable = evaluator->resolution.slots[node - ast->nodes];
+        if (variable.local) {
+            push_value(evaluator, evaluator->values[frame->locals + variable.slot]);
+        } else if (evaluator->defined[variable.slot]) {
+            push_value(evaluator, evaluator->globals[variable.slot]);
+        } else {
+            fprintf(stderr, "[ERROR] Undeclared variable: " SV_Fmt "\n", SV_Arg(node->token->value));
+            exit(1);
         }
-        fprintf(stderr, "[ERROR] Undeclared variable: %s", node->token->value);
-        exit(1);
     }
+    break;
     case NODE_ASSIGN: {
-        if (node->children->type != NODE_SYMBOL) {
+        ASTNode* target = ast_first_child(ast, node);
+        if (target->type != NODE_SYMBOL) {
             fprintf(stderr, "[ERROR] Cannot assign value to a literal");
             exit(1);
         }
-        Result var_value = _interpret_ast(scope, node->children->next);
-        set_variable_value(scope, node->children->token->value, var_value);
-        return var_value;
+        VariableSlot variable = evaluator->resolution.slots[target - ast->nodes];
+        if (variable.local) {
+            evaluator->values[frame->locals + variable.slot] = argv[0];
+        } else {
+            evaluator->globals[variable.slot] = argv[0];
+            evaluator->defined[variable.slot] = true;
+        }
     }
+    break;
     case NODE_FUNCDEF: {
-        ASTNode* func_node = node->children;
-        if (is_builtin_function(func_node->token->value))
+        ASTNode* func_node = ast_first_child(ast, node);
+        if (find_builtin(func_node->token->value))
         {
-            fprintf(stderr, "[ERROR] Trying to redefine '%s' builtin function.\n", func_node->token->value);
+            fprintf(stderr, "[ERROR] Trying to redefine '" SV_Fmt "' builtin function.\n", SV_Arg(func_node->token->value));
             exit(1);
         }
 
-        int arity = 0;
-        for (ASTNode* arg = func_node->children; arg; arg = arg->next) {
-            arity++;
-        }
-        add_function(scope, node, arity);
-        return (Result) {
+        add_function(evaluator, node, ast_count_children(ast, func_node));
+        push_value(evaluator, (Result) {
             .type = RESULT_INT,
-            .vali = 0,
-            .valf = 0
-        };
+            .vali = 0
+        });
     }
-
+    break;
     case NODE_FUNCTION: {
-        Function* func = get_function(scope, node->token->value);
-        if (func == NULL) {
-            fprintf(stderr, "[ERROR] Function '%s' is not defined", node->token->value);
+        if (frame->returning) {
+            // the value of the body replaces the arguments
+            Result value = evaluator->values[evaluator->value_count - 1];
+            if (frame->memo) {
+                // a pure body does not assign its arguments nor redefine functions
+                Function* func = get_function(evaluator, node);
+                memo_store(evaluator->memo, func->body - ast->nodes, func->arity, &evaluator->values[frame->locals], value);
+            }
+            evaluator->values[frame->locals] = value;
+            evaluator->value_count = frame->locals + 1;
+            evaluator->call_depth--;
+            break;
+        }
+
+        Function* func = get_function(evaluator, node);
+        if (func->body == NULL) {
+            fprintf(stderr, "[ERROR] Function '" SV_Fmt "' is not defined", SV_Arg(node->token->value));
             exit(1);
         }
-        ASTNode* arg_name = func->args;
-        ASTNode* arg_value = node->children; // func->{args}
-        size_t passed_args_count = ast_count_children(node);
-        if (passed_args_count != func->arity) {
-            fprintf(stderr, "[ERROR] Invalid number of arguments for function: %s. Expected %lu but got %lu",
-                    func->name,
-                    func->arity, passed_args_count);
+        if (frame->argc != func->arity) {
+            fprintf(stderr, "[ERROR] Invalid number of arguments for function: " SV_Fmt ". Expected %lu but got %lu",
+                    SV_Arg(node->token->value),
+                    func->arity, frame->argc);
             exit(1);
         }
 
-        for (size_t i = 0; i < func->arity; i++) {
-            set_variable_value(func->scope, arg_name->token->value, _interpret_ast(scope, arg_value));
-            arg_name = arg_name->next;
-            arg_value = arg_value->next;
+        bool memo = func->pure && evaluator->memo;
+        Result value;
+        if (memo && memo_lookup(evaluator->memo, func->body - ast->nodes, frame->argc, argv, &value)) {
+            evaluator->value_count -= frame->argc;
+            push_value(evaluator, value);
+            break;
         }
 
-        return _interpret_ast(func->scope, func->body);
+        size_t locals = evaluator->value_count - frame->argc;
+        if (evaluator->resolution.slots[node - ast->nodes].tail) {
+            // nothing is left to do in the frames of the running call above the one returning its
+            // value, which becomes the frame of this call, its result is not cached then
+            while (!evaluator->frames[evaluator->frame_count - 1].returning) {
+                evaluator->frame_count--;
+            }
+            evaluator->frames[evaluator->frame_count - 1].node = node;
+            evaluator->frames[evaluator->frame_count - 1].memo = memo;
+            memmove(&evaluator->values[frame->locals], argv, frame->argc * sizeof(Result));
+            locals = frame->locals;
+            evaluator->value_count = locals + frame->argc;
+        } else {
+            // the top level counts as one call, like the first frame of the VM
+            if (evaluator->call_depth + 1 >= MAX_NESTING_DEPTH) {
+                fprintf(stderr, "[ERROR] Calls nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+                exit(1);
+            }
+            evaluator->call_depth++;
+            EvalFrame* call = push_frame(evaluator, node, locals);
+            call->next_child = NULL;
+            call->returning = true;
+            call->memo = memo;
+        }
+        for (size_t i = 0; i < func->temps; i++) {
+            push_value(evaluator, (Result) {.type = RESULT_INT});
+        }
+        push_frame(evaluator, func->body, locals);
     }
+    break;
     default: {
 #ifdef _DEBUG
         printf("[ERROR] Unimplemented node: ");
@@ -835,83 +1074,83 @@ Result _interpret_ast(EvalScope* scope, ASTNode* node) {
     }
 }
 
-void free_AST(ASTNode* root) {
-    if (root->children != NULL) {
-        ASTNode* next_child;
-        for (ASTNode* child = root->children; child;) {
-            next_child = child->next;
-            free_AST(child);
-            child = next_child;
+Result interpret_ast(const AST* ast, Arena* arena) {
+    BIG_ARENA = arena;
+    Resolution resolution = resolve_variables(ast, arena);
+    Evaluator evaluator = {
+        .ast = ast,
+        .shared = arena_alloc(arena, ast->shared_count * sizeof(Result)),
+        .resolution = resolution,
+        .globals = arena_alloc(arena, resolution.globals.count * sizeof(Result)),
+        .defined = arena_alloc(arena, resolution.globals.count * sizeof(bool)),
+        .functions = arena_alloc(arena, resolution.functions.count * sizeof(Function)),
+        .pure = MEMOIZE ? memo_pure_functions(ast, arena) : NULL,
+        .memo = MEMOIZE ? memo_new() : NULL
+    };
+    ASTNode* root = ast_node(ast, ast->root);
+    push_frame(&evaluator, root, 0);
+
+    while (evaluator.frame_count > 0) {
+        EvalFrame* frame = &evaluator.frames[evaluator.frame_count - 1];
+        ASTNode* child = frame->next_child;
+        if (child == NULL) {
+            EvalFrame done = *frame;
+            evaluator.frame_count--;
+            evaluate_node(&evaluator, &done);
+            continue;
         }
-    }
 
-    if (root->value != NULL) {
-        free(root->value);
-    }
-
-    if (root->token) {
-        if (root->token->value) {
-            free(root->token->value);
+        frame->next_child = ast_next_sibling(ast, child);
+        if (frame->node->type == NODE_PROGRAM && frame->argc > 0) {
+            // only the value of the last statement is kept
+            evaluator.value_count--;
+        } else if (frame->node->type == NODE_IF && frame->argc == 1) {
+            // the condition replaced by the branch it selects, the other one is skipped
+            if (!ast_is_true(evaluator.values[--evaluator.value_count])) {
+                child = frame->next_child;
+            }
+            frame->next_child = NULL;
+        } else {
+            frame->argc++;
         }
-        free(root->token);
-    }
-    free(root);
-}
-
-void free_scope(EvalScope* scope);
-void free_variables(Variable* variables);
-
-void free_functions(Function* functions) {
-    if (functions == NULL) {
-        return;
+        push_frame(&evaluator, child, frame->locals);
     }
 
-    Function* func = functions;
-    if (func->scope->functions == NULL) {
-        printf("func '%s', scope is null\n", func->name);
+    Result result = {.type = RESULT_INT};
+    if (evaluator.value_count > 0) {
+        result = evaluator.values[evaluator.value_count - 1];
     }
-    free_scope(func->scope);
-    free(func->name);
-    free_functions(functions->next);
-    free(func);
-}
-
-void free_variables(Variable* variables) {
-    if (variables == NULL) {
-        return;
+    mem_free(evaluator.frames);
+    mem_free(evaluator.values);
+    if (evaluator.memo) {
+        memo_free(evaluator.memo);
     }
-
-    Variable* var = variables;
-    free(var->name);
-    free_variables(variables->next);
-    free(var);
-}
-
-void free_scope(EvalScope* scope) {
-    free_functions(scope->functions->next);
-    free_variables(scope->variables->next);
-    free(scope->functions);
-    free(scope->variables);
-    free(scope);
+    return result;
 }
 
 void print_node(ASTNode* node) {
     const char* node_name = NODE_NAMES[node->type];
     switch (node->type) {
     case NODE_INT: {
-        printf("%s(%d)", node_name, *((int*) node->value));
+        printf("%s(%d)", node_name, node->value.vali);
     }
     break;
     case NODE_FLOAT: {
-        printf("%s(%f)", node_name, *((double*) node->value));
+        printf("%s(%f)", node_name, node->value.valf);
     }
     break;
+    case NODE_BIG:
     case NODE_FUNCTION: {
-        printf("%s(%s)", node_name, node->token->value);
+        printf("%s(" SV_Fmt ")", node_name, SV_Arg(node->token->value));
     }
     break;
     case NODE_SYMBOL: {
-        printf("%s(%s)", node_name, node->token->value);
+        printf("%s(" SV_Fmt ")", node_name, SV_Arg(node->token->value));
+    }
+    break;
+    case NODE_SHARED:
+    case NODE_REUSE: {
+        printf("%s(#%u)", node_name, node->value.slot);
     }
     break;
     default: {
@@ -920,17 +1159,53 @@ void print_node(ASTNode* node) {
     }
 }
 
-void print_AST(ASTNode* root) {
-    print_node(root);
-    if (root->children == NULL) {
-        return;
-    }
-    printf(" -> {");
-    for (ASTNode* child = root->children; child; child = child->next) {
-        print_AST(child);
-        if (child->next) {
+typedef struct {
+    ASTNode* node;
+    bool closing;
+} PrintEntry;
+
+void print_AST(const AST* ast, ASTNode* root) {
+    size_t capacity = 64;
+    size_t count = 0;
+    PrintEntry* stack = mem_alloc(capacity * sizeof(PrintEntry));
+    stack[count++] = (PrintEntry) {
+        .node = root,
+        .closing = false
+    };
+
+    while (count > 0) {
+        PrintEntry entry = stack[--count];
+        ASTNode* node = entry.node;
+        if (entry.closing) {
+            printf("}");
+        } else {
+            print_node(node);
+            if (node->children) {
+                printf(" -> {");
+                size_t child_count = ast_count_children(ast, node);
+                if (count + child_count + 1 > capacity) {
+                    capacity = 2 * (count + child_count + 1);
+                    stack = mem_realloc(stack, capacity * sizeof(PrintEntry));
+                }
+                stack[count++] = (PrintEntry) {
+                    .node = node,
+                    .closing = true
+                };
+                // pushed last to first so the first child is printed next
+                size_t i = count + child_count;
+                for (ASTNode* child = ast_first_child(ast, node); child; child = ast_next_sibling(ast, child)) {
+                    stack[--i] = (PrintEntry) {
+                        .node = child,
+                        .closing = false
+                    };
+                }
+                count += child_count;
+                continue;
+            }
+        }
+        if (node != root && node->next) {
             printf(", ");
         }
     }
-    printf("}");
+    mem_free(stack);
 }
@@ -1,11 +1,14 @@
 #ifndef AST_H
 #define AST_H
 #include "./token.h"
+#include "./symbol.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     NODE_INT = 0,
     NODE_FLOAT,
+    NODE_BIG,    // integer literal too large for an int
     // unary operators
     NODE_UPLUS,
     NODE_UMINUS,
@@ -25,6 +28,10 @@ typedef enum {
     NODE_EXPR,
     NODE_PROGRAM,
     NODE_FUNCDEF,
+    NODE_IF,     // if(condition, then, else), only the branch the condition selects is evaluated
+    // common subexpressions, see optimize.h
+    NODE_SHARED, // evaluates its child once and keeps the value for the NODE_REUSE nodes
+    NODE_REUSE,  // value of a NODE_SHARED node evaluated before
     NODE_COUNT
 } NodeType;
 
@@ -55,40 +62,127 @@ typedef enum {
 } OpArity;
 
 
-typedef struct ASTNode {
+// Nodes live in one contiguous array and refer to each other by index,
+// index 0 is never a valid node and stands for "none".
+typedef uint32_t NodeIndex;
+
+// entry of the builtin registry, see builtins.h
+typedef struct Builtin Builtin;
+// see bigint.h
+typedef struct BigInt BigInt;
+
+typedef struct {
     Token* token;
-    void* value;
+    union {
+        int vali;
+        double valf;
+        const BigInt* valb; // NODE_BIG, allocated in the arena of the AST
+        uint32_t slot; // NODE_SHARED and NODE_REUSE: index of the shared value
+        Symbol symbol; // nodes made from a TOKEN_SYMBOL: their name
+        const Builtin* builtin; // NODE_BUILTIN_FUNCTION, set by the parser instead of the name
+    } value;
     NodeType type;
-    struct ASTNode* children;
-    struct ASTNode* next;
+    NodeIndex children; // first child
+    NodeIndex last_child;
+    NodeIndex next;
 } ASTNode;
 
+typedef struct {
+    ASTNode* nodes;
+    size_t count;
+    size_t capacity;
+    NodeIndex root;
+    size_t shared_count; // values of NODE_SHARED nodes, slots are numbered from 0
+    Arena* arena;
+} AST;
+
+// operator waiting for its right operand, NODE_COUNT marks an open parenthesis (node 0) or call
+typedef struct {
+    NodeIndex node;
+    NodeType type;
+} PendingOperator;
+
+// cursor over a token buffer, nodes are appended to ast
+typedef struct {
+    Tokens* tokens;
+    size_t cursor;
+    AST* ast;
+    // stacks of the expression parser, reused from one expression to the next
+    PendingOperator* operators;
+    size_t operator_count;
+    size_t operator_capacity;
+    NodeIndex* operands;
+    size_t operand_count;
+    size_t operand_capacity;
+} Parser;
+
+// Parsing and evaluation keep their state on heap allocated stacks instead of the C stack,
+// input nested deeper than this is rejected with an error.
+#define DEFAULT_MAX_NESTING_DEPTH (1 << 22)
+extern size_t MAX_NESTING_DEPTH;
+
 typedef enum  {
     RESULT_INT,
-    RESULT_FLOAT
+    RESULT_FLOAT,
+    RESULT_BIG // an integer that does not fit in an int, never one that does
 } ResultType;
 
+// Tagged union, only the field type names is set. 16 bytes on 64-bit targets, passed and
+// returned in registers.
 typedef struct {
     ResultType type;
-    int vali;
-    double valf;
+    union {
+        int vali;
+        double valf;
+        const BigInt* valb;
+    };
 } Result;
 
 
-// ASTNode* ast_next_expr(Token** tokens);
-// ASTNode* ast_next_operator(Token** tokens);
-// ASTNode* ast_next_term(Token** tokens);
-// ASTNode* ast_next_operand(Token** tokens);
-// ASTNode* ast_next_number(Token** tokens);
+// ASTNode* ast_next_expr(Parser* parser);
+// ASTNode* ast_next_operator(Parser* parser);
+// ASTNode* ast_next_term(Parser* parser);
+// ASTNode* ast_next_operand(Parser* parser);
+// ASTNode* ast_next_number(Parser* parser);
 // OpPrecedence get_operator_precedence(ASTNode* optor);
 // OpArity get_operator_arity(ASTNode* optor);
 
+static inline ASTNode* ast_node(const AST* ast, NodeIndex index) {
+    return index ? &ast->nodes[index] : NULL;
+}
+
+static inline ASTNode* ast_first_child(const AST* ast, const ASTNode* node) {
+    return ast_node(ast, node->children);
+}
+
+static inline ASTNode* ast_next_sibling(const AST* ast, const ASTNode* node) {
+    return ast_node(ast, node->next);
+}
+
+size_t ast_count_children(const AST* ast, ASTNode* node);
+// function is the NODE_FUNCTION node of a definition, NULL at the top level
+int ast_find_parameter(const AST* ast, ASTNode* function, Symbol name);
+
+// By node index, where a function body keeps the names that are not parameters. For its
+// NODE_SYMBOL nodes, the local of the call after the arguments, -1 for a global; for the
+// NODE_FUNCDEF nodes, the number of locals. A name assigned at the top level is a global
+// everywhere, any other name a body assigns is a local of each call of it. A read finds the
+// local only where every path from the start of the body has assigned it, elsewhere it reads
+// the global, which is never declared. Allocated in arena.
+int32_t* ast_function_locals(const AST* ast, Arena* arena);
+
+// true if child is the last thing parent evaluates and its value is the value of parent, a call
+// there is a tail call when parent is in tail position
+bool ast_is_tail_child(const AST* ast, const ASTNode* parent, const ASTNode* child);
+
+// appends a copy of node, which may move the node array
+NodeIndex ast_append_node(AST* ast, ASTNode node);
+
 bool ast_is_operator(ASTNode* node);
 void print_node(ASTNode* node);
-void print_AST(ASTNode* root);
+void print_AST(const AST* ast, ASTNode* root);
 
-ASTNode* build_AST(Token** tokens);
-Result interpret_ast(ASTNode* node);
-void dump_tokens(Token** tokens);
-void free_AST(ASTNode* ast);
+AST build_AST(Tokens* tokens, Arena* arena);
+Result interpret_ast(const AST* ast, Arena* arena);
+void dump_tokens(Parser* parser);
 #endif // AST_H
@@ -1,30 +1,25 @@
 #include "./ast_operations.h"
+#include "./bigint.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 #include <assert.h>
 
-Result create_result(Result a, Result b) {
-    Result result = {0};
-    if (a.type == RESULT_FLOAT || b.type == RESULT_FLOAT) {
-        // at least one float
-        result.type = RESULT_FLOAT;
-    } else {
-        // both int
-        result.type = RESULT_INT;
-    }
-    return result;
-}
+// "%.10f" of the largest double is 320 characters
+#define FLOAT_STRING_SIZE 330
 
 Result create_result_from_node(ASTNode* node) {
     Result result = {0};
     if (node->type == NODE_INT) {
         result.type = RESULT_INT;
-        result.vali = *((int*) node->value);
+        result.vali = node->value.vali;
     } else if (node->type == NODE_FLOAT) {
         result.type = RESULT_FLOAT;
-        result.valf = *((double*) node->value);
+        result.valf = node->value.valf;
+    } else if (node->type == NODE_BIG) {
+        result.type = RESULT_BIG;
+        result.valb = node->value.valb;
     } else {
         fprintf(stderr, "unreachable");
         exit(1);
@@ -32,345 +27,140 @@ Result create_result_from_node(ASTNode* node) {
     return result;
 }
 
-void check_zero_result(Result* result) {
-    if (result->type == RESULT_FLOAT && result->valf == 0) {
-        result->type = RESULT_INT;
-        result->vali = 0;
+double ast_as_double(Result value) {
+    if (value.type == RESULT_BIG) {
+        return big_to_double(value.valb);
     }
+    return value.type == RESULT_INT ? (double) value.vali : value.valf;
 }
 
-Result ast_do_binop(Result a, Result b, int (*funi) (int, int), double (*funf) (double, double)) {
-    Result result = create_result(a, b);
-    if (a.type == RESULT_FLOAT) {
-        if (b.type == RESULT_FLOAT) {
-            result.valf = funf(a.valf, b.valf);
-        } else {
-            result.valf = funf(a.valf, ((double) b.vali));
-        }
-    } else if (b.type == RESULT_FLOAT) {
-        result.valf = funf(((double) a.vali), b.valf);
-    } else {
-        result.vali = funi(((int) a.vali), b.vali);
+Result ast_big_result(const BigInt* value) {
+    if (big_fits_int(value)) {
+        return ast_int_result(big_to_int(value));
     }
-    check_zero_result(&result);
-    return result;
-}
-
-int addi(int a, int b) {
-    return a + b;
-}
-double addf(double a, double b) {
-    return a + b;
-}
-
-Result ast_add(Result a, Result b) {
-    return ast_do_binop(a, b, addi, addf);
-}
-
-int subi(int a, int b) {
-    return a - b;
-}
-double subf(double a, double b) {
-    return a - b;
+    return (Result) {.type = RESULT_BIG, .valb = value};
 }
 
-Result ast_sub(Result a, Result b) {
-    return ast_do_binop(a, b, subi, subf);
-}
-
-
-int muli(int a, int b) {
-    return a * b;
-}
-double mulf(double a, double b) {
-    return a * b;
+const BigInt* ast_as_big(Result value) {
+    return value.type == RESULT_BIG ? value.valb : big_from_int(value.vali);
 }
 
-Result ast_mul(Result a, Result b) {
-    return ast_do_binop(a, b, muli, mulf);
-}
-
-
-int divi(int a, int b) {
-    return a / b;
-}
-double divf(double a, double b) {
-    return a / b;
-}
-
-Result ast_div(Result a, Result b) {
-    if (b.type == RESULT_FLOAT) {
-        if (b.valf == 0) {
-            fprintf(stderr, "Division by zero");
-            exit(1);
-        }
-    } else if (b.vali == 0) {
-        fprintf(stderr, "Division by zero");
-        exit(1);
+#define AST_BIG_BINARY(name)                                                                \
+    static Result ast_##name##_big(Result a, Result b) {                                    \
+        if (a.type == RESULT_FLOAT || b.type == RESULT_FLOAT) {                             \
+            return ast_##name##_float(ast_as_double(a), ast_as_double(b));                  \
+        }                                                                                   \
+        return ast_big_result(big_##name(ast_as_big(a), ast_as_big(b)));                    \
     }
-    return ast_do_binop(a, b, divi, divf);
-}
-
-Result ast_exp(Result a, Result b) {
-    Result result = create_result(a, b);
-    if (a.type == RESULT_FLOAT) {
-        if (b.type == RESULT_FLOAT) {
-            if (a.valf == 0 && b.valf < 0) {
-                fprintf(stderr, "[ERROR] Cannot take 0 to a negative power");
-                exit(1);
-            }
-            result.valf = pow(a.valf, b.valf);
-        } else {
-            if (a.valf == 0 && b.vali < 0) {
-                fprintf(stderr, "[ERROR] Cannot take 0 to a negative power");
-                exit(1);
-            }
-            result.valf = pow(a.valf, b.vali);
-        }
-    } else if (b.type == RESULT_FLOAT) {
-        if (a.vali == 0 && b.valf < 0) {
-            fprintf(stderr, "[ERROR] Cannot take 0 to a negative power");
-            exit(1);
-        }
-
-        result.valf = pow((double) a.vali, b.valf);
-    } else {
-        if (a.vali == 0 && b.vali < 0) {
-            fprintf(stderr, "[ERROR] Cannot take 0 to a negative power");
-            exit(1);
-        }
 
-        result.vali = (int) pow(a.vali, b.vali);
+#define AST_BIG_DIVISION(name)                                                              \
+    static Result ast_##name##_big(Result a, Result b) {                                    \
+        if (a.type == RESULT_FLOAT || b.type == RESULT_FLOAT) {                             \
+            return ast_##name##_float(ast_as_double(a), ast_as_double(b));                  \
+        }                                                                                   \
+        if (b.type == RESULT_INT && b.vali == 0) {                                          \
+            ast_division_by_zero();                                                         \
+        }                                                                                   \
+        return ast_big_result(big_##name(ast_as_big(a), ast_as_big(b)));                    \
     }
-    check_zero_result(&result);
-    return result;
-}
 
-int imod(int a, int b) {
-    return (int) fmod(a, b);
-}
+AST_BIG_BINARY(add)
+AST_BIG_BINARY(sub)
+AST_BIG_BINARY(mul)
+AST_BIG_DIVISION(div)
+AST_BIG_DIVISION(mod)
 
-Result ast_mod(Result a, Result b) {
-    return ast_do_binop(a, b, imod, fmod);
+Result ast_wide_result(int64_t value) {
+    return ast_big_result(big_from_int(value));
 }
 
-Result ast_equal(Result a, Result b) {
-    Result result = {0};
-    result.type = RESULT_INT;
-    if (a.type == RESULT_FLOAT) {
-        if (b.type == RESULT_FLOAT) {
-            result.vali = a.valf == b.valf;
-        } else {
-            result.vali = a.valf == ((double) b.vali);
-        }
-    } else if (b.type == RESULT_FLOAT) {
-        result.vali = ((double) a.vali) == b.valf;
-    } else {
-        result.vali = ((int) a.vali) == b.vali;
+Result ast_int_power(int a, int b) {
+    if (a == 0 || a == 1) {
+        return ast_int_result(b == 0 ? 1 : a);
     }
-    return result;
-}
-
-Result ast_neg(Result x) {
-    return (Result) {
-        .type = x.type,
-        .vali = -(x.vali),
-        .valf = -(x.valf)
-    };
-}
-
-Result ast_sqrt(Result x) {
-    Result result = {0};
-    result.type = RESULT_FLOAT;
-
-    double x_val;
-    if (x.type == RESULT_INT) {
-        x_val = (double) x.vali;
-    } else {
-        x_val = x.valf;
+    if (a == -1) {
+        return ast_int_result(b % 2 == 0 ? 1 : -1);
     }
-
-    if (x_val < 0) {
-        fprintf(stderr, "[ERROR] Domain error, sqrt(x) where x < 0");
-        exit(1);
+    // |a| >= 2 leaves an int after at most 31 products, the last fits 64 bits
+    int64_t result = 1;
+    for (int i = 0; i < b; i++) {
+        result *= a;
+        if (result < INT_MIN || result > INT_MAX) {
+            return ast_big_result(big_pow(big_from_int(a), (uint64_t) b));
+        }
     }
-
-    result.valf = sqrt(x_val);
-    return result;
+    return ast_int_result((int) result);
 }
 
-int facti(int n) {
-    if (n == 0) {
-        return 1;
+// a big base is at least 2 in magnitude, a big exponent is too large unless the base is 0 or 1
+static Result ast_exp_big(Result a, Result b) {
+    if (a.type == RESULT_FLOAT || b.type == RESULT_FLOAT) {
+        return ast_exp_float(ast_as_double(a), ast_as_double(b));
     }
-    return n * facti(n - 1);
-}
-
-Result ast_facto(Result x) {
-    Result result = {0};
-    if (x.type == RESULT_INT) {
-        if (x.vali < 0) {
-            fprintf(stderr, "[ERROR] Domain error, facto(x) where x < 0");
-            exit(1);
-        }
-        result.type = RESULT_INT;
-        result.vali = facti(x.vali);
-
-    } else {
-        if (x.valf < -1) {
-            fprintf(stderr, "[ERROR] Domain error, facto(x) where x < 0");
-            exit(1);
+    if (b.type == RESULT_INT) {
+        return b.vali < 0 ? ast_int_result(0) : ast_big_result(big_pow(a.valb, (uint64_t) b.vali));
+    }
+    if (a.type == RESULT_INT && a.vali >= -1 && a.vali <= 1) {
+        if (a.vali == 0 && b.valb->negative) {
+            ast_zero_to_negative_power();
         }
-        result.type = RESULT_FLOAT;
-        result.valf = tgamma(x.valf + 1);
+        bool odd = b.valb->limbs[0] & 1;
+        return ast_int_result(a.vali == -1 && !odd ? 1 : a.vali);
     }
-    check_zero_result(&result);
-    return result;
-}
-
-int fibo(int n) {
-    if (n == 0 || n == 1) {
-        return n;
+    if (b.valb->negative) {
+        return ast_int_result(0);
     }
-    return fibo(n - 1) + fibo(n - 2);
+    fprintf(stderr, "[ERROR] Exponent too large");
+    exit(1);
 }
 
-Result ast_fibo(Result n) {
-    Result result = {
-        .type = RESULT_INT
-    };
-
-    int n_val;
-    if (n.type == RESULT_FLOAT) {
-        n_val = (int) n.valf;
-    } else {
-        n_val = n.vali;
-    }
-
-    if (n_val < 0) {
-        fprintf(stderr, "[ERROR] Domain error fibo(n) where n < 0");
-        exit(1);
+static Result ast_equal_big(Result a, Result b) {
+    if (a.type == RESULT_FLOAT || b.type == RESULT_FLOAT) {
+        return ast_equal_float(ast_as_double(a), ast_as_double(b));
     }
-
-    result.vali = fibo(n_val);
-    return result;
+    // an int is never equal to a big integer
+    return ast_int_result(a.type == b.type && big_compare(a.valb, b.valb) == 0);
 }
 
-int imin(int a, int b) {
-    return (int) fmin(a, b);
-}
-Result ast_min(Result a, Result b) {
-    return ast_do_binop(a, b, imin, fmin);
-}
-
-
-int imax(int a, int b) {
-    return (int) fmax(a, b);
-}
-Result ast_max(Result a, Result b) {
-    return ast_do_binop(a, b, imax, fmax);
-}
-
-
-int is_prime(int n) {
-    if (n <= 1) {
-        return 0;
-    }
-    if (n == 2) {
-        return 1;
-    }
-    if (n % 2 == 0) {
-        return 0;
+// one type check picks the kernel, there is no call through a function pointer
+#define AST_GENERIC_BINARY(name)                                         \
+    Result ast_##name(Result a, Result b) {                              \
+        if (a.type == RESULT_INT && b.type == RESULT_INT) {              \
+            return ast_##name##_int(a.vali, b.vali);                     \
+        }                                                                \
+        if (a.type == RESULT_BIG || b.type == RESULT_BIG) {              \
+            return ast_##name##_big(a, b);                               \
+        }                                                                \
+        return ast_##name##_float(ast_as_double(a), ast_as_double(b));   \
     }
 
-    int limit = (int) floor(sqrt(n));
+AST_GENERIC_BINARY(add)
+AST_GENERIC_BINARY(sub)
+AST_GENERIC_BINARY(mul)
+AST_GENERIC_BINARY(div)
+AST_GENERIC_BINARY(exp)
+AST_GENERIC_BINARY(mod)
+AST_GENERIC_BINARY(equal)
 
-    for (int i = 3; i <= limit; i++) {
-        if (n % i == 0) {
-            return 0;
-        }
+Result ast_neg(Result x) {
+    if (x.type == RESULT_INT) {
+        return x.vali == INT_MIN ? ast_wide_result(-(int64_t) INT_MIN) : ast_int_result(-x.vali);
     }
-    return 1;
-}
-Result ast_isprime(Result n) {
-    Result result = {
-        .type = RESULT_INT
-    };
-
-    if (n.type == RESULT_FLOAT) {
-        result.vali = 0;
-    } else {
-        result.vali = is_prime(n.vali);
+    if (x.type == RESULT_BIG) {
+        return ast_big_result(big_neg(x.valb));
     }
-
-    return result;
+    return (Result) {.type = RESULT_FLOAT, .valf = -x.valf};
 }
 
-int compute_gcd(int a, int b) {
-    while (a != 0 && b != 0) {
-        if (a > b) {
-            a %= b;
-        } else {
-            b %= a;
-        }
-    }
-    return a | b;
-}
-
-Result ast_gcd(Result a, Result b) {
-    int a_val, b_val;
-    if (a.type == RESULT_FLOAT) {
-        a_val = (int) a.valf;
-    } else {
-        a_val = a.vali;
-    }
-    if (b.type == RESULT_FLOAT) {
-        b_val = (int) b.valf;
-    } else {
-        b_val = b.vali;
+char* ast_result_string(Result value) {
+    if (value.type == RESULT_BIG) {
+        return big_to_string(value.valb);
     }
-
-    int gcd;
-    if (a_val < 0 && b_val < 0) {
-        a_val *= -1;
-        b_val *= -1;
-        gcd = (-1) * compute_gcd(a_val, b_val);
+    char* string = mem_alloc(FLOAT_STRING_SIZE);
+    if (value.type == RESULT_INT) {
+        snprintf(string, FLOAT_STRING_SIZE, "%d", value.vali);
     } else {
-        gcd = compute_gcd(a_val, b_val);
-    }
-
-    return (Result) {
-        .type = RESULT_INT,
-        .vali = gcd
-    };
-}
-
-Result ast_evaluate_builtin_function(const char* func_name, int argc, Result* argv) {
-    (void) argc;
-
-    if (strcmp(func_name, "sqrt") == 0) {
-        return ast_sqrt(argv[0]);
-    }
-    else if (strcmp(func_name, "facto") == 0) {
-        return ast_facto(argv[0]);
-    }
-    else if (strcmp(func_name, "fibo") == 0) {
-        return ast_fibo(argv[0]);
-    }
-    else if (strcmp(func_name, "max") == 0) {
-        return ast_max(argv[0], argv[1]);
-    }
-    else if (strcmp(func_name, "min") == 0) {
-        return ast_min(argv[0], argv[1]);
-    }
-    else if (strcmp(func_name, "isprime") == 0) {
-        return ast_isprime(argv[0]);
-    }
-    else if (strcmp(func_name, "gcd") == 0) {
-        return ast_gcd(argv[0], argv[1]);
-    }
-    else {
-        fprintf(stderr, "[ERROR] Unknown function.");
-        exit(1);
+        snprintf(string, FLOAT_STRING_SIZE, "%.10f", value.valf);
     }
+    return string;
 }
@@ -1,8 +1,145 @@
 #ifndef AST_OPS_H_
 #define AST_OPS_H_
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 #include "./ast.h"
 
+// Kernels for operands of known types, the compiler picks them ahead of time when it can infer
+// the types and the generic operations below pick one at run time. Mixed operands go to the
+// float kernels, the int one converted. A float result equal to zero becomes the int 0.
+static inline Result ast_int_result(int value) {
+    return (Result) {.type = RESULT_INT, .vali = value};
+}
+
+static inline Result ast_float_result(double value) {
+    if (value == 0) {
+        return ast_int_result(0);
+    }
+    return (Result) {.type = RESULT_FLOAT, .valf = value};
+}
+
+static inline void ast_division_by_zero(void) {
+    fprintf(stderr, "Division by zero");
+    exit(1);
+}
+
+static inline void ast_zero_to_negative_power(void) {
+    fprintf(stderr, "[ERROR] Cannot take 0 to a negative power");
+    exit(1);
+}
+
+// the result of an int operation that does not fit an int, as a big integer
+Result ast_wide_result(int64_t value);
+// a^b for b >= 0, exact
+Result ast_int_power(int a, int b);
+
+// int results that overflow are promoted to big integers
+static inline Result ast_add_int(int a, int b) {
+    int64_t result = (int64_t) a + b;
+    if (result < INT_MIN || result > INT_MAX) {
+        return ast_wide_result(result);
+    }
+    return ast_int_result((int) result);
+}
+
+static inline Result ast_sub_int(int a, int b) {
+    int64_t result = (int64_t) a - b;
+    if (result < INT_MIN || result > INT_MAX) {
+        return ast_wide_result(result);
+    }
+    return ast_int_result((int) result);
+}
+
+static inline Result ast_mul_int(int a, int b) {
+    int64_t result = (int64_t) a * b;
+    if (result < INT_MIN || result > INT_MAX) {
+        return ast_wide_result(result);
+    }
+    return ast_int_result((int) result);
+}
+
+static inline Result ast_div_int(int a, int b) {
+    if (b == 0) {
+        ast_division_by_zero();
+    }
+    if (a == INT_MIN && b == -1) {
+        return ast_wide_result(-(int64_t) INT_MIN);
+    }
+    return ast_int_result(a / b);
+}
+
+static inline Result ast_exp_int(int a, int b) {
+    if (b >= 0) {
+        return ast_int_power(a, b);
+    }
+    if (a == 0) {
+        ast_zero_to_negative_power();
+    }
+    return ast_int_result((int) pow(a, b));
+}
+
+static inline Result ast_mod_int(int a, int b) {
+    return ast_int_result((int) fmod(a, b));
+}
+
+static inline Result ast_equal_int(int a, int b) {
+    return ast_int_result(a == b);
+}
+
+static inline Result ast_add_float(double a, double b) {
+    return ast_float_result(a + b);
+}
+
+static inline Result ast_sub_float(double a, double b) {
+    return ast_float_result(a - b);
+}
+
+static inline Result ast_mul_float(double a, double b) {
+    return ast_float_result(a * b);
+}
+
+static inline Result ast_div_float(double a, double b) {
+    if (b == 0) {
+        ast_division_by_zero();
+    }
+    return ast_float_result(a / b);
+}
+
+static inline Result ast_exp_float(double a, double b) {
+    if (a == 0 && b < 0) {
+        ast_zero_to_negative_power();
+    }
+    return ast_float_result(pow(a, b));
+}
+
+static inline Result ast_mod_float(double a, double b) {
+    return ast_float_result(fmod(a, b));
+}
+
+static inline Result ast_equal_float(double a, double b) {
+    return ast_int_result(a == b);
+}
+
+// the condition of an if holds when it is not zero, a big integer never is
+static inline bool ast_is_true(Result value) {
+    if (value.type == RESULT_BIG) {
+        return true;
+    }
+    return value.type == RESULT_INT ? value.vali != 0 : value.valf != 0;
+}
+
+// Big integers: every operation on integer operands is exact, the quotient being truncated
+// toward zero. A float operand converts the big one to a float.
+Result ast_big_result(const BigInt* value); // an int when value fits
+const BigInt* ast_as_big(Result value);    // value is an int or a big integer
+double ast_as_double(Result value);
+// heap allocated, ints as "%d", floats as "%.10f" and big integers in full
+char* ast_result_string(Result value);
+
 Result ast_add(Result a, Result b);
 Result ast_sub(Result a, Result b);
 Result ast_mul(Result a, Result b);
@@ -10,7 +147,6 @@ Result ast_div(Result a, Result b);
 Result ast_exp(Result a, Result b);
 Result ast_mod(Result a, Result b);
 Result ast_equal(Result a, Result b);
-Result ast_evaluate_builtin_function(const char* func_name, int argc, Result* argv);
 Result ast_neg(Result x);
 Result create_result_from_node(ASTNode* node);
 
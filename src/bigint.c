@@ -0,0 +1,517 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "./bigint.h"
+
+Arena* BIG_ARENA = NULL;
+
+#define LIMB_BITS 32
+#define DECIMAL_CHUNK 1000000000u // 9 digits
+
+// count limbs, zeroed
+static BigInt* big_alloc(size_t count) {
+    if (BIG_ARENA == NULL) {
+        fprintf(stderr, "[ERROR] Big integer made outside of an evaluation\n");
+        exit(1);
+    }
+    return arena_alloc(BIG_ARENA, sizeof(BigInt) + count * sizeof(uint32_t));
+}
+
+// drops the leading zero limbs, zero is not negative
+static BigInt* big_normalize(BigInt* value) {
+    while (value->count > 0 && value->limbs[value->count - 1] == 0) {
+        value->count--;
+    }
+    if (value->count == 0) {
+        value->negative = false;
+    }
+    return value;
+}
+
+BigInt* big_from_uint(uint64_t value) {
+    BigInt* result = big_alloc(2);
+    result->limbs[0] = (uint32_t) value;
+    result->limbs[1] = (uint32_t) (value >> LIMB_BITS);
+    result->count = 2;
+    return big_normalize(result);
+}
+
+BigInt* big_from_int(int64_t value) {
+    BigInt* result = big_from_uint(value < 0 ? -(uint64_t) value : (uint64_t) value);
+    result->negative = value < 0;
+    return result;
+}
+
+BigInt* big_from_decimal(String_View digits, Arena* arena) {
+    // 9 digits hold in less than one limb
+    BigInt* result = arena_alloc(arena, sizeof(BigInt) + (digits.count / 9 + 1) * sizeof(uint32_t));
+    size_t i = 0;
+    while (i < digits.count) {
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (size_t end = i + 9; i < end && i < digits.count; i++) {
+            chunk = chunk * 10 + (uint32_t) (digits.data[i] - '0');
+            scale *= 10;
+        }
+        // result = result * scale + chunk
+        uint64_t carry = chunk;
+        for (size_t k = 0; k < result->count; k++) {
+            carry += (uint64_t) result->limbs[k] * scale;
+            result->limbs[k] = (uint32_t) carry;
+            carry >>= LIMB_BITS;
+        }
+        if (carry) {
+            result->limbs[result->count++] = (uint32_t) carry;
+        }
+    }
+    return result;
+}
+
+BigInt* big_copy(const BigInt* value, Arena* arena) {
+    size_t size = sizeof(BigInt) + value->count * sizeof(uint32_t);
+    BigInt* copy = arena_alloc(arena, size);
+    memcpy(copy, value, size);
+    return copy;
+}
+
+BigInt* big_neg(const BigInt* value) {
+    BigInt* result = big_copy(value, BIG_ARENA);
+    result->negative = value->count > 0 && !value->negative;
+    return result;
+}
+
+static int compare_magnitudes(const BigInt* a, const BigInt* b) {
+    if (a->count != b->count) {
+        return a->count < b->count ? -1 : 1;
+    }
+    for (size_t i = a->count; i-- > 0;) {
+        if (a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// |a| + |b|
+static BigInt* add_magnitudes(const BigInt* a, const BigInt* b) {
+    if (a->count < b->count) {
+        const BigInt* swap = a;
+        a = b;
+        b = swap;
+    }
+    BigInt* result = big_alloc(a->count + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        carry += (uint64_t) a->limbs[i] + (i < b->count ? b->limbs[i] : 0);
+        result->limbs[i] = (uint32_t) carry;
+        carry >>= LIMB_BITS;
+    }
+    result->limbs[a->count] = (uint32_t) carry;
+    result->count = a->count + 1;
+    return result;
+}
+
+// |a| - |b|, |a| >= |b|
+static BigInt* sub_magnitudes(const BigInt* a, const BigInt* b) {
+    BigInt* result = big_alloc(a->count);
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        int64_t difference = (int64_t) a->limbs[i] - (i < b->count ? b->limbs[i] : 0) - borrow;
+        borrow = difference < 0;
+        result->limbs[i] = (uint32_t) (difference + (borrow << LIMB_BITS));
+    }
+    result->count = a->count;
+    return result;
+}
+
+// a + b when b_negative is the sign of b, a - b when it is the opposite
+static BigInt* add_signed(const BigInt* a, const BigInt* b, bool b_negative) {
+    BigInt* result;
+    if (a->negative == b_negative) {
+        result = add_magnitudes(a, b);
+        result->negative = a->negative;
+    } else if (compare_magnitudes(a, b) >= 0) {
+        result = sub_magnitudes(a, b);
+        result->negative = a->negative;
+    } else {
+        result = sub_magnitudes(b, a);
+        result->negative = b_negative;
+    }
+    return big_normalize(result);
+}
+
+BigInt* big_add(const BigInt* a, const BigInt* b) {
+    return add_signed(a, b, b->negative);
+}
+
+BigInt* big_sub(const BigInt* a, const BigInt* b) {
+    return add_signed(a, b, b->count > 0 && !b->negative);
+}
+
+// The products work on magnitudes as arrays of limbs, least significant first, which may have
+// leading zero limbs. out[0 .. an + bn) = a * b and out overlaps neither operand.
+
+static void mul_schoolbook(uint32_t* out, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    memset(out, 0, (an + bn) * sizeof(uint32_t));
+    for (size_t i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < bn; j++) {
+            carry += (uint64_t) a[i] * b[j] + out[i + j];
+            out[i + j] = (uint32_t) carry;
+            carry >>= LIMB_BITS;
+        }
+        out[i + bn] = (uint32_t) carry;
+    }
+}
+
+// out[0 .. count) += a[0 .. an), an <= count, the carry out of the last limb is dropped
+static void add_limbs(uint32_t* out, size_t count, const uint32_t* a, size_t an) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < an; i++) {
+        carry += (uint64_t) out[i] + a[i];
+        out[i] = (uint32_t) carry;
+        carry >>= LIMB_BITS;
+    }
+    for (; carry && i < count; i++) {
+        carry += out[i];
+        out[i] = (uint32_t) carry;
+        carry >>= LIMB_BITS;
+    }
+}
+
+// out[0 .. count) -= a[0 .. an), an <= count and out >= a
+static void sub_limbs(uint32_t* out, size_t count, const uint32_t* a, size_t an) {
+    int64_t borrow = 0;
+    size_t i = 0;
+    for (; i < an; i++) {
+        int64_t difference = (int64_t) out[i] - a[i] - borrow;
+        borrow = difference < 0;
+        out[i] = (uint32_t) difference;
+    }
+    for (; borrow && i < count; i++) {
+        borrow = out[i] == 0;
+        out[i]--;
+    }
+}
+
+// operands shorter than this are multiplied limb by limb
+#define KARATSUBA_THRESHOLD 32
+// limbs of scratch space mul_limbs uses at most, it is split between the recursive calls
+#define MUL_SCRATCH(an, bn) (6 * ((an) + (bn)) + 1024)
+
+static void mul_limbs(uint32_t* out, const uint32_t* a, size_t an, const uint32_t* b, size_t bn, uint32_t* scratch);
+
+// Karatsuba, an >= bn > (an + 1) / 2: with a = a1 B^m + a0 and b = b1 B^m + b0, the middle term
+// a0 b1 + a1 b0 is (a0 + a1)(b0 + b1) - a0 b0 - a1 b1, three products of half the size
+static void mul_karatsuba(uint32_t* out, const uint32_t* a, size_t an, const uint32_t* b, size_t bn, uint32_t* scratch) {
+    size_t m = (an + 1) / 2;
+    mul_limbs(out, a, m, b, m, scratch);
+    mul_limbs(out + 2 * m, a + m, an - m, b + m, bn - m, scratch);
+
+    uint32_t* a_sum = scratch;
+    uint32_t* b_sum = a_sum + m + 1;
+    uint32_t* middle = b_sum + m + 1;
+    memset(a_sum, 0, 2 * (m + 1) * sizeof(uint32_t));
+    memcpy(a_sum, a, m * sizeof(uint32_t));
+    add_limbs(a_sum, m + 1, a + m, an - m);
+    memcpy(b_sum, b, m * sizeof(uint32_t));
+    add_limbs(b_sum, m + 1, b + m, bn - m);
+    mul_limbs(middle, a_sum, m + 1, b_sum, m + 1, middle + 2 * m + 2);
+    sub_limbs(middle, 2 * m + 2, out, 2 * m);
+    sub_limbs(middle, 2 * m + 2, out + 2 * m, an + bn - 2 * m);
+
+    // the limbs of the middle term past the end of the product are zero
+    size_t middle_count = 2 * m + 2 < an + bn - m ? 2 * m + 2 : an + bn - m;
+    add_limbs(out + m, an + bn - m, middle, middle_count);
+}
+
+static void mul_limbs(uint32_t* out, const uint32_t* a, size_t an, const uint32_t* b, size_t bn, uint32_t* scratch) {
+    if (an < bn) {
+        const uint32_t* swap = a;
+        a = b;
+        b = swap;
+        size_t swap_count = an;
+        an = bn;
+        bn = swap_count;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        mul_schoolbook(out, a, an, b, bn);
+        return;
+    }
+    if (bn > (an + 1) / 2) {
+        mul_karatsuba(out, a, an, b, bn, scratch);
+        return;
+    }
+
+    // a is much longer: it is cut in pieces of bn limbs, each multiplied by b and added in place
+    memset(out, 0, (an + bn) * sizeof(uint32_t));
+    uint32_t* piece = scratch;
+    for (size_t i = 0; i < an; i += bn) {
+        size_t count = an - i < bn ? an - i : bn;
+        mul_limbs(piece, a + i, count, b, bn, scratch + 2 * bn);
+        add_limbs(out + i, an + bn - i, piece, count + bn);
+    }
+}
+
+BigInt* big_mul(const BigInt* a, const BigInt* b) {
+    BigInt* result = big_alloc(a->count + b->count);
+    if (a->count > 0 && b->count > 0) {
+        bool small = a->count < KARATSUBA_THRESHOLD || b->count < KARATSUBA_THRESHOLD;
+        uint32_t* scratch = small ? NULL : mem_alloc(MUL_SCRATCH(a->count, b->count) * sizeof(uint32_t));
+        mul_limbs(result->limbs, a->limbs, a->count, b->limbs, b->count, scratch);
+        mem_free(scratch);
+    }
+    result->count = a->count + b->count;
+    result->negative = a->negative != b->negative;
+    return big_normalize(result);
+}
+
+// Long division of the magnitudes (Knuth's algorithm D): quotient[0 .. an - bn + 1) and
+// remainder[0 .. bn) of a[0 .. an) by b[0 .. bn), an >= bn >= 2 and the last limb of b is not zero.
+// Both are shifted left so that the top bit of b is set, then every limb of the quotient is
+// estimated from the top two limbs of what remains and the top one of b, and is off by 2 at most.
+static void divmod_limbs(uint32_t* quotient, uint32_t* remainder, const uint32_t* a, size_t an, const uint32_t* b, size_t bn) {
+    int shift = __builtin_clz(b[bn - 1]);
+    uint32_t* u = mem_alloc((an + 1) * sizeof(uint32_t));
+    uint32_t* v = mem_alloc(bn * sizeof(uint32_t));
+    for (size_t i = bn - 1; i > 0; i--) {
+        v[i] = (uint32_t) (b[i] << shift | (uint64_t) b[i - 1] >> (LIMB_BITS - shift));
+    }
+    v[0] = b[0] << shift;
+    u[an] = (uint32_t) ((uint64_t) a[an - 1] >> (LIMB_BITS - shift));
+    for (size_t i = an - 1; i > 0; i--) {
+        u[i] = (uint32_t) (a[i] << shift | (uint64_t) a[i - 1] >> (LIMB_BITS - shift));
+    }
+    u[0] = a[0] << shift;
+
+    const uint64_t base = (uint64_t) 1 << LIMB_BITS;
+    for (size_t j = an - bn + 1; j-- > 0;) {
+        uint64_t top = (uint64_t) u[j + bn] << LIMB_BITS | u[j + bn - 1];
+        uint64_t estimate = top / v[bn - 1];
+        uint64_t rest = top % v[bn - 1];
+        while (estimate >= base || estimate * v[bn - 2] > (rest << LIMB_BITS | u[j + bn - 2])) {
+            estimate--;
+            rest += v[bn - 1];
+            if (rest >= base) {
+                break;
+            }
+        }
+
+        // u[j ..] -= estimate * v
+        uint64_t carry = 0;
+        int64_t borrow = 0;
+        for (size_t i = 0; i < bn; i++) {
+            uint64_t product = estimate * v[i] + carry;
+            carry = product >> LIMB_BITS;
+            int64_t difference = (int64_t) u[i + j] - borrow - (int64_t) (product & 0xFFFFFFFFu);
+            u[i + j] = (uint32_t) difference;
+            borrow = difference < 0;
+        }
+        int64_t difference = (int64_t) u[j + bn] - borrow - (int64_t) carry;
+        u[j + bn] = (uint32_t) difference;
+
+        // one too many, v is added back
+        if (difference < 0) {
+            estimate--;
+            add_limbs(u + j, bn + 1, v, bn);
+        }
+        quotient[j] = (uint32_t) estimate;
+    }
+
+    for (size_t i = 0; i < bn; i++) {
+        remainder[i] = (uint32_t) (u[i] >> shift | (uint64_t) u[i + 1] << (LIMB_BITS - shift));
+    }
+    mem_free(v);
+    mem_free(u);
+}
+
+// quotient and remainder of a by a single limb, the limbs of quotient may be those of a
+static uint32_t divmod_limb(uint32_t* quotient, const uint32_t* a, size_t an, uint32_t b) {
+    uint64_t remainder = 0;
+    for (size_t i = an; i-- > 0;) {
+        uint64_t current = remainder << LIMB_BITS | a[i];
+        quotient[i] = (uint32_t) (current / b);
+        remainder = current % b;
+    }
+    return (uint32_t) remainder;
+}
+
+void big_divmod(const BigInt* a, const BigInt* b, BigInt** quotient, BigInt** remainder) {
+    if (b->count == 0) {
+        fprintf(stderr, "Division by zero");
+        exit(1);
+    }
+    BigInt* q;
+    BigInt* r;
+    if (compare_magnitudes(a, b) < 0) {
+        q = big_alloc(0);
+        r = big_copy(a, BIG_ARENA);
+    } else if (b->count == 1) {
+        q = big_alloc(a->count);
+        r = big_alloc(1);
+        r->limbs[0] = divmod_limb(q->limbs, a->limbs, a->count, b->limbs[0]);
+        q->count = a->count;
+        r->count = 1;
+    } else {
+        q = big_alloc(a->count - b->count + 1);
+        r = big_alloc(b->count);
+        divmod_limbs(q->limbs, r->limbs, a->limbs, a->count, b->limbs, b->count);
+        q->count = a->count - b->count + 1;
+        r->count = b->count;
+    }
+    // the quotient is truncated, the remainder has the sign of a
+    q->negative = a->negative != b->negative;
+    r->negative = a->negative;
+    *quotient = big_normalize(q);
+    *remainder = big_normalize(r);
+}
+
+BigInt* big_div(const BigInt* a, const BigInt* b) {
+    BigInt* quotient;
+    BigInt* remainder;
+    big_divmod(a, b, &quotient, &remainder);
+    return quotient;
+}
+
+BigInt* big_mod(const BigInt* a, const BigInt* b) {
+    BigInt* quotient;
+    BigInt* remainder;
+    big_divmod(a, b, &quotient, &remainder);
+    return remainder;
+}
+
+BigInt* big_pow(const BigInt* base, uint64_t exponent) {
+    BigInt* result = big_from_int(1);
+    // from the highest bit of the exponent, squaring the result for each once it is not 1
+    bool started = false;
+    for (int bit = 63; bit >= 0; bit--) {
+        if (started) {
+            result = big_mul(result, result);
+        }
+        if ((exponent >> bit) & 1) {
+            result = big_mul(result, base);
+            started = true;
+        }
+    }
+    return result;
+}
+
+// product of the integers from low to high, split in halves so that the operands of each
+// product have about the same size and the large ones go through Karatsuba
+static BigInt* product_range(uint64_t low, uint64_t high) {
+    if (high - low < 16) {
+        BigInt* result = big_from_uint(low);
+        for (uint64_t i = low + 1; i <= high; i++) {
+            result = big_mul(result, big_from_uint(i));
+        }
+        return result;
+    }
+    uint64_t middle = low + (high - low) / 2;
+    return big_mul(product_range(low, middle), product_range(middle + 1, high));
+}
+
+BigInt* big_factorial(uint64_t n) {
+    return n < 2 ? big_from_int(1) : product_range(2, n);
+}
+
+BigInt* big_gcd(const BigInt* a, const BigInt* b) {
+    BigInt* x = big_copy(a, BIG_ARENA);
+    BigInt* y = big_copy(b, BIG_ARENA);
+    x->negative = false;
+    y->negative = false;
+    while (y->count > 0) {
+        BigInt* remainder = big_mod(x, y);
+        x = y;
+        y = remainder;
+    }
+    return x;
+}
+
+int big_compare(const BigInt* a, const BigInt* b) {
+    if (a->negative != b->negative) {
+        return a->negative ? -1 : 1;
+    }
+    int magnitude = compare_magnitudes(a, b);
+    return a->negative ? -magnitude : magnitude;
+}
+
+bool big_fits_int(const BigInt* value) {
+    if (value->count > 1) {
+        return false;
+    }
+    uint32_t limit = value->negative ? (uint32_t) INT_MAX + 1 : INT_MAX;
+    return value->count == 0 || value->limbs[0] <= limit;
+}
+
+int big_to_int(const BigInt* value) {
+    if (value->count == 0) {
+        return 0;
+    }
+    int64_t magnitude = value->limbs[0];
+    return (int) (value->negative ? -magnitude : magnitude);
+}
+
+bool big_fits_uint64(const BigInt* value) {
+    return !value->negative && value->count <= 2;
+}
+
+uint64_t big_to_uint64(const BigInt* value) {
+    uint64_t result = 0;
+    for (size_t i = value->count; i-- > 0;) {
+        result = result << LIMB_BITS | value->limbs[i];
+    }
+    return result;
+}
+
+double big_to_double(const BigInt* value) {
+    double result = 0;
+    for (size_t i = value->count; i-- > 0;) {
+        result = result * 4294967296.0 + value->limbs[i];
+    }
+    return value->negative ? -result : result;
+}
+
+uint64_t big_hash(const BigInt* value) {
+    uint64_t hash = 14695981039346656037u ^ value->negative;
+    for (size_t i = 0; i < value->count; i++) {
+        hash = (hash ^ value->limbs[i]) * 1099511628211u;
+    }
+    return hash;
+}
+
+char* big_to_string(const BigInt* value) {
+    // 32 bits are less than 10 digits, so less than 2 chunks of 9
+    size_t count = value->count;
+    uint32_t* quotient = mem_alloc((count + 1) * sizeof(uint32_t));
+    uint32_t* chunks = mem_alloc((2 * count + 1) * sizeof(uint32_t));
+    memcpy(quotient, value->limbs, count * sizeof(uint32_t));
+    size_t chunk_count = 0;
+    while (count > 0) {
+        uint64_t remainder = 0;
+        for (size_t i = count; i-- > 0;) {
+            uint64_t current = remainder << LIMB_BITS | quotient[i];
+            quotient[i] = (uint32_t) (current / DECIMAL_CHUNK);
+            remainder = current % DECIMAL_CHUNK;
+        }
+        chunks[chunk_count++] = (uint32_t) remainder;
+        while (count > 0 && quotient[count - 1] == 0) {
+            count--;
+        }
+    }
+
+    char* string = mem_alloc(9 * chunk_count + 3);
+    char* cursor = string;
+    if (value->negative) {
+        *cursor++ = '-';
+    }
+    cursor += sprintf(cursor, "%u", chunk_count > 0 ? chunks[chunk_count - 1] : 0);
+    for (size_t i = chunk_count - (chunk_count > 0); i-- > 0;) {
+        cursor += sprintf(cursor, "%09u", chunks[i]);
+    }
+    mem_free(chunks);
+    mem_free(quotient);
+    return string;
+}
@@ -0,0 +1,52 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "./ast.h"
+
+// Integer of any size, never modified once made. Its value is the sum of limbs[i] * 2^(32 i),
+// negated when negative. Zero has no limbs and is not negative.
+struct BigInt {
+    size_t count; // the last limb is not zero
+    bool negative;
+    uint32_t limbs[];
+};
+
+// arena the big integers are allocated from, interpret_ast, vm_run and jit_run set it to the
+// arena of the evaluation
+extern Arena* BIG_ARENA;
+
+BigInt* big_from_int(int64_t value);
+BigInt* big_from_uint(uint64_t value);
+// digits is not empty and only holds decimal digits
+BigInt* big_from_decimal(String_View digits, Arena* arena);
+BigInt* big_copy(const BigInt* value, Arena* arena);
+BigInt* big_neg(const BigInt* value);
+BigInt* big_add(const BigInt* a, const BigInt* b);
+BigInt* big_sub(const BigInt* a, const BigInt* b);
+// Karatsuba once both operands have a few dozen limbs
+BigInt* big_mul(const BigInt* a, const BigInt* b);
+// the quotient is truncated toward zero, the remainder has the sign of a, b is not zero
+void big_divmod(const BigInt* a, const BigInt* b, BigInt** quotient, BigInt** remainder);
+BigInt* big_div(const BigInt* a, const BigInt* b);
+BigInt* big_mod(const BigInt* a, const BigInt* b);
+BigInt* big_pow(const BigInt* base, uint64_t exponent);
+BigInt* big_factorial(uint64_t n);
+// not negative
+BigInt* big_gcd(const BigInt* a, const BigInt* b);
+// -1, 0 or 1 as a is less than, equal to or greater than b
+int big_compare(const BigInt* a, const BigInt* b);
+bool big_fits_int(const BigInt* value);
+// value must fit
+int big_to_int(const BigInt* value);
+bool big_fits_uint64(const BigInt* value);
+// value must fit
+uint64_t big_to_uint64(const BigInt* value);
+// a double close to value, infinite beyond the range of doubles
+double big_to_double(const BigInt* value);
+uint64_t big_hash(const BigInt* value);
+// decimal digits after a '-' when negative, heap allocated
+char* big_to_string(const BigInt* value);
+
+#endif // BIGINT_H
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "./builtins.h"
+#include "./ast_operations.h"
+#include "./bigint.h"
+#include "./primes.h"
+
+// calls are only folded when their argument is small enough to be cheap to evaluate
+#define MAX_FOLDED_FIBO 1000
+#define MAX_FOLDED_FACTO 100
+#define MAX_FOLDED_PRIMEPI 1000000
+
+// the int builtins truncate float arguments
+static int as_int(Result value) {
+    if (value.type == RESULT_BIG) {
+        fprintf(stderr, "[ERROR] Integer too large for a builtin function");
+        exit(1);
+    }
+    return value.type == RESULT_INT ? value.vali : (int) value.valf;
+}
+
+static bool fits_int(Result value) {
+    if (value.type == RESULT_BIG) {
+        return false;
+    }
+    return value.type == RESULT_INT || (value.valf > INT_MIN - 1.0 && value.valf < INT_MAX + 1.0);
+}
+
+static Result builtin_sqrt(const Result* args) {
+    double x = ast_as_double(args[0]);
+    if (x < 0) {
+        fprintf(stderr, "[ERROR] Domain error, sqrt(x) where x < 0");
+        exit(1);
+    }
+    return (Result) {.type = RESULT_FLOAT, .valf = sqrt(x)};
+}
+
+static bool sqrt_foldable(const Result* args) {
+    return ast_as_double(args[0]) >= 0;
+}
+
+// ints up to facto(12), big integers after it, the gamma function on floats
+static Result builtin_facto(const Result* args) {
+    Result x = args[0];
+    if (x.type != RESULT_FLOAT) {
+        int n = as_int(x);
+        if (n < 0) {
+            fprintf(stderr, "[ERROR] Domain error, facto(x) where x < 0");
+            exit(1);
+        }
+        return ast_big_result(big_factorial((uint64_t) n));
+    }
+    if (x.valf < -1) {
+        fprintf(stderr, "[ERROR] Domain error, facto(x) where x < 0");
+        exit(1);
+    }
+    return ast_float_result(tgamma(x.valf + 1));
+}
+
+static bool facto_foldable(const Result* args) {
+    if (args[0].type == RESULT_INT) {
+        return args[0].vali >= 0 && args[0].vali <= MAX_FOLDED_FACTO;
+    }
+    return args[0].type == RESULT_FLOAT && args[0].valf >= -1;
+}
+
+// fibo(93) is the largest to fit in 64 bits
+#define MAX_UINT64_FIBO 93
+
+// Fast doubling: from a = F(k) and b = F(k + 1), F(2k) = a (2b - a) and F(2k + 1) = a^2 + b^2.
+// The bits of n are read from the highest, each one doubles k and adds the bit to it.
+static uint64_t fibo_uint64(int n) {
+    uint64_t a = 0;
+    uint64_t b = 1;
+    for (int bit = 30; bit >= 0; bit--) {
+        // F(k + 2) wraps around past MAX_UINT64_FIBO, it is not used then
+        uint64_t doubled = a * (2 * b - a);
+        uint64_t next = a * a + b * b;
+        if ((n >> bit) & 1) {
+            a = next;
+            b = doubled + next;
+        } else {
+            a = doubled;
+            b = next;
+        }
+    }
+    return a;
+}
+
+static const BigInt* fibo_big(int n) {
+    const BigInt* a = big_from_int(0);
+    const BigInt* b = big_from_int(1);
+    for (int bit = 30; bit >= 0; bit--) {
+        const BigInt* doubled = big_mul(a, big_sub(big_add(b, b), a));
+        const BigInt* next = big_add(big_mul(a, a), big_mul(b, b));
+        if ((n >> bit) & 1) {
+            a = next;
+            b = big_add(doubled, next);
+        } else {
+            a = doubled;
+            b = next;
+        }
+    }
+    return a;
+}
+
+// ints up to fibo(46), big integers after it
+static Result builtin_fibo(const Result* args) {
+    int n = as_int(args[0]);
+    if (n < 0) {
+        fprintf(stderr, "[ERROR] Domain error fibo(n) where n < 0");
+        exit(1);
+    }
+    if (n <= MAX_UINT64_FIBO) {
+        uint64_t value = fibo_uint64(n);
+        return value <= INT_MAX ? ast_int_result((int) value) : ast_big_result(big_from_uint(value));
+    }
+    return ast_big_result(fibo_big(n));
+}
+
+static bool fibo_foldable(const Result* args) {
+    return fits_int(args[0]) && as_int(args[0]) >= 0 && as_int(args[0]) <= MAX_FOLDED_FIBO;
+}
+
+// min and max of integers of which one is big are exact
+static Result builtin_min(const Result* args) {
+    if (args[0].type == RESULT_INT && args[1].type == RESULT_INT) {
+        return ast_int_result((int) fmin(args[0].vali, args[1].vali));
+    }
+    if (args[0].type != RESULT_FLOAT && args[1].type != RESULT_FLOAT) {
+        return big_compare(ast_as_big(args[0]), ast_as_big(args[1])) <= 0 ? args[0] : args[1];
+    }
+    return ast_float_result(fmin(ast_as_double(args[0]), ast_as_double(args[1])));
+}
+
+static Result builtin_max(const Result* args) {
+    if (args[0].type == RESULT_INT && args[1].type == RESULT_INT) {
+        return ast_int_result((int) fmax(args[0].vali, args[1].vali));
+    }
+    if (args[0].type != RESULT_FLOAT && args[1].type != RESULT_FLOAT) {
+        return big_compare(ast_as_big(args[0]), ast_as_big(args[1])) >= 0 ? args[0] : args[1];
+    }
+    return ast_float_result(fmax(ast_as_double(args[0]), ast_as_double(args[1])));
+}
+
+// the argument of the prime builtins: floats are truncated and negative values count as 0,
+// false past 64 bits
+static bool as_uint64(Result value, uint64_t* n) {
+    *n = 0;
+    if (value.type == RESULT_BIG) {
+        if (value.valb->negative) {
+            return true;
+        }
+        if (!big_fits_uint64(value.valb)) {
+            return false;
+        }
+        *n = big_to_uint64(value.valb);
+    } else if (value.type == RESULT_FLOAT) {
+        if (value.valf >= 18446744073709551616.0) {
+            return false;
+        }
+        *n = value.valf < 0 ? 0 : (uint64_t) value.valf;
+    } else if (value.vali > 0) {
+        *n = (uint64_t) value.vali;
+    }
+    return true;
+}
+
+static Result uint64_result(uint64_t value) {
+    return value <= INT_MAX ? ast_int_result((int) value) : ast_big_result(big_from_uint(value));
+}
+
+static Result builtin_isprime(const Result* args) {
+    uint64_t n;
+    if (args[0].type == RESULT_FLOAT) {
+        return ast_int_result(0);
+    }
+    if (!as_uint64(args[0], &n)) {
+        fprintf(stderr, "[ERROR] Domain error, isprime(n) where n >= 2^64");
+        exit(1);
+    }
+    return ast_int_result(is_prime(n));
+}
+
+static bool isprime_foldable(const Result* args) {
+    uint64_t n;
+    return args[0].type == RESULT_FLOAT || as_uint64(args[0], &n);
+}
+
+static Result builtin_nextprime(const Result* args) {
+    uint64_t n;
+    uint64_t prime;
+    if (!as_uint64(args[0], &n) || (prime = next_prime(n)) == 0) {
+        fprintf(stderr, "[ERROR] Domain error, nextprime(n) where n >= 2^64 - 59");
+        exit(1);
+    }
+    return uint64_result(prime);
+}
+
+static bool nextprime_foldable(const Result* args) {
+    return fits_int(args[0]);
+}
+
+static Result builtin_primepi(const Result* args) {
+    uint64_t n;
+    if (!as_uint64(args[0], &n) || n > MAX_PRIME_PI) {
+        fprintf(stderr, "[ERROR] Domain error, primepi(n) where n > 2^40");
+        exit(1);
+    }
+    return uint64_result(prime_pi(n));
+}
+
+static bool primepi_foldable(const Result* args) {
+    return fits_int(args[0]) && as_int(args[0]) <= MAX_FOLDED_PRIMEPI;
+}
+
+// Euclid on magnitudes, |INT_MIN| does not fit an int
+static unsigned compute_gcd(unsigned a, unsigned b) {
+    while (b != 0) {
+        unsigned remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+static unsigned magnitude(int x) {
+    return x < 0 ? 0u - (unsigned) x : (unsigned) x;
+}
+
+// a float operand is truncated as by as_int
+static const BigInt* as_big_int(Result value) {
+    return value.type == RESULT_FLOAT ? big_from_int(as_int(value)) : ast_as_big(value);
+}
+
+static Result builtin_gcd(const Result* args) {
+    if (args[0].type == RESULT_BIG || args[1].type == RESULT_BIG) {
+        const BigInt* a = as_big_int(args[0]);
+        const BigInt* b = as_big_int(args[1]);
+        const BigInt* gcd = big_gcd(a, b);
+        return ast_big_result(a->negative && b->negative ? big_neg(gcd) : gcd);
+    }
+    int a = as_int(args[0]);
+    int b = as_int(args[1]);
+    int64_t gcd = compute_gcd(magnitude(a), magnitude(b));
+    // negative when both operands are, gcd(INT_MIN, 0) is a big integer
+    if (a < 0 && b < 0) {
+        gcd = -gcd;
+    }
+    return gcd > INT_MAX ? ast_wide_result(gcd) : ast_int_result((int) gcd);
+}
+
+static bool gcd_foldable(const Result* args) {
+    return fits_int(args[0]) && fits_int(args[1]);
+}
+
+const Builtin BUILTINS[] = {
+    {SV_STATIC("sqrt"), 1, BUILTIN_PURE | BUILTIN_FLOAT, builtin_sqrt, sqrt_foldable},
+    {SV_STATIC("facto"), 1, BUILTIN_PURE, builtin_facto, facto_foldable},
+    {SV_STATIC("fibo"), 1, BUILTIN_PURE, builtin_fibo, fibo_foldable},
+    {SV_STATIC("min"), 2, BUILTIN_PURE | BUILTIN_INT_ON_INTS, builtin_min, NULL},
+    {SV_STATIC("max"), 2, BUILTIN_PURE | BUILTIN_INT_ON_INTS, builtin_max, NULL},
+    {SV_STATIC("isprime"), 1, BUILTIN_PURE | BUILTIN_INT, builtin_isprime, isprime_foldable},
+    {SV_STATIC("gcd"), 2, BUILTIN_PURE, builtin_gcd, gcd_foldable},
+    {SV_STATIC("nextprime"), 1, BUILTIN_PURE, builtin_nextprime, nextprime_foldable},
+    {SV_STATIC("primepi"), 1, BUILTIN_PURE | BUILTIN_INT_ON_INTS, builtin_primepi, primepi_foldable},
+};
+const size_t BUILTIN_COUNT = sizeof(BUILTINS) / sizeof(BUILTINS[0]);
+
+// Perfect hash: the seed of the hash is the first one sending every name to an entry of its own
+#define BUILTIN_TABLE_SIZE 32 // power of two
+_Static_assert(2 * sizeof(BUILTINS) / sizeof(BUILTINS[0]) <= BUILTIN_TABLE_SIZE, "too many builtins for the table");
+
+static const Builtin* builtin_table[BUILTIN_TABLE_SIZE];
+static uint32_t builtin_seed = 0; // 0 until the table is built
+
+static uint32_t hash_builtin_name(String_View name, uint32_t seed) {
+    // FNV-1a from a seeded offset, mixed at the end for the low bits
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (size_t i = 0; i < name.count; i++) {
+        hash = (hash ^ (uint8_t) name.data[i]) * 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash & (BUILTIN_TABLE_SIZE - 1);
+}
+
+static void build_builtin_table(void) {
+    for (uint32_t seed = 1; seed < 1 << 16; seed++) {
+        memset(builtin_table, 0, sizeof(builtin_table));
+        size_t placed = 0;
+        while (placed < BUILTIN_COUNT) {
+            const Builtin** entry = &builtin_table[hash_builtin_name(BUILTINS[placed].name, seed)];
+            if (*entry) {
+                break;
+            }
+            *entry = &BUILTINS[placed++];
+        }
+        if (placed == BUILTIN_COUNT) {
+            builtin_seed = seed;
+            return;
+        }
+    }
+    fprintf(stderr, "[ERROR] No perfect hash for the builtin names, is one of them defined twice?\n");
+    exit(1);
+}
+
+const Builtin* find_builtin(String_View name) {
+    if (builtin_seed == 0) {
+        build_builtin_table();
+    }
+    const Builtin* builtin = builtin_table[hash_builtin_name(name, builtin_seed)];
+    return builtin && sv_eq(builtin->name, name) ? builtin : NULL;
+}
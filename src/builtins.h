@@ -0,0 +1,38 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "./ast.h"
+
+// arguments are read in place, arity of them
+typedef Result (*BuiltinFunction)(const Result* args);
+
+typedef enum {
+    BUILTIN_PURE = 1 << 0,        // the result only depends on the arguments: calls are shared and cached
+    BUILTIN_INT = 1 << 1,         // the result is always an int
+    BUILTIN_FLOAT = 1 << 2,       // the result is always a float, zero included
+    BUILTIN_INT_ON_INTS = 1 << 3, // the result is an int when every argument is
+} BuiltinFlags;
+
+#define MAX_BUILTIN_ARITY 2
+
+// Every builtin is one entry of BUILTINS, NODE_BUILTIN_FUNCTION nodes point to theirs and the
+// bytecode refers to it by its index.
+struct Builtin {
+    String_View name;
+    int arity;
+    unsigned flags;
+    BuiltinFunction function;
+    // false when calling function on these constant arguments would fail, hang or take long,
+    // NULL when it never does. The optimizer only folds the calls it accepts.
+    bool (*foldable)(const Result* args);
+};
+
+extern const Builtin BUILTINS[];
+extern const size_t BUILTIN_COUNT;
+
+// NULL if name is not a builtin, one hash of the name and one comparison through a perfect hash
+// table, built on the first lookup
+const Builtin* find_builtin(String_View name);
+
+#endif // BUILTINS_H
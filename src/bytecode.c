@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "./bytecode.h"
+#include "./builtins.h"
+#include "./ast_operations.h"
+
+const char* OPCODE_NAMES[BC_COUNT] = {
+    "CONST", "LOAD_LOCAL", "STORE_LOCAL", "LOAD_GLOBAL", "STORE_GLOBAL", "NEG", "ADD", "SUB", "MUL", "DIV",
+    "EXP", "MOD", "EQUAL", "POP", "DEFINE", "CALL", "CALL_BUILTIN", "RETURN", "TAIL_CALL", "JUMP", "JUMP_IF_FALSE", "ADD_INT", "SUB_INT",
+    "MUL_INT", "DIV_INT", "EXP_INT", "MOD_INT", "EQUAL_INT", "ADD_FLOAT", "SUB_FLOAT", "MUL_FLOAT", "DIV_FLOAT",
+    "EXP_FLOAT", "MOD_FLOAT", "EQUAL_FLOAT", "CONST_CONST", "ADD_CONST", "SUB_CONST", "MUL_CONST", "DIV_CONST",
+    "LOCAL_ADD_CONST", "LOCAL_SUB_CONST", "LOCAL_MUL_CONST", "LOCAL_DIV_CONST", "MUL_ADD", "ADD_MUL"
+};
+
+int SUPERINSTRUCTIONS = 1;
+int TYPED_INSTRUCTIONS = 1;
+
+// binary operator nodes to their instruction
+const Opcode BINARY_OPS[NODE_COUNT] = {
+    [NODE_PLUS] = BC_ADD, [NODE_MINUS] = BC_SUB, [NODE_MULT] = BC_MUL, [NODE_DIV] = BC_DIV,
+    [NODE_EXP] = BC_EXP, [NODE_MOD] = BC_MOD, [NODE_EQUALITY] = BC_EQUAL
+};
+const Opcode INT_OPS[NODE_COUNT] = {
+    [NODE_PLUS] = BC_ADD_INT, [NODE_MINUS] = BC_SUB_INT, [NODE_MULT] = BC_MUL_INT, [NODE_DIV] = BC_DIV_INT,
+    [NODE_EXP] = BC_EXP_INT, [NODE_MOD] = BC_MOD_INT, [NODE_EQUALITY] = BC_EQUAL_INT
+};
+const Opcode FLOAT_OPS[NODE_COUNT] = {
+    [NODE_PLUS] = BC_ADD_FLOAT, [NODE_MINUS] = BC_SUB_FLOAT, [NODE_MULT] = BC_MUL_FLOAT, [NODE_DIV] = BC_DIV_FLOAT,
+    [NODE_EXP] = BC_EXP_FLOAT, [NODE_MOD] = BC_MOD_FLOAT, [NODE_EQUALITY] = BC_EQUAL_FLOAT
+};
+
+// node whose children are being compiled, the compiler walks the tree with an explicit stack like the evaluator
+typedef struct {
+    ASTNode* node;
+    ASTNode* next_child;
+    uint32_t chunk;      // chunk the code of node goes to
+    uint32_t body_chunk; // chunk of the function a FUNCDEF node defines
+    ASTNode* function;   // function whose parameters are in scope, NULL at the top level
+    size_t children;     // children compiled so far
+    StaticType operand_types[3]; // of the first three children
+    bool tail;           // the value of node is the value of the function body it is in
+    size_t jump;         // NODE_IF: jump to the end of the node, patched once it is known
+} CompileFrame;
+
+typedef struct {
+    const AST* ast;
+    Program* program;
+    uint32_t* shared_locals; // local of each NODE_SHARED slot in the chunk it is compiled to
+    int32_t* variables;      // see ast_function_locals()
+    // Types are inferred in evaluation order: the type of a variable is the type of the last value
+    // assigned to it. Calls may assign any global, they make them all unknown again. Function
+    // bodies run later, the globals they read are unknown.
+    StaticType* shared_types;
+    StaticType* global_types;
+    size_t global_type_count;
+    StaticType local_types[MAX_CALL_ARGC + 1]; // parameters of the function being compiled
+    bool* pure; // by node index, see memo_pure_functions(), NULL when not memoizing
+    CompileFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+} Compiler;
+
+void check_operand(size_t value, size_t max, const char* what) {
+    if (value > max) {
+        fprintf(stderr, "[ERROR] Too many %s in one program (at most %zu)\n", what, max);
+        exit(1);
+    }
+}
+
+uint32_t add_chunk(Program* program) {
+    program->chunks = reserve_item(program->arena, program->chunks, program->chunk_count, &program->chunk_capacity, sizeof(Chunk));
+    check_operand(program->chunk_count, MAX_INSTRUCTION_ARG, "functions");
+    program->chunks[program->chunk_count] = (Chunk) {0};
+    return program->chunk_count++;
+}
+
+// instruction to fuse CONST k and op into, 0 if there is none
+Opcode const_superinstruction(Opcode op, bool local) {
+    // saving a dispatch is worth more than the type check a typed instruction saves
+    switch (op) {
+    case BC_ADD: case BC_ADD_INT: case BC_ADD_FLOAT: return local ? BC_LOCAL_ADD_CONST : BC_ADD_CONST;
+    case BC_SUB: case BC_SUB_INT: case BC_SUB_FLOAT: return local ? BC_LOCAL_SUB_CONST : BC_SUB_CONST;
+    case BC_MUL: case BC_MUL_INT: case BC_MUL_FLOAT: return local ? BC_LOCAL_MUL_CONST : BC_MUL_CONST;
+    case BC_DIV: case BC_DIV_INT: case BC_DIV_FLOAT: return local ? BC_LOCAL_DIV_CONST : BC_DIV_CONST;
+    default: return 0;
+    }
+}
+
+// Fuses op with the instructions at the end of the chunk. The right operand of a binary
+// instruction is always pushed by the instruction right before it, so looking back down to
+// the last jump target is enough to recognize the shapes. Returns false if op was not fused.
+bool fuse_instruction(Chunk* chunk, Opcode op, uint32_t arg) {
+    if (chunk->count <= chunk->label) {
+        return false;
+    }
+    Instruction* last = &chunk->code[chunk->count - 1];
+    Instruction* previous = chunk->count > chunk->label + 1 ? last - 1 : NULL;
+    Opcode last_op = INSTRUCTION_OP(*last);
+    uint32_t last_arg = INSTRUCTION_ARG(*last);
+
+    if (op == BC_CONST && last_op == BC_CONST && last_arg <= MAX_PAIR_ARG && arg <= MAX_PAIR_ARG) {
+        *last = INSTRUCTION(BC_CONST_CONST, PAIR_ARG(last_arg, arg));
+        return true;
+    }
+    if (const_superinstruction(op, false) && last_op == BC_CONST) {
+        if (previous && INSTRUCTION_OP(*previous) == BC_LOAD_LOCAL
+                && INSTRUCTION_ARG(*previous) <= MAX_PAIR_ARG && last_arg <= MAX_PAIR_ARG) {
+            *previous = INSTRUCTION(const_superinstruction(op, true), PAIR_ARG(INSTRUCTION_ARG(*previous), last_arg));
+            chunk->count--;
+        } else {
+            *last = INSTRUCTION(const_superinstruction(op, false), last_arg);
+        }
+        return true;
+    }
+    if (op == BC_ADD && last_op == BC_MUL) {
+        *last = INSTRUCTION(BC_ADD_MUL, 0);
+        return true;
+    }
+    if (op == BC_ADD && (last_op == BC_LOAD_LOCAL || last_op == BC_LOAD_GLOBAL)
+            && previous && INSTRUCTION_OP(*previous) == BC_MUL) {
+        // z is loaded before the product is computed, which needs one more stack slot
+        *previous = *last;
+        *last = INSTRUCTION(BC_MUL_ADD, 0);
+        if (chunk->stack_depth + 1 > chunk->max_stack) {
+            chunk->max_stack = chunk->stack_depth + 1;
+        }
+        return true;
+    }
+    return false;
+}
+
+void emit(Program* program, uint32_t chunk_index, Opcode op, uint32_t arg, int stack_effect) {
+    Chunk* chunk = &program->chunks[chunk_index];
+    if (!SUPERINSTRUCTIONS || !fuse_instruction(chunk, op, arg)) {
+        chunk->code = reserve_item(program->arena, chunk->code, chunk->count, &chunk->capacity, sizeof(Instruction));
+        chunk->code[chunk->count++] = INSTRUCTION(op, arg);
+    }
+
+    chunk->stack_depth += stack_effect;
+    if (chunk->stack_depth > chunk->max_stack) {
+        chunk->max_stack = chunk->stack_depth;
+    }
+}
+
+uint32_t add_constant(Program* program, Result value) {
+    program->constants = reserve_item(program->arena, program->constants, program->constant_count,
+                                      &program->constant_capacity, sizeof(Result));
+    check_operand(program->constant_count, MAX_INSTRUCTION_ARG, "constants");
+    program->constants[program->constant_count] = value;
+    return program->constant_count++;
+}
+
+uint32_t global_slot(Program* program, Symbol name) {
+    uint32_t slot = symbol_slot(&program->globals, program->arena, name);
+    check_operand(slot, MAX_INSTRUCTION_ARG, "variables");
+    return slot;
+}
+
+uint32_t function_slot(Program* program, Symbol name) {
+    uint32_t slot = symbol_slot(&program->functions, program->arena, name);
+    check_operand(slot, MAX_CALL_SLOT, "function names");
+    return slot;
+}
+
+void push_compile_frame(Compiler* compiler, ASTNode* node, uint32_t chunk, ASTNode* function, bool tail) {
+    if (compiler->frame_count >= MAX_NESTING_DEPTH) {
+        fprintf(stderr, "[ERROR] Compilation nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+        exit(1);
+    }
+    if (compiler->frame_count >= compiler->frame_capacity) {
+        compiler->frame_capacity = compiler->frame_capacity ? compiler->frame_capacity * 2 : 64;
+        compiler->frames = mem_realloc(compiler->frames, compiler->frame_capacity * sizeof(CompileFrame));
+    }
+
+    CompileFrame frame = {
+        .node = node,
+        .chunk = chunk,
+        .function = function,
+        .tail = tail
+    };
+    switch (node->type) {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_BIG:
+    case NODE_SYMBOL: {
+    }
+    break;
+    case NODE_ASSIGN: {
+        // the target is not compiled as an expression
+        frame.next_child = ast_next_sibling(compiler->ast, ast_first_child(compiler->ast, node));
+    }
+    break;
+    case NODE_FUNCDEF: {
+        // only the body is compiled, in a chunk of its own
+        ASTNode* func_node = ast_first_child(compiler->ast, node);
+        frame.next_child = ast_next_sibling(compiler->ast, func_node);
+        frame.body_chunk = add_chunk(compiler->program);
+        // known before the body is compiled, its shared values go after the arguments
+        Chunk* body = &compiler->program->chunks[frame.body_chunk];
+        body->arity = ast_count_children(compiler->ast, func_node);
+        check_operand(body->arity, MAX_CALL_ARGC, "parameters");
+        body->temps = compiler->variables[node - compiler->ast->nodes];
+        check_operand(body->arity + body->temps, MAX_INSTRUCTION_ARG, "variables");
+        body->pure = compiler->pure && compiler->pure[node - compiler->ast->nodes];
+        memset(compiler->local_types, 0, sizeof(compiler->local_types));
+    }
+    break;
+    default: {
+        frame.next_child = ast_first_child(compiler->ast, node);
+    }
+    }
+    compiler->frames[compiler->frame_count++] = frame;
+}
+
+// static type of a variable, NULL for the names of a function body that are not parameters
+StaticType* variable_type(Compiler* compiler, const CompileFrame* frame, Symbol name) {
+    int param = ast_find_parameter(compiler->ast, frame->function, name);
+    if (param >= 0) {
+        return &compiler->local_types[param];
+    }
+    if (frame->function) {
+        return NULL;
+    }
+    uint32_t slot = global_slot(compiler->program, name);
+    if (slot >= compiler->global_type_count) {
+        size_t count = compiler->program->globals.capacity;
+        compiler->global_types = mem_realloc(compiler->global_types, count * sizeof(StaticType));
+        memset(compiler->global_types + compiler->global_type_count, 0,
+               (count - compiler->global_type_count) * sizeof(StaticType));
+        compiler->global_type_count = count;
+    }
+    return &compiler->global_types[slot];
+}
+
+// emits the instruction of a binary operator for the types of its operands, returns the type of its result
+StaticType emit_binary(Program* program, uint32_t chunk, NodeType type, StaticType a, StaticType b) {
+    // an int mixed with a float keeps the generic instruction, its one branch is cheaper
+    // than dispatching a conversion and it can still be fused
+    if (TYPED_INSTRUCTIONS && a == TYPE_INT && b == TYPE_INT) {
+        emit(program, chunk, INT_OPS[type], 0, -1);
+    } else if (TYPED_INSTRUCTIONS && a == TYPE_FLOAT && b == TYPE_FLOAT) {
+        emit(program, chunk, FLOAT_OPS[type], 0, -1);
+    } else {
+        emit(program, chunk, BINARY_OPS[type], 0, -1);
+    }
+    // a float result equal to zero becomes an int and an int result that overflows a big
+    // integer, only comparisons and the modulo of ints give a result of a known type
+    if (type == NODE_EQUALITY || (type == NODE_MOD && a == TYPE_INT && b == TYPE_INT)) {
+        return TYPE_INT;
+    }
+    return TYPE_ANY;
+}
+
+// type of the result of a builtin, from its flags
+StaticType builtin_type(const Builtin* builtin, const StaticType* args) {
+    if (builtin->flags & BUILTIN_FLOAT) {
+        return TYPE_FLOAT;
+    }
+    if (builtin->flags & BUILTIN_INT) {
+        return TYPE_INT;
+    }
+    if (builtin->flags & BUILTIN_INT_ON_INTS) {
+        for (int i = 0; i < builtin->arity; i++) {
+            if (args[i] != TYPE_INT) {
+                return TYPE_ANY;
+            }
+        }
+        return TYPE_INT;
+    }
+    return TYPE_ANY;
+}
+
+// emits a jump to an instruction that is not known yet, returns its index for patch_jump
+size_t emit_jump(Program* program, uint32_t chunk, Opcode op) {
+    emit(program, chunk, op, 0, -1);
+    return program->chunks[chunk].count - 1;
+}
+
+// makes the jump at index land on the next instruction
+void patch_jump(Program* program, uint32_t chunk_index, size_t jump) {
+    Chunk* chunk = &program->chunks[chunk_index];
+    check_operand(chunk->count, MAX_INSTRUCTION_ARG, "instructions in one function");
+    chunk->code[jump] = INSTRUCTION(INSTRUCTION_OP(chunk->code[jump]), chunk->count);
+    chunk->label = chunk->count;
+}
+
+// global_types is NULL until a global is typed
+void forget_global_types(Compiler* compiler) {
+    if (compiler->global_type_count > 0) {
+        memset(compiler->global_types, 0, compiler->global_type_count * sizeof(StaticType));
+    }
+}
+
+// a branch may not run, the types it gives to variables are not known after it nor in the other one
+void forget_types(Compiler* compiler) {
+    memset(compiler->local_types, 0, sizeof(compiler->local_types));
+    forget_global_types(compiler);
+}
+
+// emits the code between the children of a NODE_IF: the condition jumps over the then
+// branch, which jumps over the else branch, or returns when the value of the if is returned
+void compile_branch(Compiler* compiler, CompileFrame* frame) {
+    Program* program = compiler->program;
+    if (frame->children == 1) {
+        frame->jump = emit_jump(program, frame->chunk, BC_JUMP_IF_FALSE);
+    } else {
+        size_t otherwise = frame->jump;
+        // the value of the then branch is not on the stack of the else branch
+        if (frame->tail) {
+            emit(program, frame->chunk, BC_RETURN, 0, -1);
+        } else {
+            frame->jump = emit_jump(program, frame->chunk, BC_JUMP);
+        }
+        patch_jump(program, frame->chunk, otherwise);
+    }
+    forget_types(compiler);
+}
+
+// emits the code of a node once its children are compiled, returns the type of its value
+StaticType compile_node(Compiler* compiler, CompileFrame* frame) {
+    const AST* ast = compiler->ast;
+    Program* program = compiler->program;
+    ASTNode* node = frame->node;
+    uint32_t chunk = frame->chunk;
+    StaticType* operand_types = frame->operand_types;
+    StaticType type = TYPE_ANY;
+
+    switch (node->type) {
+    case NODE_PROGRAM: {
+        if (frame->children == 0) {
+            emit(program, chunk, BC_CONST, add_constant(program, (Result) {.type = RESULT_INT}), 1);
+        }
+        emit(program, chunk, BC_RETURN, 0, -1);
+    }
+    break;
+    case NODE_UPLUS:
+    case NODE_EXPR: {
+        if (frame->children == 1) {
+            type = operand_types[0];
+        }
+    }
+    break;
+    case NODE_UMINUS: {
+        emit(program, chunk, BC_NEG, 0, 0);
+        // -INT_MIN is a big integer
+        type = operand_types[0] == TYPE_FLOAT ? TYPE_FLOAT : TYPE_ANY;
+    }
+    break;
+    case NODE_PLUS:
+    case NODE_MINUS:
+    case NODE_MULT:
+    case NODE_DIV:
+    case NODE_EXP:
+    case NODE_MOD:
+    case NODE_EQUALITY: {
+        type = emit_binary(program, chunk, node->type, operand_types[0], operand_types[1]);
+    }
+    break;
+    case NODE_INT: {
+        Result value = {.type = RESULT_INT, .vali = node->value.vali};
+        emit(program, chunk, BC_CONST, add_constant(program, value), 1);
+        type = TYPE_INT;
+    }
+    break;
+    case NODE_FLOAT: {
+        Result value = {.type = RESULT_FLOAT, .valf = node->value.valf};
+        emit(program, chunk, BC_CONST, add_constant(program, value), 1);
+        type = TYPE_FLOAT;
+    }
+    break;
+    case NODE_BIG: {
+        Result value = {.type = RESULT_BIG, .valb = node->value.valb};
+        emit(program, chunk, BC_CONST, add_constant(program, value), 1);
+        type = TYPE_ANY;
+    }
+    break;
+    case NODE_SYMBOL: {
+        int param = ast_find_parameter(ast, frame->function, node->value.symbol);
+        if (param >= 0) {
+            emit(program, chunk, BC_LOAD_LOCAL, param, 1);
+        } else if (frame->function && compiler->variables[node - ast->nodes] >= 0) {
+            emit(program, chunk, BC_LOAD_LOCAL, program->chunks[chunk].arity + compiler->variables[node - ast->nodes], 1);
+        } else {
+            emit(program, chunk, BC_LOAD_GLOBAL, global_slot(program, node->value.symbol), 1);
+        }
+        StaticType* variable = variable_type(compiler, frame, node->value.symbol);
+        type = variable ? *variable : TYPE_ANY;
+    }
+    break;
+    case NODE_SHARED: {
+        Chunk* code = &program->chunks[chunk];
+        check_operand(code->arity + code->temps, MAX_INSTRUCTION_ARG, "shared values");
+        uint32_t local = code->arity + code->temps++;
+        compiler->shared_locals[node->value.slot] = local;
+        emit(program, chunk, BC_STORE_LOCAL, local, 0);
+        type = operand_types[0];
+        compiler->shared_types[node->value.slot] = type;
+    }
+    break;
+    case NODE_REUSE: {
+        emit(program, chunk, BC_LOAD_LOCAL, compiler->shared_locals[node->value.slot], 1);
+        type = compiler->shared_types[node->value.slot];
+    }
+    break;
+    case NODE_ASSIGN: {
+        ASTNode* target = ast_first_child(ast, node);
+        if (target->type != NODE_SYMBOL) {
+            fprintf(stderr, "[ERROR] Cannot assign value to a literal");
+            exit(1);
+        }
+        int param = ast_find_parameter(ast, frame->function, target->value.symbol);
+        if (param >= 0) {
+            emit(program, chunk, BC_STORE_LOCAL, param, 0);
+        } else if (frame->function && compiler->variables[target - ast->nodes] >= 0) {
+            emit(program, chunk, BC_STORE_LOCAL, program->chunks[chunk].arity + compiler->variables[target - ast->nodes], 0);
+        } else {
+            emit(program, chunk, BC_STORE_GLOBAL, global_slot(program, target->value.symbol), 0);
+        }
+        type = operand_types[0];
+        StaticType* variable = variable_type(compiler, frame, target->value.symbol);
+        if (variable) {
+            *variable = type;
+        }
+    }
+    break;
+    case NODE_BUILTIN_FUNCTION: {
+        const Builtin* builtin = node->value.builtin;
+        if ((int) frame->children != builtin->arity) {
+            printf("[ERROR] Invalid number of arguments for function: ");
+            print_node(node);
+            printf("\n");
+            exit(EXIT_FAILURE);
+        }
+        emit(program, chunk, BC_CALL_BUILTIN, CALL_ARG(builtin - BUILTINS, frame->children), 1 - (int) frame->children);
+        type = builtin_type(builtin, operand_types);
+    }
+    break;
+    case NODE_FUNCTION: {
+        check_operand(frame->children, MAX_CALL_ARGC, "arguments");
+        uint32_t slot = function_slot(program, node->value.symbol);
+        Opcode call = frame->tail ? BC_TAIL_CALL : BC_CALL;
+        emit(program, chunk, call, CALL_ARG(slot, frame->children), 1 - (int) frame->children);
+        if (frame->function == NULL) {
+            forget_global_types(compiler);
+        }
+    }
+    break;
+    case NODE_IF: {
+        if (!frame->tail) {
+            patch_jump(program, chunk, frame->jump);
+        }
+        forget_types(compiler);
+        if (operand_types[1] == operand_types[2]) {
+            type = operand_types[1];
+        }
+    }
+    break;
+    case NODE_FUNCDEF: {
+        ASTNode* func_node = ast_first_child(ast, node);
+        if (find_builtin(func_node->token->value))
+        {
+            fprintf(stderr, "[ERROR] Trying to redefine '" SV_Fmt "' builtin function.\n", SV_Arg(func_node->token->value));
+            exit(1);
+        }
+        emit(program, frame->body_chunk, BC_RETURN, 0, -1);
+
+        Chunk* body = &program->chunks[frame->body_chunk];
+        body->name = func_node->token->value;
+        body->function_slot = function_slot(program, func_node->value.symbol);
+        emit(program, chunk, BC_DEFINE, frame->body_chunk, 1);
+        type = TYPE_INT;
+    }
+    break;
+    default: {
+        fprintf(stderr, "[ERROR] Cannot compile node: ");
+        print_node(node);
+        fprintf(stderr, "\n");
+        exit(1);
+    }
+    }
+    return type;
+}
+
+Program* compile_ast(const AST* ast, Arena* arena) {
+    Program* program = arena_alloc(arena, sizeof(Program));
+    program->arena = arena;
+    Compiler compiler = {
+        .ast = ast,
+        .program = program,
+        .shared_locals = arena_alloc(arena, ast->shared_count * sizeof(uint32_t)),
+        .shared_types = arena_alloc(arena, ast->shared_count * sizeof(StaticType)),
+        .variables = ast_function_locals(ast, arena),
+        .pure = MEMOIZE ? memo_pure_functions(ast, arena) : NULL
+    };
+
+    uint32_t main_chunk = add_chunk(program);
+    push_compile_frame(&compiler, ast_node(ast, ast->root), main_chunk, NULL, false);
+
+    while (compiler.frame_count > 0) {
+        CompileFrame* frame = &compiler.frames[compiler.frame_count - 1];
+        ASTNode* child = frame->next_child;
+        if (child == NULL) {
+            CompileFrame done = *frame;
+            compiler.frame_count--;
+            StaticType type = compile_node(&compiler, &done);
+            if (compiler.frame_count > 0) {
+                CompileFrame* parent = &compiler.frames[compiler.frame_count - 1];
+                if (parent->children <= 3) {
+                    parent->operand_types[parent->children - 1] = type;
+                }
+            }
+            continue;
+        }
+
+        frame->next_child = ast_next_sibling(ast, child);
+        if (frame->node->type == NODE_PROGRAM && frame->children > 0) {
+            // only the value of the last statement is kept
+            emit(program, frame->chunk, BC_POP, 0, -1);
+        } else if (frame->node->type == NODE_IF && frame->children > 0) {
+            compile_branch(&compiler, frame);
+        }
+        frame->children++;
+
+        if (frame->node->type == NODE_FUNCDEF) {
+            push_compile_frame(&compiler, child, frame->body_chunk, ast_first_child(ast, frame->node), true);
+        } else {
+            bool tail = frame->tail && ast_is_tail_child(ast, frame->node, child);
+            push_compile_frame(&compiler, child, frame->chunk, frame->function, tail);
+        }
+    }
+
+    mem_free(compiler.frames);
+    mem_free(compiler.global_types);
+    return program;
+}
+
+static void print_constant(FILE* out, const Program* program, uint32_t index) {
+    Result value = program->constants[index];
+    if (value.type == RESULT_INT) {
+        fprintf(out, "%u (%d)", index, value.vali);
+    } else if (value.type == RESULT_BIG) {
+        char* string = ast_result_string(value);
+        fprintf(out, "%u (%s)", index, string);
+        mem_free(string);
+    } else {
+        fprintf(out, "%u (%f)", index, value.valf);
+    }
+}
+
+static void print_instruction(FILE* out, const Program* program, Instruction instruction) {
+    Opcode op = INSTRUCTION_OP(instruction);
+    uint32_t arg = INSTRUCTION_ARG(instruction);
+    fprintf(out, "%-16s", OPCODE_NAMES[op]);
+    switch (op) {
+    case BC_CONST:
+    case BC_ADD_CONST:
+    case BC_SUB_CONST:
+    case BC_MUL_CONST:
+    case BC_DIV_CONST: {
+        print_constant(out, program, arg);
+    }
+    break;
+    case BC_CONST_CONST: {
+        print_constant(out, program, PAIR_FIRST(arg));
+        fprintf(out, " ");
+        print_constant(out, program, PAIR_SECOND(arg));
+    }
+    break;
+    case BC_LOCAL_ADD_CONST:
+    case BC_LOCAL_SUB_CONST:
+    case BC_LOCAL_MUL_CONST:
+    case BC_LOCAL_DIV_CONST: {
+        fprintf(out, "%u ", PAIR_FIRST(arg));
+        print_constant(out, program, PAIR_SECOND(arg));
+    }
+    break;
+    case BC_LOAD_LOCAL:
+    case BC_STORE_LOCAL: {
+        fprintf(out, "%u", arg);
+    }
+    break;
+    case BC_LOAD_GLOBAL:
+    case BC_STORE_GLOBAL: {
+        fprintf(out, "%u (" SV_Fmt ")", arg, SV_Arg(symbol_name(program->globals.symbols[arg])));
+    }
+    break;
+    case BC_DEFINE: {
+        fprintf(out, "%u (" SV_Fmt ")", arg, SV_Arg(program->chunks[arg].name));
+    }
+    break;
+    case BC_CALL:
+    case BC_TAIL_CALL: {
+        fprintf(out, SV_Fmt " %u", SV_Arg(symbol_name(program->functions.symbols[CALL_SLOT(arg)])), CALL_ARGC(arg));
+    }
+    break;
+    case BC_JUMP:
+    case BC_JUMP_IF_FALSE: {
+        fprintf(out, "%04u", arg);
+    }
+    break;
+    case BC_CALL_BUILTIN: {
+        fprintf(out, SV_Fmt " %u", SV_Arg(BUILTINS[CALL_SLOT(arg)].name), CALL_ARGC(arg));
+    }
+    break;
+    default: {
+    }
+    }
+    fprintf(out, "\n");
+}
+
+void print_program(FILE* out, const Program* program) {
+    for (size_t i = 0; i < program->chunk_count; i++) {
+        const Chunk* chunk = &program->chunks[i];
+        if (i == 0) {
+            fprintf(out, "<main>:\n");
+        } else {
+            fprintf(out, SV_Fmt "/%u:\n", SV_Arg(chunk->name), chunk->arity);
+        }
+        for (size_t ip = 0; ip < chunk->count; ip++) {
+            fprintf(out, "  %04zu ", ip);
+            print_instruction(out, program, chunk->code[ip]);
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include <stdio.h>
+#include <stdint.h>
+#include "./ast.h"
+#include "./memo.h"
+
+typedef enum {
+    BC_CONST = 0,       // push constants[arg]
+    BC_LOAD_LOCAL,      // push local arg of the running function, its arguments come first
+    BC_STORE_LOCAL,     // local arg = top of the stack, the value stays on the stack
+    BC_LOAD_GLOBAL,     // push global variable arg
+    BC_STORE_GLOBAL,    // global variable arg = top of the stack, the value stays on the stack
+    BC_NEG,
+    BC_ADD,
+    BC_SUB,
+    BC_MUL,
+    BC_DIV,
+    BC_EXP,
+    BC_MOD,
+    BC_EQUAL,
+    BC_POP,
+    BC_DEFINE,          // bind chunk arg to the function name it was compiled for, push 0
+    BC_CALL,            // call the function bound to CALL_SLOT(arg) with the CALL_ARGC(arg) values on top of the stack
+    BC_CALL_BUILTIN,    // same with BUILTINS[CALL_SLOT(arg)]
+    BC_RETURN,          // return the top of the stack to the caller
+    BC_TAIL_CALL,       // same as CALL then RETURN, the callee replaces the running call
+    BC_JUMP,            // continue at instruction arg of the chunk
+    BC_JUMP_IF_FALSE,   // pop the top of the stack, JUMP if it is zero
+    // typed instructions, emitted when the compiler knows the types of both operands
+    BC_ADD_INT,         // two ints
+    BC_SUB_INT,
+    BC_MUL_INT,
+    BC_DIV_INT,
+    BC_EXP_INT,
+    BC_MOD_INT,
+    BC_EQUAL_INT,
+    BC_ADD_FLOAT,       // two floats
+    BC_SUB_FLOAT,
+    BC_MUL_FLOAT,
+    BC_DIV_FLOAT,
+    BC_EXP_FLOAT,
+    BC_MOD_FLOAT,
+    BC_EQUAL_FLOAT,
+    // superinstructions, fused by the compiler from the sequences on the right
+    BC_CONST_CONST,     // CONST a; CONST b
+    BC_ADD_CONST,       // CONST k; ADD
+    BC_SUB_CONST,       // CONST k; SUB
+    BC_MUL_CONST,       // CONST k; MUL
+    BC_DIV_CONST,       // CONST k; DIV
+    BC_LOCAL_ADD_CONST, // LOAD_LOCAL s; CONST k; ADD
+    BC_LOCAL_SUB_CONST, // LOAD_LOCAL s; CONST k; SUB
+    BC_LOCAL_MUL_CONST, // LOAD_LOCAL s; CONST k; MUL
+    BC_LOCAL_DIV_CONST, // LOAD_LOCAL s; CONST k; DIV
+    BC_MUL_ADD,         // MUL; <load z>; ADD, z is pushed first: x y z -> x * y + z
+    BC_ADD_MUL,         // MUL; ADD: x y z -> x + y * z
+    BC_COUNT
+} Opcode;
+
+// One word per instruction: the opcode in the low byte, its operand in the 24 high bits
+typedef uint32_t Instruction;
+
+#define INSTRUCTION(op, arg) ((Instruction) (op) | ((Instruction) (arg) << 8))
+#define INSTRUCTION_OP(instruction) ((instruction) & 0xFF)
+#define INSTRUCTION_ARG(instruction) ((instruction) >> 8)
+#define MAX_INSTRUCTION_ARG 0xFFFFFF
+
+// calls pack the callee in 16 bits and the argument count in 8
+#define CALL_ARG(slot, argc) (((uint32_t) (argc) << 16) | (uint32_t) (slot))
+#define CALL_SLOT(arg) ((arg) & 0xFFFF)
+#define CALL_ARGC(arg) ((arg) >> 16)
+#define MAX_CALL_SLOT 0xFFFF
+#define MAX_CALL_ARGC 0xFF
+
+// superinstructions with two operands pack them in 12 bits each
+#define PAIR_ARG(first, second) (((uint32_t) (second) << 12) | (uint32_t) (first))
+#define PAIR_FIRST(arg) ((arg) & 0xFFF)
+#define PAIR_SECOND(arg) ((arg) >> 12)
+#define MAX_PAIR_ARG 0xFFF
+
+// code of the top level or of one function
+typedef struct {
+    Instruction* code;
+    size_t count;
+    size_t capacity;
+    String_View name;
+    uint32_t arity;
+    uint32_t temps;  // locals after the arguments, holding the variables of the body then the values of NODE_SHARED nodes
+    uint32_t function_slot;
+    int max_stack;   // values pushed at most on top of the arguments
+    int stack_depth; // while compiling
+    size_t label;    // while compiling: a jump lands there, instructions before it are not fused with the next ones
+    bool pure;       // compiled with MEMOIZE, the result only depends on the arguments and is cached
+} Chunk;
+
+// Variables and functions are resolved to slots at compile time, the VM keeps their values
+// in arrays indexed by those. Everything lives in the arena of the evaluation.
+typedef struct {
+    Chunk* chunks; // chunks[0] is the top level
+    size_t chunk_count;
+    size_t chunk_capacity;
+    Result* constants;
+    size_t constant_count;
+    size_t constant_capacity;
+    SymbolTable globals;   // names by slot
+    SymbolTable functions; // names by slot
+    Arena* arena;
+} Program;
+
+// type of a value known at compile time
+typedef enum {
+    TYPE_ANY = 0,
+    TYPE_INT,
+    TYPE_FLOAT
+} StaticType;
+
+// set to 0 to compile without superinstructions
+extern int SUPERINSTRUCTIONS;
+// set to 0 to compile every operation to the instruction checking the types at run time
+extern int TYPED_INSTRUCTIONS;
+
+Program* compile_ast(const AST* ast, Arena* arena);
+void print_program(FILE* out, const Program* program);
+
+#endif // BYTECODE_H
@@ -0,0 +1,716 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./jit.h"
+#include "./vm.h"
+#include "./ast_operations.h"
+#include "./builtins.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+#ifdef JIT_X86_64
+
+// Template JIT: every instruction of a function is replaced by a fixed sequence of machine code
+// working on the VM's value stack. + - * on two ints or two floats are inlined, everything else
+// calls the C functions the VM uses, so results are identical. The top level runs once, it is
+// left to the VM, which calls the native code of functions instead of interpreting them.
+//
+// Registers of the generated code (all callee saved):
+//   rbx  top of the value stack (the VM's sp)
+//   r12  arguments of the running function (the VM's locals)
+//   r13  NativeCode
+
+_Static_assert(sizeof(Result) % 8 == 0, "Results are copied 8 bytes at a time");
+_Static_assert(offsetof(Result, vali) == offsetof(Result, valf), "ints and floats share the value of a Result");
+_Static_assert(sizeof(ResultType) == 4 && sizeof(int) == 4, "types and ints are handled as 32-bit values");
+
+#define RESULT_SIZE ((int32_t) sizeof(Result))
+#define TYPE_OFFSET ((int32_t) offsetof(Result, type))
+#define VALI_OFFSET ((int32_t) offsetof(Result, vali))
+#define VALF_OFFSET ((int32_t) offsetof(Result, valf))
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12, R13 = 13 };
+
+typedef struct {
+    uint8_t* bytes;
+    size_t count;
+    size_t capacity;
+} CodeBuffer;
+
+static void jit_undeclared(NativeCode* context, uint32_t slot) {
+    fprintf(stderr, "[ERROR] Undeclared variable: " SV_Fmt "\n", SV_Arg(symbol_name(context->program->globals.symbols[slot])));
+    exit(1);
+}
+
+static void jit_neg(Result* x) {
+    *x = ast_neg(*x);
+}
+
+#define JIT_BINARY(name, function)                 \
+    static void name(Result* a, const Result* b) { \
+        *a = function(*a, *b);                     \
+    }
+JIT_BINARY(jit_add, ast_add)
+JIT_BINARY(jit_sub, ast_sub)
+JIT_BINARY(jit_mul, ast_mul)
+JIT_BINARY(jit_div, ast_div)
+JIT_BINARY(jit_exp, ast_exp)
+JIT_BINARY(jit_mod, ast_mod)
+JIT_BINARY(jit_equal, ast_equal)
+
+// typed instructions, the compiler checked the types of both operands
+#define JIT_TYPED_BINARY(name, kernel, field)      \
+    static void name(Result* a, const Result* b) { \
+        *a = kernel(a->field, b->field);           \
+    }
+JIT_TYPED_BINARY(jit_div_int, ast_div_int, vali)
+JIT_TYPED_BINARY(jit_exp_int, ast_exp_int, vali)
+JIT_TYPED_BINARY(jit_mod_int, ast_mod_int, vali)
+JIT_TYPED_BINARY(jit_equal_int, ast_equal_int, vali)
+JIT_TYPED_BINARY(jit_div_float, ast_div_float, valf)
+JIT_TYPED_BINARY(jit_exp_float, ast_exp_float, valf)
+JIT_TYPED_BINARY(jit_mod_float, ast_mod_float, valf)
+JIT_TYPED_BINARY(jit_equal_float, ast_equal_float, valf)
+
+static void jit_define(NativeCode* context, uint32_t index, Result* sp) {
+    const Chunk* function = &context->program->chunks[index];
+    if (context->functions[function->function_slot] && context->memo) {
+        memo_clear(context->memo);
+    }
+    context->functions[function->function_slot] = function;
+    *sp = (Result) {.type = RESULT_INT};
+}
+
+static void jit_call_builtin(Result* sp, uint32_t arg) {
+    uint32_t argc = CALL_ARGC(arg);
+    sp -= argc;
+    *sp = BUILTINS[CALL_SLOT(arg)].function(sp);
+}
+
+static int jit_is_true(const Result* value) {
+    return ast_is_true(*value);
+}
+
+static const Chunk* jit_callee(NativeCode* context, uint32_t arg) {
+    const Chunk* callee = context->functions[CALL_SLOT(arg)];
+    uint32_t argc = CALL_ARGC(arg);
+    if (callee == NULL) {
+        fprintf(stderr, "[ERROR] Function '" SV_Fmt "' is not defined", SV_Arg(symbol_name(context->program->functions.symbols[CALL_SLOT(arg)])));
+        exit(1);
+    }
+    if (argc != callee->arity) {
+        fprintf(stderr, "[ERROR] Invalid number of arguments for function: " SV_Fmt ". Expected %u but got %u",
+                SV_Arg(callee->name), callee->arity, argc);
+        exit(1);
+    }
+    return callee;
+}
+
+// the VM leaves room for NATIVE_STACK_SIZE values and NATIVE_MAX_CALL_DEPTH calls, false when
+// callee does not fit and goes on the interpreter
+static bool jit_has_room(NativeCode* context, const Chunk* callee, const Result* locals) {
+    if (context->depth >= MAX_NESTING_DEPTH) {
+        fprintf(stderr, "[ERROR] Calls nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+        exit(1);
+    }
+    return context->depth < context->max_depth
+           && locals + callee->arity + callee->temps + callee->max_stack + 1 <= context->stack_end;
+}
+
+// entry of a tail call the interpreter already ran, its result is in place
+static void jit_return(NativeCode* context, Result* locals) {
+    (void) context;
+    (void) locals;
+}
+
+static void jit_call(NativeCode* context, uint32_t arg, Result* sp) {
+    const Chunk* callee = jit_callee(context, arg);
+    uint32_t index = callee - context->program->chunks;
+    Result* locals = sp - CALL_ARGC(arg);
+    // the result overwrites the arguments, the key is copied first
+    Result key[MEMO_MAX_ARGS];
+    bool memo = context->memo && callee->pure;
+    if (memo) {
+        Result value;
+        if (memo_lookup(context->memo, index, callee->arity, locals, &value)) {
+            *locals = value;
+            return;
+        }
+        memcpy(key, locals, callee->arity * sizeof(Result));
+    }
+
+    if (jit_has_room(context, callee, locals)) {
+        context->depth++;
+        context->entries[index](context, locals);
+        context->depth--;
+    } else {
+        vm_call_interpreted(context, index, locals, context->depth);
+    }
+    if (memo) {
+        memo_store(context->memo, index, callee->arity, key, *locals);
+    }
+}
+
+// moves the arguments over those of the running call and returns the code to jump to, the
+// result is only cached for the call replaced, by jit_call()
+static NativeFunction jit_tail_call(NativeCode* context, uint32_t arg, Result* sp, Result* locals) {
+    const Chunk* callee = jit_callee(context, arg);
+    uint32_t index = callee - context->program->chunks;
+    memmove(locals, sp - callee->arity, callee->arity * sizeof(Result));
+    if (!jit_has_room(context, callee, locals)) {
+        vm_call_interpreted(context, index, locals, context->depth);
+        return jit_return;
+    }
+    return context->entries[index];
+}
+
+static void emit_bytes(CodeBuffer* buffer, const uint8_t* bytes, size_t count) {
+    if (buffer->count + count > buffer->capacity) {
+        buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        if (buffer->capacity < buffer->count + count) {
+            buffer->capacity = buffer->count + count;
+        }
+        buffer->bytes = mem_realloc(buffer->bytes, buffer->capacity);
+    }
+    memcpy(buffer->bytes + buffer->count, bytes, count);
+    buffer->count += count;
+}
+
+#define EMIT(buffer, ...) \
+    emit_bytes(buffer, (const uint8_t[]) {__VA_ARGS__}, sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+static void emit_u32(CodeBuffer* buffer, uint32_t value) {
+    EMIT(buffer, value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, value >> 24);
+}
+
+static void emit_u64(CodeBuffer* buffer, uint64_t value) {
+    emit_u32(buffer, value & 0xFFFFFFFF);
+    emit_u32(buffer, value >> 32);
+}
+
+// ModRM (and SIB) of [base + disp], with an 8-bit displacement when it fits
+static void emit_address(CodeBuffer* buffer, int reg, int base, int32_t disp) {
+    bool short_disp = disp >= -128 && disp <= 127;
+    EMIT(buffer, (short_disp ? 0x40 : 0x80) | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == RSP) {
+        EMIT(buffer, 0x24);
+    }
+    if (short_disp) {
+        EMIT(buffer, (uint8_t) disp);
+    } else {
+        emit_u32(buffer, (uint32_t) disp);
+    }
+}
+
+// mov reg, [base + disp] / mov [base + disp], reg on 64 bits
+static void emit_load(CodeBuffer* buffer, int reg, int base, int32_t disp) {
+    EMIT(buffer, 0x48 | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0), 0x8B);
+    emit_address(buffer, reg, base, disp);
+}
+
+static void emit_store(CodeBuffer* buffer, int reg, int base, int32_t disp) {
+    EMIT(buffer, 0x48 | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0), 0x89);
+    emit_address(buffer, reg, base, disp);
+}
+
+static void emit_copy_result(CodeBuffer* buffer, int to, int32_t to_disp, int from, int32_t from_disp) {
+    for (int32_t offset = 0; offset < RESULT_SIZE; offset += 8) {
+        emit_load(buffer, RCX, from, from_disp + offset);
+        emit_store(buffer, RCX, to, to_disp + offset);
+    }
+}
+
+static void emit_mov_imm64(CodeBuffer* buffer, int reg, uint64_t value) {
+    EMIT(buffer, 0x48, 0xB8 + reg);
+    emit_u64(buffer, value);
+}
+
+static void emit_call(CodeBuffer* buffer, void (*function)(void)) {
+    emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) function);
+    EMIT(buffer, 0xFF, 0xD0); // call rax
+}
+#define EMIT_CALL(buffer, function) emit_call(buffer, (void (*)(void)) (function))
+
+// add rbx, delta
+static void emit_move_sp(CodeBuffer* buffer, int32_t delta) {
+    if (delta != 0) {
+        EMIT(buffer, 0x48, 0x81, 0xC3);
+        emit_u32(buffer, (uint32_t) delta);
+    }
+}
+
+// lea reg, [rbx + disp]
+static void emit_stack_address(CodeBuffer* buffer, int reg, int32_t disp) {
+    EMIT(buffer, 0x48, 0x8D);
+    emit_address(buffer, reg, RBX, disp);
+}
+
+// mov dword/qword [rbx + disp], imm32
+static void emit_store_imm(CodeBuffer* buffer, bool wide, int32_t disp, int32_t value) {
+    if (wide) {
+        EMIT(buffer, 0x48);
+    }
+    EMIT(buffer, 0xC7);
+    emit_address(buffer, 0, RBX, disp);
+    emit_u32(buffer, (uint32_t) value);
+}
+
+// jump with a 32-bit displacement to be patched, returns where the displacement is
+static size_t emit_jump(CodeBuffer* buffer, uint8_t condition) {
+    if (condition) {
+        EMIT(buffer, 0x0F, condition);
+    } else {
+        EMIT(buffer, 0xE9);
+    }
+    emit_u32(buffer, 0);
+    return buffer->count - 4;
+}
+#define JMP 0
+#define JO 0x80
+#define JE 0x84
+#define JNE 0x85
+#define JA 0x87
+#define JP 0x8A
+
+static void patch_jump_to(CodeBuffer* buffer, size_t at, size_t target) {
+    uint32_t displacement = (uint32_t) (target - (at + 4));
+    memcpy(buffer->bytes + at, &displacement, 4);
+}
+
+static void patch_jump(CodeBuffer* buffer, size_t at) {
+    patch_jump_to(buffer, at, buffer->count);
+}
+
+static void emit_constant(CodeBuffer* buffer, const Program* program, uint32_t index) {
+    emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) &program->constants[index]);
+    emit_copy_result(buffer, RBX, 0, RAX, 0);
+    emit_move_sp(buffer, RESULT_SIZE);
+}
+
+static void emit_load_local(CodeBuffer* buffer, uint32_t slot) {
+    emit_copy_result(buffer, RBX, 0, R12, slot * RESULT_SIZE);
+    emit_move_sp(buffer, RESULT_SIZE);
+}
+
+// [rbx + a] = [rbx + a] op [rbx + b] through the C function
+static void emit_binary_call(CodeBuffer* buffer, void (*function)(Result*, const Result*), int32_t a, int32_t b) {
+    emit_stack_address(buffer, RDI, a);
+    emit_stack_address(buffer, RSI, b);
+    EMIT_CALL(buffer, function);
+}
+
+// xmm = [rbx + at] as a double, eax or ecx holds its type
+static void emit_load_double(CodeBuffer* buffer, int xmm, int type_reg, int32_t at) {
+    EMIT(buffer, 0x85, 0xC0 | (type_reg << 3) | type_reg); // test type, type
+    size_t is_float = emit_jump(buffer, JNE);
+    EMIT(buffer, 0xF2, 0x0F, 0x2A); // cvtsi2sd xmm, dword [vali]
+    emit_address(buffer, xmm, RBX, at + VALI_OFFSET);
+    size_t done = emit_jump(buffer, JMP);
+    patch_jump(buffer, is_float);
+    EMIT(buffer, 0xF2, 0x0F, 0x10); // movsd xmm, [valf]
+    emit_address(buffer, xmm, RBX, at + VALF_OFFSET);
+    patch_jump(buffer, done);
+}
+
+static const uint8_t INT_ARITHMETIC[] = {[BC_ADD] = 0x03, [BC_SUB] = 0x2B, [BC_MUL] = 0xAF};
+static const uint8_t FLOAT_ARITHMETIC[] = {[BC_ADD] = 0x58, [BC_SUB] = 0x5C, [BC_MUL] = 0x59};
+
+// [rbx + a] = xmm0, a zero float becomes an int like in ast_float_result, NaN is unordered and stays a float
+static void emit_float_result(CodeBuffer* buffer, int32_t a) {
+    EMIT(buffer, 0x66, 0x0F, 0x57, 0xD2); // xorpd xmm2, xmm2
+    EMIT(buffer, 0x66, 0x0F, 0x2E, 0xC2); // ucomisd xmm0, xmm2
+    size_t unordered = emit_jump(buffer, JP);
+    size_t non_zero = emit_jump(buffer, JNE);
+    emit_store_imm(buffer, false, a + TYPE_OFFSET, RESULT_INT);
+    emit_store_imm(buffer, false, a + VALI_OFFSET, 0);
+    size_t zero_done = emit_jump(buffer, JMP);
+    patch_jump(buffer, unordered);
+    patch_jump(buffer, non_zero);
+    emit_store_imm(buffer, false, a + TYPE_OFFSET, RESULT_FLOAT);
+    EMIT(buffer, 0xF2, 0x0F, 0x11); // movsd [a.valf], xmm0
+    emit_address(buffer, 0, RBX, a + VALF_OFFSET);
+    patch_jump(buffer, zero_done);
+}
+
+// [rbx + a] = [rbx + a] op [rbx + b] for + - * on two ints, the C function promotes a result
+// that overflows to a big integer
+static void emit_int_arithmetic(CodeBuffer* buffer, Opcode op, int32_t a, int32_t b) {
+    void (*helper[])(Result*, const Result*) = {[BC_ADD] = jit_add, [BC_SUB] = jit_sub, [BC_MUL] = jit_mul};
+
+    EMIT(buffer, 0x8B); // mov eax, [a.vali]
+    emit_address(buffer, RAX, RBX, a + VALI_OFFSET);
+    if (op == BC_MUL) {
+        EMIT(buffer, 0x0F);
+    }
+    EMIT(buffer, INT_ARITHMETIC[op]); // op eax, [b.vali]
+    emit_address(buffer, RAX, RBX, b + VALI_OFFSET);
+    size_t overflow = emit_jump(buffer, JO);
+    EMIT(buffer, 0x89); // mov [a.vali], eax
+    emit_address(buffer, RAX, RBX, a + VALI_OFFSET);
+    size_t done = emit_jump(buffer, JMP);
+    patch_jump(buffer, overflow);
+    emit_binary_call(buffer, helper[op], a, b);
+    patch_jump(buffer, done);
+}
+
+// same on two floats
+static void emit_float_arithmetic(CodeBuffer* buffer, Opcode op, int32_t a, int32_t b) {
+    EMIT(buffer, 0xF2, 0x0F, 0x10); // movsd xmm0, [a.valf]
+    emit_address(buffer, 0, RBX, a + VALF_OFFSET);
+    EMIT(buffer, 0xF2, 0x0F, FLOAT_ARITHMETIC[op]); // op xmm0, [b.valf]
+    emit_address(buffer, 0, RBX, b + VALF_OFFSET);
+    emit_float_result(buffer, a);
+}
+
+// [rbx + a] = [rbx + a] op [rbx + b] for + - *, inline for ints and floats like the generic functions
+static void emit_arithmetic(CodeBuffer* buffer, Opcode op, int32_t a, int32_t b) {
+    void (*helper[])(Result*, const Result*) = {[BC_ADD] = jit_add, [BC_SUB] = jit_sub, [BC_MUL] = jit_mul};
+    _Static_assert(RESULT_INT == 0 && RESULT_FLOAT == 1, "the generated code tests types against 0 and 1");
+
+    // mov eax, [a.type]; mov ecx, [b.type]
+    EMIT(buffer, 0x8B);
+    emit_address(buffer, RAX, RBX, a + TYPE_OFFSET);
+    EMIT(buffer, 0x8B);
+    emit_address(buffer, RCX, RBX, b + TYPE_OFFSET);
+    EMIT(buffer, 0x89, 0xC2, 0x09, 0xCA); // mov edx, eax; or edx, ecx
+    size_t both_int = emit_jump(buffer, JE);
+    EMIT(buffer, 0x83, 0xF8, RESULT_FLOAT); // cmp eax, RESULT_FLOAT
+    size_t other_a = emit_jump(buffer, JA);
+    EMIT(buffer, 0x83, 0xF9, RESULT_FLOAT); // cmp ecx, RESULT_FLOAT
+    size_t other_b = emit_jump(buffer, JA);
+
+    // at least one float, the int one is converted
+    emit_load_double(buffer, 0, RAX, a);
+    emit_load_double(buffer, 1, RCX, b);
+    EMIT(buffer, 0xF2, 0x0F, FLOAT_ARITHMETIC[op], 0xC1); // op xmm0, xmm1
+    emit_float_result(buffer, a);
+    size_t float_done = emit_jump(buffer, JMP);
+
+    patch_jump(buffer, both_int);
+    emit_int_arithmetic(buffer, op, a, b);
+    size_t int_done = emit_jump(buffer, JMP);
+
+    patch_jump(buffer, other_a);
+    patch_jump(buffer, other_b);
+    emit_binary_call(buffer, helper[op], a, b);
+
+    patch_jump(buffer, float_done);
+    patch_jump(buffer, int_done);
+}
+
+static void emit_binary(CodeBuffer* buffer, Opcode op) {
+    int32_t a = -2 * RESULT_SIZE;
+    int32_t b = -RESULT_SIZE;
+    switch (op) {
+    case BC_ADD:
+    case BC_SUB:
+    case BC_MUL: {
+        emit_arithmetic(buffer, op, a, b);
+    }
+    break;
+    case BC_DIV: {
+        emit_binary_call(buffer, jit_div, a, b);
+    }
+    break;
+    case BC_EXP: {
+        emit_binary_call(buffer, jit_exp, a, b);
+    }
+    break;
+    case BC_MOD: {
+        emit_binary_call(buffer, jit_mod, a, b);
+    }
+    break;
+    default: {
+        emit_binary_call(buffer, jit_equal, a, b);
+    }
+    }
+    emit_move_sp(buffer, -RESULT_SIZE);
+}
+
+// typed instructions: + - * are inlined, the others call the kernels
+static void emit_typed_binary(CodeBuffer* buffer, Opcode op) {
+    static const Opcode GENERIC_OPS[BC_COUNT] = {
+        [BC_ADD_INT] = BC_ADD, [BC_SUB_INT] = BC_SUB, [BC_MUL_INT] = BC_MUL,
+        [BC_ADD_FLOAT] = BC_ADD, [BC_SUB_FLOAT] = BC_SUB, [BC_MUL_FLOAT] = BC_MUL
+    };
+    static void (*const HELPERS[BC_COUNT])(Result*, const Result*) = {
+        [BC_DIV_INT] = jit_div_int, [BC_EXP_INT] = jit_exp_int,
+        [BC_MOD_INT] = jit_mod_int, [BC_EQUAL_INT] = jit_equal_int,
+        [BC_DIV_FLOAT] = jit_div_float, [BC_EXP_FLOAT] = jit_exp_float,
+        [BC_MOD_FLOAT] = jit_mod_float, [BC_EQUAL_FLOAT] = jit_equal_float
+    };
+    int32_t a = -2 * RESULT_SIZE;
+    int32_t b = -RESULT_SIZE;
+    if (HELPERS[op]) {
+        emit_binary_call(buffer, HELPERS[op], a, b);
+    } else if (op <= BC_EQUAL_INT) {
+        emit_int_arithmetic(buffer, GENERIC_OPS[op], a, b);
+    } else {
+        emit_float_arithmetic(buffer, GENERIC_OPS[op], a, b);
+    }
+    emit_move_sp(buffer, -RESULT_SIZE);
+}
+
+static const Opcode FUSED_OPS[BC_COUNT] = {
+    [BC_ADD_CONST] = BC_ADD, [BC_SUB_CONST] = BC_SUB, [BC_MUL_CONST] = BC_MUL, [BC_DIV_CONST] = BC_DIV,
+    [BC_LOCAL_ADD_CONST] = BC_ADD, [BC_LOCAL_SUB_CONST] = BC_SUB,
+    [BC_LOCAL_MUL_CONST] = BC_MUL, [BC_LOCAL_DIV_CONST] = BC_DIV
+};
+
+// appends the native code of chunk, returns false if it contains an instruction that cannot be translated
+static bool compile_chunk(CodeBuffer* buffer, const Program* program, const Chunk* chunk, NativeCode* context) {
+    // push rbp; mov rbp, rsp; push rbx; push r12; push r13; push r14 (keeps rsp 16 byte aligned)
+    EMIT(buffer, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56);
+    // mov r13, rdi; mov r12, rsi; lea rbx, [rsi + arity + temps]
+    EMIT(buffer, 0x49, 0x89, 0xFD, 0x49, 0x89, 0xF4, 0x48, 0x8D);
+    emit_address(buffer, RBX, RSI, (chunk->arity + chunk->temps) * RESULT_SIZE);
+
+    // jumps go forward, they are patched once every instruction has its native offset
+    size_t* offsets = mem_alloc((chunk->count + 1) * sizeof(size_t));
+    size_t* jumps = mem_alloc(chunk->count * sizeof(size_t)); // where the displacement of each is
+    size_t jump_count = 0;
+    bool translated = true;
+    for (size_t i = 0; i < chunk->count && translated; i++) {
+        offsets[i] = buffer->count;
+        Opcode op = INSTRUCTION_OP(chunk->code[i]);
+        uint32_t arg = INSTRUCTION_ARG(chunk->code[i]);
+        switch (op) {
+        case BC_CONST: {
+            emit_constant(buffer, program, arg);
+        }
+        break;
+        case BC_LOAD_LOCAL: {
+            emit_load_local(buffer, arg);
+        }
+        break;
+        case BC_STORE_LOCAL: {
+            emit_copy_result(buffer, R12, arg * RESULT_SIZE, RBX, -RESULT_SIZE);
+        }
+        break;
+        case BC_LOAD_GLOBAL: {
+            emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) &context->defined[arg]);
+            EMIT(buffer, 0x80, 0x38, 0x00); // cmp byte [rax], 0
+            size_t defined = emit_jump(buffer, JNE);
+            EMIT(buffer, 0x4C, 0x89, 0xEF, 0xBE); // mov rdi, r13; mov esi, arg
+            emit_u32(buffer, arg);
+            EMIT_CALL(buffer, jit_undeclared);
+            patch_jump(buffer, defined);
+            emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) &context->globals[arg]);
+            emit_copy_result(buffer, RBX, 0, RAX, 0);
+            emit_move_sp(buffer, RESULT_SIZE);
+        }
+        break;
+        case BC_STORE_GLOBAL: {
+            emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) &context->globals[arg]);
+            emit_copy_result(buffer, RAX, 0, RBX, -RESULT_SIZE);
+            emit_mov_imm64(buffer, RAX, (uint64_t) (uintptr_t) &context->defined[arg]);
+            EMIT(buffer, 0xC6, 0x00, 0x01); // mov byte [rax], 1
+        }
+        break;
+        case BC_NEG: {
+            emit_stack_address(buffer, RDI, -RESULT_SIZE);
+            EMIT_CALL(buffer, jit_neg);
+        }
+        break;
+        case BC_ADD:
+        case BC_SUB:
+        case BC_MUL:
+        case BC_DIV:
+        case BC_EXP:
+        case BC_MOD:
+        case BC_EQUAL: {
+            emit_binary(buffer, op);
+        }
+        break;
+        case BC_ADD_INT:
+        case BC_SUB_INT:
+        case BC_MUL_INT:
+        case BC_DIV_INT:
+        case BC_EXP_INT:
+        case BC_MOD_INT:
+        case BC_EQUAL_INT:
+        case BC_ADD_FLOAT:
+        case BC_SUB_FLOAT:
+        case BC_MUL_FLOAT:
+        case BC_DIV_FLOAT:
+        case BC_EXP_FLOAT:
+        case BC_MOD_FLOAT:
+        case BC_EQUAL_FLOAT: {
+            emit_typed_binary(buffer, op);
+        }
+        break;
+        case BC_POP: {
+            emit_move_sp(buffer, -RESULT_SIZE);
+        }
+        break;
+        case BC_DEFINE: {
+            EMIT(buffer, 0x4C, 0x89, 0xEF, 0xBE); // mov rdi, r13; mov esi, arg
+            emit_u32(buffer, arg);
+            EMIT(buffer, 0x48, 0x89, 0xDA); // mov rdx, rbx
+            EMIT_CALL(buffer, jit_define);
+            emit_move_sp(buffer, RESULT_SIZE);
+        }
+        break;
+        case BC_CALL_BUILTIN: {
+            EMIT(buffer, 0x48, 0x89, 0xDF, 0xBE); // mov rdi, rbx; mov esi, arg
+            emit_u32(buffer, arg);
+            EMIT_CALL(buffer, jit_call_builtin);
+            emit_move_sp(buffer, (1 - (int32_t) CALL_ARGC(arg)) * RESULT_SIZE);
+        }
+        break;
+        case BC_CALL: {
+            EMIT(buffer, 0x4C, 0x89, 0xEF, 0xBE); // mov rdi, r13; mov esi, arg
+            emit_u32(buffer, arg);
+            EMIT(buffer, 0x48, 0x89, 0xDA); // mov rdx, rbx
+            EMIT_CALL(buffer, jit_call);
+            emit_move_sp(buffer, (1 - (int32_t) CALL_ARGC(arg)) * RESULT_SIZE);
+        }
+        break;
+        case BC_RETURN: {
+            emit_copy_result(buffer, R12, 0, RBX, -RESULT_SIZE);
+            // pop r14; pop r13; pop r12; pop rbx; pop rbp; ret
+            EMIT(buffer, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3);
+        }
+        break;
+        case BC_TAIL_CALL: {
+            EMIT(buffer, 0x4C, 0x89, 0xEF, 0xBE); // mov rdi, r13; mov esi, arg
+            emit_u32(buffer, arg);
+            EMIT(buffer, 0x48, 0x89, 0xDA, 0x4C, 0x89, 0xE1); // mov rdx, rbx; mov rcx, r12
+            EMIT_CALL(buffer, jit_tail_call);
+            // the callee starts with the registers and the native stack of the caller of this call:
+            // mov rdi, r13; mov rsi, r12; pop r14; pop r13; pop r12; pop rbx; pop rbp; jmp rax
+            EMIT(buffer, 0x4C, 0x89, 0xEF, 0x4C, 0x89, 0xE6);
+            EMIT(buffer, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xFF, 0xE0);
+        }
+        break;
+        case BC_JUMP: {
+            jumps[jump_count++] = emit_jump(buffer, JMP);
+        }
+        break;
+        case BC_JUMP_IF_FALSE: {
+            emit_move_sp(buffer, -RESULT_SIZE);
+            EMIT(buffer, 0x48, 0x89, 0xDF); // mov rdi, rbx
+            EMIT_CALL(buffer, jit_is_true);
+            EMIT(buffer, 0x85, 0xC0); // test eax, eax
+            jumps[jump_count++] = emit_jump(buffer, JE);
+        }
+        break;
+        case BC_CONST_CONST: {
+            emit_constant(buffer, program, PAIR_FIRST(arg));
+            emit_constant(buffer, program, PAIR_SECOND(arg));
+        }
+        break;
+        case BC_ADD_CONST:
+        case BC_SUB_CONST:
+        case BC_MUL_CONST:
+        case BC_DIV_CONST: {
+            emit_constant(buffer, program, arg);
+            emit_binary(buffer, FUSED_OPS[op]);
+        }
+        break;
+        case BC_LOCAL_ADD_CONST:
+        case BC_LOCAL_SUB_CONST:
+        case BC_LOCAL_MUL_CONST:
+        case BC_LOCAL_DIV_CONST: {
+            emit_load_local(buffer, PAIR_FIRST(arg));
+            emit_constant(buffer, program, PAIR_SECOND(arg));
+            emit_binary(buffer, FUSED_OPS[op]);
+        }
+        break;
+        case BC_MUL_ADD: {
+            emit_arithmetic(buffer, BC_MUL, -3 * RESULT_SIZE, -2 * RESULT_SIZE);
+            emit_arithmetic(buffer, BC_ADD, -3 * RESULT_SIZE, -RESULT_SIZE);
+            emit_move_sp(buffer, -2 * RESULT_SIZE);
+        }
+        break;
+        case BC_ADD_MUL: {
+            emit_arithmetic(buffer, BC_MUL, -2 * RESULT_SIZE, -RESULT_SIZE);
+            emit_arithmetic(buffer, BC_ADD, -3 * RESULT_SIZE, -2 * RESULT_SIZE);
+            emit_move_sp(buffer, -2 * RESULT_SIZE);
+        }
+        break;
+        default: {
+            translated = false;
+        }
+        }
+    }
+    offsets[chunk->count] = buffer->count;
+
+    for (size_t i = 0, j = 0; translated && i < chunk->count; i++) {
+        Opcode op = INSTRUCTION_OP(chunk->code[i]);
+        if (op == BC_JUMP || op == BC_JUMP_IF_FALSE) {
+            patch_jump_to(buffer, jumps[j++], offsets[INSTRUCTION_ARG(chunk->code[i])]);
+        }
+    }
+    mem_free(offsets);
+    mem_free(jumps);
+    return translated;
+}
+
+bool jit_supported(void) {
+    return true;
+}
+
+Result jit_run(const Program* program, Arena* arena) {
+    NativeCode native = {
+        .entries = arena_alloc(arena, program->chunk_count * sizeof(NativeFunction)),
+        .program = program,
+        .globals = arena_alloc(arena, program->globals.count * sizeof(Result)),
+        .defined = arena_alloc(arena, program->globals.count * sizeof(bool)),
+        .functions = arena_alloc(arena, program->functions.count * sizeof(Chunk*))
+    };
+    if (program->chunk_count == 1) {
+        return vm_run_native(program, arena, &native);
+    }
+
+    CodeBuffer buffer = {0};
+    size_t* offsets = arena_alloc(arena, program->chunk_count * sizeof(size_t));
+    for (size_t i = 1; i < program->chunk_count; i++) {
+        offsets[i] = buffer.count;
+        if (!compile_chunk(&buffer, program, &program->chunks[i], &native)) {
+            mem_free(buffer.bytes);
+            return vm_run_native(program, arena, &native);
+        }
+    }
+
+    // written while writable, then switched to executable, never both
+    uint8_t* code = mmap(NULL, buffer.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        mem_free(buffer.bytes);
+        return vm_run_native(program, arena, &native);
+    }
+    memcpy(code, buffer.bytes, buffer.count);
+    mem_free(buffer.bytes);
+    if (mprotect(code, buffer.count, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, buffer.count);
+        return vm_run_native(program, arena, &native);
+    }
+    for (size_t i = 1; i < program->chunk_count; i++) {
+        // object to function pointer conversions are not ISO C, copying the bytes is
+        void* entry = code + offsets[i];
+        memcpy(&native.entries[i], &entry, sizeof(entry));
+    }
+
+    Result result = vm_run_native(program, arena, &native);
+    munmap(code, buffer.count);
+    return result;
+}
+
+#else
+
+bool jit_supported(void) {
+    return false;
+}
+
+Result jit_run(const Program* program, Arena* arena) {
+    return vm_run(program, arena);
+}
+
+#endif // JIT_X86_64
@@ -0,0 +1,12 @@
+#ifndef JIT_H
+#define JIT_H
+#include <stdbool.h>
+#include "./bytecode.h"
+
+// Translates the functions of program to x86-64 machine code and runs the top level on the VM,
+// which calls them. Everything is interpreted when the platform is not supported or a function
+// contains an instruction the JIT does not translate.
+Result jit_run(const Program* program, Arena* arena);
+bool jit_supported(void);
+
+#endif // JIT_H
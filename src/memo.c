@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./memo.h"
+#include "./builtins.h"
+#include "./bigint.h"
+
+int MEMOIZE = 0;
+MemoStats MEMO_STATS = {0};
+
+#define MEMO_WAYS 4
+#define MEMO_SETS 1024 // power of two
+
+typedef struct {
+    uint32_t hashes[MEMO_WAYS]; // of the key of each way, 0 for an empty way
+    uint8_t referenced;         // clock bit of each way
+    uint8_t hand;               // way the clock looks at first
+} MemoSet;
+
+typedef struct {
+    uint32_t function;
+    uint32_t argc;
+    Result value;
+    Result args[MEMO_MAX_ARGS];
+} MemoEntry;
+
+struct MemoTable {
+    MemoSet sets[MEMO_SETS];                // searched first, 20 KB
+    MemoEntry entries[MEMO_SETS * MEMO_WAYS]; // way w of set s is entries[s * MEMO_WAYS + w]
+};
+
+MemoTable* memo_new(void) {
+    return mem_calloc(1, sizeof(MemoTable));
+}
+
+void memo_free(MemoTable* table) {
+    mem_free(table);
+}
+
+// the bits of the value, a float and an int never compare equal
+static uint64_t value_bits(Result value) {
+    if (value.type == RESULT_INT) {
+        return (uint32_t) value.vali;
+    }
+    if (value.type == RESULT_BIG) {
+        return big_hash(value.valb);
+    }
+    uint64_t bits;
+    memcpy(&bits, &value.valf, sizeof(bits));
+    return bits;
+}
+
+static uint32_t hash_key(uint32_t function, size_t argc, const Result* args) {
+    uint64_t hash = ((uint64_t) function << 8 | argc) * 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < argc; i++) {
+        hash = (hash ^ value_bits(args[i]) ^ (uint64_t) args[i].type << 62) * 0x9E3779B97F4A7C15u;
+        hash ^= hash >> 29;
+    }
+    uint32_t result = hash >> 32;
+    return result ? result : 1;
+}
+
+static bool same_key(const MemoEntry* entry, uint32_t function, size_t argc, const Result* args) {
+    if (entry->function != function || entry->argc != argc) {
+        return false;
+    }
+    for (size_t i = 0; i < argc; i++) {
+        if (entry->args[i].type != args[i].type || value_bits(entry->args[i]) != value_bits(args[i])) {
+            return false;
+        }
+        if (args[i].type == RESULT_BIG && big_compare(entry->args[i].valb, args[i].valb) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// way of set holding the key, -1 if there is none
+static int find_way(MemoTable* table, size_t set, uint32_t hash, uint32_t function, size_t argc, const Result* args) {
+    for (int way = 0; way < MEMO_WAYS; way++) {
+        if (table->sets[set].hashes[way] == hash && same_key(&table->entries[set * MEMO_WAYS + way], function, argc, args)) {
+            return way;
+        }
+    }
+    return -1;
+}
+
+bool memo_lookup(MemoTable* table, uint32_t function, size_t argc, const Result* args, Result* value) {
+    uint32_t hash = hash_key(function, argc, args);
+    size_t set = hash & (MEMO_SETS - 1);
+    int way = find_way(table, set, hash, function, argc, args);
+    if (way < 0) {
+        MEMO_STATS.misses++;
+        return false;
+    }
+    MEMO_STATS.hits++;
+    table->sets[set].referenced |= 1 << way;
+    *value = table->entries[set * MEMO_WAYS + way].value;
+    return true;
+}
+
+void memo_store(MemoTable* table, uint32_t function, size_t argc, const Result* args, Result value) {
+    uint32_t hash = hash_key(function, argc, args);
+    size_t set_index = hash & (MEMO_SETS - 1);
+    MemoSet* set = &table->sets[set_index];
+    int way = find_way(table, set_index, hash, function, argc, args);
+    for (int i = 0; way < 0 && i < MEMO_WAYS; i++) {
+        if (set->hashes[i] == 0) {
+            way = i;
+        }
+    }
+    if (way < 0) {
+        // every way is referenced at most once before the hand comes back to it cleared
+        while (set->referenced & (1 << set->hand)) {
+            set->referenced &= ~(1 << set->hand);
+            set->hand = (set->hand + 1) % MEMO_WAYS;
+        }
+        way = set->hand;
+        set->hand = (set->hand + 1) % MEMO_WAYS;
+        MEMO_STATS.evictions++;
+    }
+
+    MemoEntry* entry = &table->entries[set_index * MEMO_WAYS + way];
+    entry->function = function;
+    entry->argc = argc;
+    entry->value = value;
+    memcpy(entry->args, args, argc * sizeof(Result));
+    set->hashes[way] = hash;
+    set->referenced &= ~(1 << way);
+}
+
+void memo_clear(MemoTable* table) {
+    memset(table->sets, 0, sizeof(table->sets));
+}
+
+typedef struct {
+    ASTNode* node;
+    ASTNode* funcdef; // definition whose body the node is in, NULL at the top level
+} PurityEntry;
+
+typedef struct {
+    NodeIndex funcdef;
+    uint32_t callee; // slot of the name called
+} PurityCall;
+
+bool* memo_pure_functions(const AST* ast, Arena* arena) {
+    bool* pure = arena_alloc(arena, ast->count * sizeof(bool));
+    SymbolTable names = {0};
+    size_t def_count = 0;
+    size_t def_capacity = 16;
+    NodeIndex* defs = mem_alloc(def_capacity * sizeof(NodeIndex));
+    size_t call_count = 0;
+    size_t call_capacity = 16;
+    PurityCall* calls = mem_alloc(call_capacity * sizeof(PurityCall));
+
+    // first the bodies on their own, with the calls they make to user functions
+    size_t capacity = 64;
+    size_t count = 0;
+    PurityEntry* stack = mem_alloc(capacity * sizeof(PurityEntry));
+    stack[count++] = (PurityEntry) {.node = ast_node(ast, ast->root)};
+    while (count > 0) {
+        PurityEntry entry = stack[--count];
+        ASTNode* node = entry.node;
+        ASTNode* funcdef = entry.funcdef;
+        ASTNode* function = funcdef ? ast_first_child(ast, funcdef) : NULL;
+        ASTNode* child = ast_first_child(ast, node);
+
+        if (node->type == NODE_FUNCDEF) {
+            if (funcdef) {
+                pure[funcdef - ast->nodes] = false;
+            }
+            funcdef = node;
+            if (def_count >= def_capacity) {
+                def_capacity *= 2;
+                defs = mem_realloc(defs, def_capacity * sizeof(NodeIndex));
+            }
+            defs[def_count++] = node - ast->nodes;
+            pure[node - ast->nodes] = ast_count_children(ast, child) <= MEMO_MAX_ARGS;
+            child = ast_next_sibling(ast, child);
+        } else if (funcdef && node->type == NODE_ASSIGN) {
+            pure[funcdef - ast->nodes] = false;
+        } else if (funcdef && node->type == NODE_SYMBOL && ast_find_parameter(ast, function, node->value.symbol) < 0) {
+            pure[funcdef - ast->nodes] = false;
+        } else if (funcdef && node->type == NODE_BUILTIN_FUNCTION && !(node->value.builtin->flags & BUILTIN_PURE)) {
+            pure[funcdef - ast->nodes] = false;
+        } else if (funcdef && node->type == NODE_FUNCTION) {
+            if (call_count >= call_capacity) {
+                call_capacity *= 2;
+                calls = mem_realloc(calls, call_capacity * sizeof(PurityCall));
+            }
+            calls[call_count++] = (PurityCall) {
+                .funcdef = funcdef - ast->nodes,
+                .callee = symbol_slot(&names, arena, node->value.symbol)
+            };
+        }
+
+        for (; child; child = ast_next_sibling(ast, child)) {
+            if (count >= capacity) {
+                capacity *= 2;
+                stack = mem_realloc(stack, capacity * sizeof(PurityEntry));
+            }
+            stack[count++] = (PurityEntry) {.node = child, .funcdef = funcdef};
+        }
+    }
+    mem_free(stack);
+
+    // a name is impure when one of its definitions is, or when it has none
+    uint32_t* def_names = mem_alloc((def_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < def_count; i++) {
+        def_names[i] = symbol_slot(&names, arena, ast_first_child(ast, ast_node(ast, defs[i]))->value.symbol);
+    }
+    bool* impure_names = mem_alloc((names.count + 1) * sizeof(bool));
+    for (size_t i = 0; i < names.count; i++) {
+        impure_names[i] = true;
+    }
+    for (size_t i = 0; i < def_count; i++) {
+        impure_names[def_names[i]] = false;
+    }
+    for (size_t i = 0; i < def_count; i++) {
+        if (!pure[defs[i]]) {
+            impure_names[def_names[i]] = true;
+        }
+    }
+
+    // then impurity goes from the names to the definitions calling them, the calls are grouped
+    // by callee so that each name is followed once
+    size_t* first_caller = mem_calloc(names.count + 1, sizeof(size_t));
+    for (size_t i = 0; i < call_count; i++) {
+        first_caller[calls[i].callee + 1]++;
+    }
+    for (size_t i = 0; i < names.count; i++) {
+        first_caller[i + 1] += first_caller[i];
+    }
+    NodeIndex* callers = mem_alloc((call_count + 1) * sizeof(NodeIndex));
+    size_t* filled = mem_calloc(names.count + 1, sizeof(size_t));
+    for (size_t i = 0; i < call_count; i++) {
+        callers[first_caller[calls[i].callee] + filled[calls[i].callee]++] = calls[i].funcdef;
+    }
+
+    uint32_t* worklist = mem_alloc((names.count + 1) * sizeof(uint32_t));
+    size_t pending = 0;
+    for (size_t i = 0; i < names.count; i++) {
+        if (impure_names[i]) {
+            worklist[pending++] = i;
+        }
+    }
+    while (pending > 0) {
+        uint32_t name = worklist[--pending];
+        for (size_t i = first_caller[name]; i < first_caller[name + 1]; i++) {
+            if (!pure[callers[i]]) {
+                continue;
+            }
+            pure[callers[i]] = false;
+            uint32_t caller_name = symbol_slot(&names, arena, ast_first_child(ast, ast_node(ast, callers[i]))->value.symbol);
+            if (!impure_names[caller_name]) {
+                impure_names[caller_name] = true;
+                worklist[pending++] = caller_name;
+            }
+        }
+    }
+
+    mem_free(worklist);
+    mem_free(filled);
+    mem_free(callers);
+    mem_free(first_caller);
+    mem_free(def_names);
+    mem_free(impure_names);
+    mem_free(defs);
+    mem_free(calls);
+    return pure;
+}
@@ -0,0 +1,42 @@
+#ifndef MEMO_H
+#define MEMO_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "./ast.h"
+
+// set to 1 to cache the results of pure user functions (see --memo)
+extern int MEMOIZE;
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} MemoStats;
+
+extern MemoStats MEMO_STATS;
+
+// functions with more parameters are never cached
+#define MEMO_MAX_ARGS 4
+
+// Results of calls keyed on the function and the values of the arguments, in a fixed number of
+// sets of a few entries. A key can only go to one set, which is searched through the hashes
+// of its entries, kept together. A full set evicts with the clock algorithm: an entry read since
+// the hand last passed it gets a second chance.
+typedef struct MemoTable MemoTable;
+
+MemoTable* memo_new(void);
+void memo_free(MemoTable* table);
+// function is any number identifying the code called, argc is at most MEMO_MAX_ARGS
+bool memo_lookup(MemoTable* table, uint32_t function, size_t argc, const Result* args, Result* value);
+void memo_store(MemoTable* table, uint32_t function, size_t argc, const Result* args, Result value);
+// forgets every result, a function called by a cached one was redefined
+void memo_clear(MemoTable* table);
+
+// By node index, true for the NODE_FUNCDEF nodes whose value only depends on their arguments:
+// their body assigns nothing, reads no global and only calls builtins and functions of which
+// every definition is pure. Calls to another function go through its name, whatever
+// definition it is bound to when the call runs is pure, but the table must be cleared when a
+// name is bound again. Everything is allocated in arena.
+bool* memo_pure_functions(const AST* ast, Arena* arena);
+
+#endif // MEMO_H
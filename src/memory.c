@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./memory.h"
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#endif
+
+AllocStats ALLOC_STATS = {0};
+
+static void* check_allocation(void* ptr, size_t size) {
+    if (ptr == NULL && size != 0) {
+        fprintf(stderr, "[ERROR] Could not allocate %zu bytes\n", size);
+        exit(1);
+    }
+    ALLOC_STATS.mallocs++;
+    ALLOC_STATS.bytes += size;
+    return ptr;
+}
+
+void* mem_alloc(size_t size) {
+    return check_allocation(malloc(size), size);
+}
+
+void* mem_calloc(size_t count, size_t size) {
+    return check_allocation(calloc(count, size), count * size);
+}
+
+void* mem_realloc(void* ptr, size_t size) {
+    return check_allocation(realloc(ptr, size), size);
+}
+
+void mem_free(void* ptr) {
+    if (ptr != NULL) {
+        ALLOC_STATS.frees++;
+    }
+    free(ptr);
+}
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN(size) (((size) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = ARENA_ALIGN(size);
+
+    // blocks after the current one are left over from before the last reset
+    ArenaBlock* block = arena->current;
+    while (block != NULL && block->capacity - block->used < size) {
+        if (block->next == NULL) {
+            block = NULL;
+            break;
+        }
+        block = block->next;
+        block->used = 0;
+        arena->current = block;
+    }
+
+    if (block == NULL) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = mem_alloc(sizeof(ArenaBlock) + capacity);
+        block->next = NULL;
+        block->capacity = capacity;
+        block->used = 0;
+        ASAN_POISON_MEMORY_REGION(block->data, capacity);
+
+        if (arena->current) {
+            arena->current->next = block;
+        } else {
+            arena->first = block;
+        }
+        arena->current = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    ASAN_UNPOISON_MEMORY_REGION(ptr, size);
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void* arena_resize_block(Arena* arena, ArenaBlock* block, size_t capacity) {
+    ArenaBlock* previous = NULL;
+    if (arena->first != block) {
+        for (previous = arena->first; previous->next != block; previous = previous->next) { }
+    }
+
+    block = mem_realloc(block, sizeof(ArenaBlock) + capacity);
+    block->capacity = capacity;
+    block->used = capacity;
+    ASAN_UNPOISON_MEMORY_REGION(block->data, capacity);
+
+    if (previous) {
+        previous->next = block;
+    } else {
+        arena->first = block;
+    }
+    arena->current = block;
+    return block->data;
+}
+
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    ArenaBlock* block = arena->current;
+    if (ptr != NULL && block != NULL) {
+        size_t offset = (unsigned char*) ptr - block->data;
+        bool is_last = offset < block->capacity && offset + ARENA_ALIGN(old_size) == block->used;
+        if (is_last && offset + ARENA_ALIGN(new_size) <= block->capacity) {
+            block->used = offset + ARENA_ALIGN(new_size);
+            ASAN_UNPOISON_MEMORY_REGION(ptr, ARENA_ALIGN(new_size));
+            return ptr;
+        }
+        if (is_last && offset == 0) {
+            // ptr is alone in its block, resizing the block lets realloc avoid the copy for large sizes
+            return arena_resize_block(arena, block, ARENA_ALIGN(new_size));
+        }
+    }
+
+    void* grown = arena_alloc(arena, new_size);
+    if (ptr != NULL) {
+        memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return grown;
+}
+
+void arena_reset(Arena* arena) {
+#ifdef __SANITIZE_ADDRESS__
+    for (ArenaBlock* block = arena->first; block; block = block->next) {
+        ASAN_POISON_MEMORY_REGION(block->data, block->capacity);
+    }
+#endif
+    if (arena->first) {
+        arena->first->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+void* reserve_item(Arena* arena, void* items, size_t count, size_t* capacity, size_t item_size) {
+    if (count < *capacity) {
+        return items;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    items = arena_grow(arena, items, *capacity * item_size, new_capacity * item_size);
+    *capacity = new_capacity;
+    return items;
+}
+
+size_t arena_used(const Arena* arena) {
+    size_t used = 0;
+    for (ArenaBlock* block = arena->first; block; block = block->next) {
+        used += block->used;
+        if (block == arena->current) {
+            break;
+        }
+    }
+    return used;
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->first;
+    while (block) {
+        ArenaBlock* next = block->next;
+        mem_free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
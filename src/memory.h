@@ -0,0 +1,41 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+#include <stddef.h>
+
+// Every heap allocation of the interpreter goes through these wrappers so
+// they can be counted (see --profile). They exit on allocation failure.
+typedef struct {
+    size_t mallocs;
+    size_t frees;
+    size_t bytes;
+} AllocStats;
+
+extern AllocStats ALLOC_STATS;
+
+void* mem_alloc(size_t size);
+void* mem_calloc(size_t count, size_t size);
+void* mem_realloc(void* ptr, size_t size);
+void mem_free(void* ptr);
+
+// Bump allocator. Everything allocated during an evaluation lives in one
+// arena that is reset at the end of it, blocks are kept for the next one.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* first;
+    ArenaBlock* current;
+} Arena;
+
+// memory is zeroed
+void* arena_alloc(Arena* arena, size_t size);
+// resizes ptr, which must be the last allocation made in the arena to be extended in place
+void* arena_grow(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+// makes room for one more item in an arena allocated array of count items
+void* reserve_item(Arena* arena, void* items, size_t count, size_t* capacity, size_t item_size);
+// O(1), every allocation made so far is invalidated
+void arena_reset(Arena* arena);
+// bytes allocated since the last reset, alignment included
+size_t arena_used(const Arena* arena);
+void arena_free(Arena* arena);
+
+#endif // MEMORY_H
@@ -0,0 +1,648 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "./optimize.h"
+#include "./ast_operations.h"
+#include "./builtins.h"
+#include "./bigint.h"
+
+// node whose children are optimized before itself, the tree is walked with an explicit stack
+typedef struct {
+    ASTNode* node;
+    ASTNode* next_child;
+    ASTNode* function; // function whose parameters are in scope, NULL at the top level
+} OptimizeFrame;
+
+// expressions are only looked into that deep when checking that they are pure
+#define MAX_PURITY_DEPTH 16
+
+static bool is_literal(const ASTNode* node) {
+    return node->type == NODE_INT || node->type == NODE_FLOAT || node->type == NODE_BIG;
+}
+
+static bool is_int_literal(const ASTNode* node, int value) {
+    return node->type == NODE_INT && node->value.vali == value;
+}
+
+// big integers are copied to the arena of the AST, folding computes them in a scratch one
+static void set_literal(const AST* ast, ASTNode* node, Result value) {
+    if (value.type == RESULT_BIG) {
+        node->type = NODE_BIG;
+        node->value.valb = big_copy(value.valb, ast->arena);
+    } else if (value.type == RESULT_INT) {
+        node->type = NODE_INT;
+        node->value.vali = value.vali;
+    } else {
+        node->type = NODE_FLOAT;
+        node->value.valf = value.valf;
+    }
+    node->children = 0;
+    node->last_child = 0;
+}
+
+// node takes the place of its descendant in the tree
+static void replace_node(ASTNode* node, const ASTNode* descendant) {
+    NodeIndex next = node->next;
+    *node = *descendant;
+    node->next = next;
+}
+
+// The evaluator turns every float zero computed by an operator into the int 0, an operand
+// dropped by an identity must not be a float zero or the result would change type.
+static bool never_float_zero(const AST* ast, const ASTNode* node) {
+    while (node->type == NODE_UMINUS || node->type == NODE_UPLUS) {
+        node = ast_first_child(ast, node);
+    }
+    switch (node->type) {
+    case NODE_INT:
+    case NODE_BIG:
+    case NODE_PLUS:
+    case NODE_MINUS:
+    case NODE_MULT:
+    case NODE_DIV:
+    case NODE_EXP:
+    case NODE_MOD:
+    case NODE_EQUALITY: {
+        return true;
+    }
+    case NODE_FLOAT: {
+        return node->value.valf != 0;
+    }
+    case NODE_BUILTIN_FUNCTION: {
+        return !(node->value.builtin->flags & BUILTIN_FLOAT);
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+// true if evaluating node cannot fail nor change anything, *is_int tells if it is always an int
+static bool is_pure(const AST* ast, const ASTNode* node, ASTNode* function, bool* is_int, int depth) {
+    if (depth > MAX_PURITY_DEPTH) {
+        return false;
+    }
+    switch (node->type) {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_BIG: {
+        *is_int = node->type == NODE_INT;
+        return true;
+    }
+    case NODE_SYMBOL: {
+        // parameters are always bound, globals may not be
+        *is_int = false;
+        return ast_find_parameter(ast, function, node->value.symbol) >= 0;
+    }
+    case NODE_UPLUS:
+    case NODE_UMINUS:
+    case NODE_PLUS:
+    case NODE_MINUS:
+    case NODE_MULT:
+    case NODE_EQUALITY: {
+        bool all_int = true;
+        for (ASTNode* child = ast_first_child(ast, node); child; child = ast_next_sibling(ast, child)) {
+            bool child_int;
+            if (!is_pure(ast, child, function, &child_int, depth + 1)) {
+                return false;
+            }
+            all_int = all_int && child_int;
+        }
+        *is_int = node->type == NODE_EQUALITY || all_int;
+        return true;
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+// folds a binary operator on two literals, false if evaluating it would fail
+static bool fold_binary(const AST* ast, ASTNode* node, Result a, Result b) {
+    switch (node->type) {
+    case NODE_PLUS: {
+        set_literal(ast, node, ast_add(a, b));
+        return true;
+    }
+    case NODE_MINUS: {
+        set_literal(ast, node, ast_sub(a, b));
+        return true;
+    }
+    case NODE_MULT: {
+        set_literal(ast, node, ast_mul(a, b));
+        return true;
+    }
+    case NODE_DIV: {
+        if (ast_as_double(b) == 0) {
+            return false;
+        }
+        set_literal(ast, node, ast_div(a, b));
+        return true;
+    }
+    case NODE_EXP: {
+        bool zero_base = ast_as_double(a) == 0;
+        bool negative_power = ast_as_double(b) < 0;
+        // the power of an int base other than 0, 1 and -1 is a big integer past 2^31, which can take
+        // long, and so is any power of a big one
+        bool too_large = (a.type == RESULT_INT && b.type == RESULT_INT && (a.vali < -1 || a.vali > 1) && b.vali > 31)
+                         || a.type == RESULT_BIG || b.type == RESULT_BIG;
+        if ((zero_base && negative_power) || too_large) {
+            return false;
+        }
+        set_literal(ast, node, ast_exp(a, b));
+        return true;
+    }
+    case NODE_MOD: {
+        // the int modulo by zero is undefined, leave it to run time
+        if (ast_as_double(b) == 0) {
+            return false;
+        }
+        set_literal(ast, node, ast_mod(a, b));
+        return true;
+    }
+    case NODE_EQUALITY: {
+        set_literal(ast, node, ast_equal(a, b));
+        return true;
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+// folds a builtin call on literal arguments, false if evaluating it would fail, hang or take long
+static bool fold_builtin(const AST* ast, ASTNode* node) {
+    Result args[MAX_BUILTIN_ARITY];
+    int argc = 0;
+    for (ASTNode* arg = ast_first_child(ast, node); arg; arg = ast_next_sibling(ast, arg)) {
+        // arguments are wrapped in a NODE_EXPR
+        ASTNode* value = arg->type == NODE_EXPR ? ast_first_child(ast, arg) : arg;
+        if (argc == MAX_BUILTIN_ARITY || value == NULL || ast_next_sibling(ast, value) || !is_literal(value)) {
+            return false;
+        }
+        args[argc++] = create_result_from_node(value);
+    }
+    const Builtin* builtin = node->value.builtin;
+    if (!(builtin->flags & BUILTIN_PURE) || argc != builtin->arity || (builtin->foldable && !builtin->foldable(args))) {
+        return false;
+    }
+    set_literal(ast, node, builtin->function(args));
+    return true;
+}
+
+// x / c is x * (1 / c) exactly when c is a power of two whose inverse is a normal double
+static bool has_exact_inverse(double value) {
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    return (mantissa == 0.5 || mantissa == -0.5) && isnormal(1 / value);
+}
+
+static void optimize_node(const AST* ast, ASTNode* node, ASTNode* function) {
+    ASTNode* left = ast_first_child(ast, node);
+    ASTNode* right = left ? ast_next_sibling(ast, left) : NULL;
+
+    switch (node->type) {
+    case NODE_UPLUS: {
+        if (is_literal(left)) {
+            replace_node(node, left);
+        }
+    }
+    break;
+    case NODE_UMINUS: {
+        if (is_literal(left)) {
+            set_literal(ast, node, ast_neg(create_result_from_node(left)));
+        } else if (left->type == NODE_UMINUS) {
+            replace_node(node, ast_first_child(ast, left));
+        }
+    }
+    break;
+    case NODE_PLUS:
+    case NODE_MINUS:
+    case NODE_MULT:
+    case NODE_DIV:
+    case NODE_EXP:
+    case NODE_MOD:
+    case NODE_EQUALITY: {
+        if (is_literal(left) && is_literal(right)
+                && fold_binary(ast, node, create_result_from_node(left), create_result_from_node(right))) {
+            break;
+        }
+
+        bool left_is_int;
+        bool right_is_int;
+        if (node->type == NODE_PLUS && is_int_literal(left, 0) && never_float_zero(ast, right)) {
+            replace_node(node, right);
+        } else if ((node->type == NODE_PLUS || node->type == NODE_MINUS)
+                   && is_int_literal(right, 0) && never_float_zero(ast, left)) {
+            replace_node(node, left);
+        } else if (node->type == NODE_MULT && is_int_literal(left, 1) && never_float_zero(ast, right)) {
+            replace_node(node, right);
+        } else if ((node->type == NODE_MULT || node->type == NODE_DIV)
+                   && is_int_literal(right, 1) && never_float_zero(ast, left)) {
+            replace_node(node, left);
+        } else if (node->type == NODE_MULT && is_int_literal(right, 0)
+                   && is_pure(ast, left, function, &left_is_int, 0) && left_is_int) {
+            replace_node(node, right);
+        } else if (node->type == NODE_MULT && is_int_literal(left, 0)
+                   && is_pure(ast, right, function, &right_is_int, 0) && right_is_int) {
+            replace_node(node, left);
+        } else if (node->type == NODE_EXP && is_int_literal(right, 2) && left->type == NODE_SYMBOL) {
+            // the symbol is loaded twice, which cannot fail if loading it once did not
+            NodeIndex next = right->next;
+            *right = *left;
+            right->next = next;
+            node->type = NODE_MULT;
+        } else if (node->type == NODE_DIV && right->type == NODE_FLOAT && has_exact_inverse(right->value.valf)) {
+            right->value.valf = 1 / right->value.valf;
+            node->type = NODE_MULT;
+        }
+    }
+    break;
+    case NODE_BUILTIN_FUNCTION: {
+        fold_builtin(ast, node);
+    }
+    break;
+    case NODE_IF: {
+        // the condition is wrapped in a NODE_EXPR like every argument
+        ASTNode* condition = ast_first_child(ast, left);
+        if (condition && !ast_next_sibling(ast, condition) && is_literal(condition)) {
+            ASTNode* otherwise = ast_next_sibling(ast, right);
+            replace_node(node, ast_is_true(create_result_from_node(condition)) ? right : otherwise);
+        }
+    }
+    break;
+    default: {
+    }
+    }
+}
+
+// Value numbering: every pure expression is numbered with the first node computing the same
+// value, variables being told apart by the number of assignments to them (and of calls, which
+// may assign any global, for the globals). Expressions are never compared across functions.
+typedef struct {
+    NodeType type;
+    Symbol name;
+    uint64_t bits;         // value of a literal, version of a variable, index of a builtin
+    NodeIndex operands[2]; // value numbers
+} ValueKey;
+
+typedef struct {
+    ValueKey key;
+    NodeIndex node; // 0 for an empty entry
+} ValueEntry;
+
+typedef struct {
+    uint32_t assignments;
+} VariableVersion;
+
+typedef struct {
+    NodeIndex node;
+    NodeIndex next_child;
+    ASTNode* function;
+} NumberingFrame;
+
+typedef struct {
+    const AST* ast;
+    NodeIndex* numbers; // value number of each node, 0 if it has none
+    ValueEntry* entries; // open addressing, the capacity is a power of two
+    size_t entry_count;
+    size_t entry_capacity;
+    SymbolTable variables; // in the arena of the AST
+    VariableVersion* versions; // by slot in variables
+    size_t version_capacity;
+    uint32_t calls;
+} ValueNumbering;
+
+static uint64_t hash_key(const ValueKey* key) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037u;
+    const uint8_t* fields[] = {(const uint8_t*) &key->type, (const uint8_t*) &key->name, (const uint8_t*) &key->bits, (const uint8_t*) key->operands};
+    const size_t sizes[] = {sizeof(key->type), sizeof(key->name), sizeof(key->bits), sizeof(key->operands)};
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < sizes[i]; j++) {
+            hash = (hash ^ fields[i][j]) * 1099511628211u;
+        }
+    }
+    return hash;
+}
+
+static bool key_equal(const ValueKey* a, const ValueKey* b) {
+    return a->type == b->type && a->bits == b->bits && a->operands[0] == b->operands[0]
+           && a->operands[1] == b->operands[1] && a->name == b->name;
+}
+
+static ValueEntry* find_entry(ValueEntry* entries, size_t capacity, const ValueKey* key) {
+    size_t i = hash_key(key) & (capacity - 1);
+    while (entries[i].node && !key_equal(&entries[i].key, key)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+// number of the first node with the same key, node itself if it is the first
+static NodeIndex number_value(ValueNumbering* numbering, const ValueKey* key, NodeIndex node) {
+    if (2 * (numbering->entry_count + 1) > numbering->entry_capacity) {
+        size_t capacity = numbering->entry_capacity ? 2 * numbering->entry_capacity : 64;
+        ValueEntry* entries = mem_calloc(capacity, sizeof(ValueEntry));
+        for (size_t i = 0; i < numbering->entry_capacity; i++) {
+            if (numbering->entries[i].node) {
+                *find_entry(entries, capacity, &numbering->entries[i].key) = numbering->entries[i];
+            }
+        }
+        mem_free(numbering->entries);
+        numbering->entries = entries;
+        numbering->entry_capacity = capacity;
+    }
+
+    ValueEntry* entry = find_entry(numbering->entries, numbering->entry_capacity, key);
+    if (entry->node == 0) {
+        *entry = (ValueEntry) {.key = *key, .node = node};
+        numbering->entry_count++;
+    }
+    return entry->node;
+}
+
+// forgets every value, which is needed when entering or leaving a function body
+static void reset_numbering(ValueNumbering* numbering) {
+    if (numbering->entries) {
+        memset(numbering->entries, 0, numbering->entry_capacity * sizeof(ValueEntry));
+    }
+    numbering->entry_count = 0;
+    symbol_table_clear(&numbering->variables);
+}
+
+static VariableVersion* variable_version(ValueNumbering* numbering, Symbol name) {
+    size_t count = numbering->variables.count;
+    uint32_t slot = symbol_slot(&numbering->variables, numbering->ast->arena, name);
+    if (slot >= numbering->version_capacity) {
+        numbering->version_capacity = numbering->version_capacity ? 2 * numbering->version_capacity : 16;
+        numbering->versions = mem_realloc(numbering->versions, numbering->version_capacity * sizeof(VariableVersion));
+    }
+    if (slot == count) {
+        numbering->versions[slot] = (VariableVersion) {0};
+    }
+    return &numbering->versions[slot];
+}
+
+// expressions worth computing once, the others are as cheap to compute as to reload
+static bool is_shareable(NodeType type) {
+    switch (type) {
+    case NODE_UMINUS:
+    case NODE_PLUS:
+    case NODE_MINUS:
+    case NODE_MULT:
+    case NODE_DIV:
+    case NODE_EXP:
+    case NODE_MOD:
+    case NODE_EQUALITY:
+    case NODE_BUILTIN_FUNCTION: {
+        return true;
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+// Number of an operand, leaves are only numbered when an expression uses them since most are not.
+// Operands of a numbered expression contain no assignment nor call, the variables they read
+// still have the version they had when read.
+static NodeIndex operand_number(ValueNumbering* numbering, ASTNode* operand, ASTNode* function) {
+    const AST* ast = numbering->ast;
+    // same value as their only child
+    while ((operand->type == NODE_UPLUS || operand->type == NODE_EXPR)
+            && operand->children && !ast_next_sibling(ast, ast_first_child(ast, operand))) {
+        operand = ast_first_child(ast, operand);
+    }
+
+    ValueKey key = {.type = operand->type};
+    switch (operand->type) {
+    case NODE_INT: {
+        key.bits = (uint32_t) operand->value.vali;
+    }
+    break;
+    case NODE_FLOAT: {
+        memcpy(&key.bits, &operand->value.valf, sizeof(key.bits));
+    }
+    break;
+    case NODE_BIG: {
+        // every big literal is a value of its own
+        key.bits = (uint64_t) (uintptr_t) operand->value.valb;
+    }
+    break;
+    case NODE_SYMBOL: {
+        key.name = operand->value.symbol;
+        key.bits = variable_version(numbering, key.name)->assignments;
+        if (ast_find_parameter(ast, function, key.name) < 0) {
+            key.bits |= (uint64_t) numbering->calls << 32;
+        }
+    }
+    break;
+    default: {
+        return numbering->numbers[operand - ast->nodes];
+    }
+    }
+    return number_value(numbering, &key, operand - ast->nodes);
+}
+
+// numbers node once its children are numbered
+static void number_node(ValueNumbering* numbering, NodeIndex index, ASTNode* function) {
+    const AST* ast = numbering->ast;
+    ASTNode* node = ast_node(ast, index);
+
+    switch (node->type) {
+    case NODE_ASSIGN: {
+        variable_version(numbering, ast_first_child(ast, node)->value.symbol)->assignments++;
+    }
+    break;
+    case NODE_FUNCTION: {
+        numbering->calls++;
+    }
+    break;
+    default: {
+        if (!is_shareable(node->type)) {
+            return;
+        }
+        ValueKey key = {.type = node->type};
+        if (node->type == NODE_BUILTIN_FUNCTION) {
+            if (!(node->value.builtin->flags & BUILTIN_PURE)) {
+                return;
+            }
+            key.bits = node->value.builtin - BUILTINS;
+        }
+        size_t operand = 0;
+        for (ASTNode* child = ast_first_child(ast, node); child; child = ast_next_sibling(ast, child)) {
+            NodeIndex number = operand < 2 ? operand_number(numbering, child, function) : 0;
+            if (number == 0) {
+                return;
+            }
+            key.operands[operand++] = number;
+        }
+        numbering->numbers[index] = number_value(numbering, &key, index);
+    }
+    }
+}
+
+// numbers every node of the AST in evaluation order
+static void number_values(ValueNumbering* numbering) {
+    const AST* ast = numbering->ast;
+    size_t frame_capacity = 64;
+    size_t frame_count = 0;
+    NumberingFrame* frames = mem_alloc(frame_capacity * sizeof(NumberingFrame));
+    frames[frame_count++] = (NumberingFrame) {.node = ast->root, .next_child = ast_node(ast, ast->root)->children};
+
+    while (frame_count > 0) {
+        NumberingFrame* frame = &frames[frame_count - 1];
+        ASTNode* node = ast_node(ast, frame->node);
+        if (frame->next_child == 0) {
+            NumberingFrame done = *frame;
+            frame_count--;
+            if (node->type == NODE_FUNCDEF || node->type == NODE_IF) {
+                reset_numbering(numbering);
+            } else {
+                number_node(numbering, done.node, done.function);
+            }
+            continue;
+        }
+        ASTNode* child = ast_node(ast, frame->next_child);
+        frame->next_child = child->next;
+
+        ASTNode* function = frame->function;
+        if (node->type == NODE_FUNCDEF) {
+            function = ast_first_child(ast, node);
+            if (child == function) {
+                continue;
+            }
+            reset_numbering(numbering);
+        } else if (node->type == NODE_IF && child != ast_first_child(ast, node)) {
+            // a branch may not run, what it computes is not known after it nor in the other one
+            reset_numbering(numbering);
+        } else if (node->type == NODE_ASSIGN && child == ast_first_child(ast, node)) {
+            // the target is not read
+            continue;
+        }
+        if (frame_count >= frame_capacity) {
+            frame_capacity *= 2;
+            frames = mem_realloc(frames, frame_capacity * sizeof(NumberingFrame));
+        }
+        frames[frame_count++] = (NumberingFrame) {
+            .node = child - ast->nodes,
+            .next_child = child->children,
+            .function = function
+        };
+    }
+    mem_free(frames);
+}
+
+// Replaces the expressions computing a value already computed by NODE_REUSE nodes and turns the
+// nodes computing it first into NODE_SHARED ones. Numbering starts over at the branches of an if
+// and after it, so a node evaluated before another in the walk is evaluated before it in every run.
+static void share_common_subexpressions(AST* ast) {
+    ValueNumbering numbering = {
+        .ast = ast,
+        .numbers = mem_calloc(ast->count, sizeof(NodeIndex))
+    };
+    number_values(&numbering);
+
+    // the outermost repeated expressions are replaced, those nested in them are not evaluated anymore
+    uint32_t* slots = mem_calloc(ast->count, sizeof(uint32_t)); // slot + 1 of the nodes to share
+    NodeIndex* stack = mem_alloc(ast->count * sizeof(NodeIndex));
+    size_t count = 0;
+    stack[count++] = ast->root;
+    while (count > 0) {
+        NodeIndex index = stack[--count];
+        ASTNode* node = ast_node(ast, index);
+        NodeIndex first = numbering.numbers[index];
+        if (is_shareable(node->type) && first != 0 && first != index) {
+            if (slots[first] == 0) {
+                slots[first] = ++ast->shared_count;
+            }
+            node->type = NODE_REUSE;
+            node->value.slot = slots[first] - 1;
+            node->children = 0;
+            node->last_child = 0;
+            continue;
+        }
+        for (NodeIndex child = node->children; child; child = ast_node(ast, child)->next) {
+            stack[count++] = child;
+        }
+    }
+
+    // the node keeps its place in the tree and evaluates a copy of itself
+    size_t node_count = ast->count;
+    for (NodeIndex index = 1; index < node_count; index++) {
+        if (slots[index] == 0) {
+            continue;
+        }
+        ASTNode copy = ast->nodes[index];
+        copy.next = 0;
+        NodeIndex child = ast_append_node(ast, copy);
+        ASTNode* node = ast_node(ast, index);
+        node->type = NODE_SHARED;
+        node->value.slot = slots[index] - 1;
+        node->children = child;
+        node->last_child = child;
+    }
+
+    mem_free(stack);
+    mem_free(slots);
+    mem_free(numbering.numbers);
+    mem_free(numbering.entries);
+    mem_free(numbering.versions);
+}
+
+void optimize_ast(AST* ast) {
+    // the big integers computed while folding are dropped, only the literals keep a copy
+    Arena scratch = {0};
+    Arena* big_arena = BIG_ARENA;
+    BIG_ARENA = &scratch;
+
+    OptimizeFrame* frames = NULL;
+    size_t frame_count = 0;
+    size_t frame_capacity = 0;
+
+    ASTNode* root = ast_node(ast, ast->root);
+    frame_capacity = 64;
+    frames = mem_alloc(frame_capacity * sizeof(OptimizeFrame));
+    frames[frame_count++] = (OptimizeFrame) {.node = root, .next_child = ast_first_child(ast, root)};
+
+    while (frame_count > 0) {
+        OptimizeFrame* frame = &frames[frame_count - 1];
+        ASTNode* child = frame->next_child;
+        if (child == NULL) {
+            OptimizeFrame done = *frame;
+            frame_count--;
+            optimize_node(ast, done.node, done.function);
+            continue;
+        }
+        frame->next_child = ast_next_sibling(ast, child);
+
+        ASTNode* function = frame->function;
+        if (frame->node->type == NODE_FUNCDEF) {
+            // the name and parameters are left alone, the body sees the parameters
+            function = ast_first_child(ast, frame->node);
+            if (child == function) {
+                continue;
+            }
+        }
+        if (frame_count >= frame_capacity) {
+            frame_capacity *= 2;
+            frames = mem_realloc(frames, frame_capacity * sizeof(OptimizeFrame));
+        }
+        frames[frame_count++] = (OptimizeFrame) {
+            .node = child,
+            .next_child = ast_first_child(ast, child),
+            .function = function
+        };
+    }
+    mem_free(frames);
+    BIG_ARENA = big_arena;
+    arena_free(&scratch);
+
+    share_common_subexpressions(ast);
+}
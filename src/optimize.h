@@ -0,0 +1,14 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+#include "./ast.h"
+
+// Rewrites the AST in place before it is evaluated or compiled: constant subtrees (builtin
+// calls included) become literals, x + 0, x * 1, x / 1 and - - x lose their no-op, x ^ 2
+// becomes x * x, division by a power of two float becomes a multiplication and an if on a
+// constant becomes the branch it selects.
+// Expressions computing a value already computed since the last assignment or call it depends on
+// are then replaced with NODE_REUSE nodes reading it from the NODE_SHARED node computing it.
+// Rewrites only happen when they give the same value and the same errors as the original.
+void optimize_ast(AST* ast);
+
+#endif // OPTIMIZE_H
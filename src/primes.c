@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#ifndef __STDC_NO_THREADS__
+#include <threads.h>
+#endif
+
+#include "./primes.h"
+#include "./memory.h"
+
+int SIEVE_THREADS = 0;
+
+// the sieve first covers this and doubles when a query goes past it
+#define INITIAL_SIEVE_LIMIT ((uint64_t) 1 << 16)
+// is_prime grows the sieve below this, past it Miller-Rabin is cheaper than sieving up to n
+#define SMALL_PRIME_LIMIT ((uint64_t) 1 << 20)
+// the largest prime of 64 bits, 2^64 - 59
+#define LAST_PRIME_64 18446744073709551557u
+// bits of the segments sieved past the cache, 32 KB
+#define SEGMENT_WORDS 4096
+// a thread sieves that many numbers at least, a shorter range takes fewer threads
+#define MIN_THREAD_RANGE ((uint64_t) 1 << 24)
+#define MAX_SIEVE_THREADS 64
+
+// One bit per odd number, set when it is composite: bit i of word w stands for 128 w + 2 i + 1.
+// sieve_before[w] counts the odd primes below 128 w, so that counting the primes up to any n
+// reads one word.
+static uint64_t* sieve_composite = NULL;
+static uint32_t* sieve_before = NULL;
+static uint64_t sieve_limit = 0; // the numbers below it are sieved, a multiple of 128
+
+static void set_bit(uint64_t* bits, uint64_t bit) {
+    bits[bit / 64] |= (uint64_t) 1 << (bit % 64);
+}
+
+// n is odd and below sieve_limit
+static bool sieve_is_composite(uint64_t n) {
+    uint64_t bit = n / 2;
+    return (sieve_composite[bit / 64] >> (bit % 64)) & 1;
+}
+
+// primes up to n included, n is below sieve_limit
+static uint64_t sieve_pi(uint64_t n) {
+    if (n < 2) {
+        return 0;
+    }
+    uint64_t bit = (n - 1) / 2; // the last odd number up to n
+    uint64_t word = bit / 64;
+    uint64_t mask = bit % 64 == 63 ? ~(uint64_t) 0 : ((uint64_t) 1 << (bit % 64 + 1)) - 1;
+    // 2 is the one even prime
+    return 1 + sieve_before[word] + __builtin_popcountll(~sieve_composite[word] & mask);
+}
+
+static uint64_t isqrt(uint64_t n) {
+    uint64_t root = (uint64_t) sqrt((double) n);
+    while (root * root > n) {
+        root--;
+    }
+    while ((root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+// the odd primes up to sqrt(high - 1), heap allocated, the sieve must cover them
+static uint32_t* sieving_primes(uint64_t high, size_t* count) {
+    uint64_t limit = isqrt(high - 1);
+    *count = sieve_pi(limit) - 1;
+    uint32_t* primes = mem_alloc(*count * sizeof(uint32_t));
+    size_t found = 0;
+    for (uint64_t p = 3; p <= limit; p += 2) {
+        if (!sieve_is_composite(p)) {
+            primes[found++] = (uint32_t) p;
+        }
+    }
+    return primes;
+}
+
+// Sets the bits of the odd composites of [low, high) in bits, bit i standing for low + 2 i + 1.
+// low is even and primes holds the odd primes up to sqrt(high - 1).
+static void mark_composites(uint64_t* bits, uint64_t low, uint64_t high, const uint32_t* primes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t p = primes[i];
+        // the smaller multiples of p have a smaller factor, which marked them
+        uint64_t start = p * p;
+        if (start < low) {
+            start = (low + p - 1) / p * p;
+            if (start % 2 == 0) {
+                start += p;
+            }
+        }
+        // consecutive odd multiples are p bits apart
+        uint64_t end = (high - low) / 2;
+        for (uint64_t bit = (start - low) / 2; bit < end; bit += p) {
+            set_bit(bits, bit);
+        }
+    }
+}
+
+// makes the sieve cover n, which is below SIEVE_CACHE_LIMIT, only the new segment is sieved
+static void grow_sieve(uint64_t n) {
+    if (n < sieve_limit) {
+        return;
+    }
+    uint64_t limit = sieve_limit ? sieve_limit : INITIAL_SIEVE_LIMIT;
+    while (limit <= n) {
+        limit *= 2;
+    }
+    size_t old_words = sieve_limit / 128;
+    size_t words = limit / 128;
+    sieve_composite = mem_realloc(sieve_composite, words * sizeof(uint64_t));
+    sieve_before = mem_realloc(sieve_before, words * sizeof(uint32_t));
+    memset(sieve_composite + old_words, 0, (words - old_words) * sizeof(uint64_t));
+
+    if (sieve_limit == 0) {
+        // every prime is found before its square, where its multiples start being marked
+        set_bit(sieve_composite, 0);
+        for (uint64_t p = 3; p * p < limit; p += 2) {
+            if (sieve_is_composite(p)) {
+                continue;
+            }
+            for (uint64_t multiple = p * p; multiple < limit; multiple += 2 * p) {
+                set_bit(sieve_composite, multiple / 2);
+            }
+        }
+    } else {
+        // the primes up to the square root of the new limit are below the old one
+        size_t count;
+        uint32_t* primes = sieving_primes(limit, &count);
+        mark_composites(sieve_composite + old_words, sieve_limit, limit, primes, count);
+        mem_free(primes);
+    }
+
+    for (size_t w = old_words; w < words; w++) {
+        sieve_before[w] = w == 0 ? 0 : sieve_before[w - 1] + __builtin_popcountll(~sieve_composite[w - 1]);
+    }
+    sieve_limit = limit;
+}
+
+// Montgomery form modulo an odd n: x stands for x 2^64 mod n, a product then needs no division
+__extension__ typedef unsigned __int128 uint128;
+
+typedef struct {
+    uint64_t n;
+    uint64_t inverse; // n^-1 mod 2^64
+    uint64_t one;     // 2^64 mod n, 1 in Montgomery form
+    uint64_t square;  // 2^128 mod n, to convert into Montgomery form
+} Montgomery;
+
+static Montgomery montgomery_init(uint64_t n) {
+    Montgomery m = {.n = n};
+    // Newton's iteration doubles the correct low bits, n is its own inverse modulo 8
+    m.inverse = n;
+    for (int i = 0; i < 5; i++) {
+        m.inverse *= 2 - n * m.inverse;
+    }
+    m.one = -n % n;
+    m.square = (uint64_t) ((uint128) m.one * m.one % n);
+    return m;
+}
+
+// t 2^-64 mod n for t < n^2: the low 64 bits of t and of q n are equal, they cancel out
+static uint64_t montgomery_reduce(const Montgomery* m, uint128 t) {
+    uint64_t high = (uint64_t) (t >> 64);
+    uint64_t q = (uint64_t) t * m->inverse;
+    uint64_t qn = (uint64_t) (((uint128) q * m->n) >> 64);
+    return high >= qn ? high - qn : high - qn + m->n;
+}
+
+static uint64_t montgomery_mul(const Montgomery* m, uint64_t a, uint64_t b) {
+    return montgomery_reduce(m, (uint128) a * b);
+}
+
+// With n - 1 = d 2^s and d odd, a prime n has a^d = 1 or a^(d 2^r) = -1 for some r < s. These
+// bases leave no odd composite below 2^64 passing for all of them.
+static bool miller_rabin(uint64_t n) {
+    static const uint64_t BASES[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    Montgomery m = montgomery_init(n);
+    uint64_t minus_one = n - m.one;
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+
+    for (size_t i = 0; i < sizeof(BASES) / sizeof(BASES[0]); i++) {
+        uint64_t a = BASES[i] % n;
+        if (a == 0) {
+            continue;
+        }
+        uint64_t base = montgomery_mul(&m, a, m.square);
+        uint64_t x = m.one;
+        for (uint64_t e = d; e > 0; e >>= 1) {
+            if (e & 1) {
+                x = montgomery_mul(&m, x, base);
+            }
+            base = montgomery_mul(&m, base, base);
+        }
+        if (x == m.one || x == minus_one) {
+            continue;
+        }
+        bool witness = true;
+        for (int r = 1; r < s && witness; r++) {
+            x = montgomery_mul(&m, x, x);
+            witness = x != minus_one;
+        }
+        if (witness) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool is_prime(uint64_t n) {
+    static const uint64_t SMALL_PRIMES[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    if (n % 2 == 0) {
+        return n == 2;
+    }
+    if (n < SMALL_PRIME_LIMIT) {
+        grow_sieve(n);
+    }
+    if (n < sieve_limit) {
+        return !sieve_is_composite(n);
+    }
+    // past the sieve, most composites have a small factor
+    for (size_t i = 0; i < sizeof(SMALL_PRIMES) / sizeof(SMALL_PRIMES[0]); i++) {
+        if (n % SMALL_PRIMES[i] == 0) {
+            return false;
+        }
+    }
+    return miller_rabin(n);
+}
+
+uint64_t next_prime(uint64_t n) {
+    if (n < 2) {
+        return 2;
+    }
+    if (n >= LAST_PRIME_64) {
+        return 0;
+    }
+    uint64_t candidate = n % 2 == 0 ? n + 1 : n + 2;
+    while (!is_prime(candidate)) {
+        candidate += 2;
+    }
+    return candidate;
+}
+
+// Primes of [low, high) past the sieve, low is a multiple of 128. bits has SEGMENT_WORDS words,
+// the caller allocates it as the allocator is not thread safe.
+typedef struct {
+    uint64_t low;
+    uint64_t high;
+    const uint32_t* primes;
+    size_t prime_count;
+    uint64_t* bits;
+    uint64_t count;
+} SieveTask;
+
+static int sieve_task(void* argument) {
+    SieveTask* task = argument;
+    const uint64_t span = SEGMENT_WORDS * 128;
+    for (uint64_t low = task->low; low < task->high; low += span) {
+        uint64_t high = task->high - low < span ? task->high : low + span;
+        uint64_t odd = (high - low) / 2;
+        size_t words = (odd + 63) / 64;
+        memset(task->bits, 0, words * sizeof(uint64_t));
+        mark_composites(task->bits, low, high, task->primes, task->prime_count);
+        for (size_t w = 0; w < words; w++) {
+            uint64_t primes = ~task->bits[w];
+            if (w == words - 1 && odd % 64 != 0) {
+                primes &= ((uint64_t) 1 << (odd % 64)) - 1;
+            }
+            task->count += __builtin_popcountll(primes);
+        }
+    }
+    return 0;
+}
+
+static int sieve_thread_count(uint64_t range) {
+    long threads = SIEVE_THREADS > 0 ? SIEVE_THREADS : sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t useful = range / MIN_THREAD_RANGE + 1;
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((uint64_t) threads > useful) {
+        threads = (long) useful;
+    }
+    return threads < MAX_SIEVE_THREADS ? (int) threads : MAX_SIEVE_THREADS;
+}
+
+// the first task runs on this thread, each other one on its own
+static void run_sieve_tasks(SieveTask* tasks, int count) {
+#ifndef __STDC_NO_THREADS__
+    thrd_t threads[MAX_SIEVE_THREADS];
+    bool started[MAX_SIEVE_THREADS] = {0};
+    for (int i = 1; i < count; i++) {
+        started[i] = thrd_create(&threads[i], sieve_task, &tasks[i]) == thrd_success;
+    }
+    sieve_task(&tasks[0]);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            thrd_join(threads[i], NULL);
+        } else {
+            sieve_task(&tasks[i]);
+        }
+    }
+#else
+    for (int i = 0; i < count; i++) {
+        sieve_task(&tasks[i]);
+    }
+#endif
+}
+
+// primes of [low, high), split between threads in ranges of the same length
+static uint64_t count_primes(uint64_t low, uint64_t high) {
+    size_t prime_count;
+    uint32_t* primes = sieving_primes(high, &prime_count);
+    int thread_count = sieve_thread_count(high - low);
+    uint64_t chunk = ((high - low) / thread_count + 127) / 128 * 128;
+
+    SieveTask tasks[MAX_SIEVE_THREADS];
+    for (int i = 0; i < thread_count; i++) {
+        uint64_t task_low = high - low > i * chunk ? low + i * chunk : high;
+        tasks[i] = (SieveTask) {
+            .low = task_low,
+            .high = high - task_low > chunk ? task_low + chunk : high,
+            .primes = primes,
+            .prime_count = prime_count,
+            .bits = mem_alloc(SEGMENT_WORDS * sizeof(uint64_t)),
+        };
+    }
+    run_sieve_tasks(tasks, thread_count);
+
+    uint64_t count = 0;
+    for (int i = 0; i < thread_count; i++) {
+        count += tasks[i].count;
+        mem_free(tasks[i].bits);
+    }
+    mem_free(primes);
+    return count;
+}
+
+uint64_t prime_pi(uint64_t n) {
+    if (n < SIEVE_CACHE_LIMIT) {
+        grow_sieve(n);
+        return sieve_pi(n);
+    }
+    grow_sieve(SIEVE_CACHE_LIMIT - 1);
+    return sieve_pi(SIEVE_CACHE_LIMIT - 1) + count_primes(SIEVE_CACHE_LIMIT, n + 1);
+}
@@ -0,0 +1,24 @@
+#ifndef PRIMES_H
+#define PRIMES_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Primality of 64-bit integers. Small ones are read from a sieve of Eratosthenes kept between
+// calls and grown by segments as queries go further, the others go through a deterministic
+// Miller-Rabin test.
+
+// the sieve never covers numbers past this, it then takes 4 MB
+#define SIEVE_CACHE_LIMIT ((uint64_t) 1 << 26)
+// prime_pi counts the primes past the sieve segment by segment, up to this
+#define MAX_PRIME_PI ((uint64_t) 1 << 40)
+
+// threads sieving the segments past SIEVE_CACHE_LIMIT for prime_pi, 0 for one per processor
+extern int SIEVE_THREADS;
+
+bool is_prime(uint64_t n);
+// smallest prime greater than n, 0 when it does not fit 64 bits
+uint64_t next_prime(uint64_t n);
+// number of primes up to n included, n <= MAX_PRIME_PI
+uint64_t prime_pi(uint64_t n);
+
+#endif // PRIMES_H
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./resolve.h"
+
+typedef struct {
+    ASTNode* node;
+    ASTNode* funcdef; // definition whose body the node is in, NULL at the top level
+    bool tail;        // the value of node is the value of the body
+} ResolveEntry;
+
+Resolution resolve_variables(const AST* ast, Arena* arena) {
+    Resolution resolution = {
+        .slots = arena_alloc(arena, ast->count * sizeof(VariableSlot)),
+        .shared = arena_alloc(arena, ast->shared_count * sizeof(VariableSlot))
+    };
+    int32_t* locals = ast_function_locals(ast, arena);
+
+    // the order nodes are visited in does not matter, only the function they are in
+    size_t capacity = 64;
+    size_t count = 0;
+    ResolveEntry* stack = mem_alloc(capacity * sizeof(ResolveEntry));
+    stack[count++] = (ResolveEntry) {.node = ast_node(ast, ast->root)};
+
+    while (count > 0) {
+        ResolveEntry entry = stack[--count];
+        ASTNode* node = entry.node;
+        ASTNode* funcdef = entry.funcdef;
+        ASTNode* function = funcdef ? ast_first_child(ast, funcdef) : NULL;
+        ASTNode* child = ast_first_child(ast, node);
+
+        VariableSlot* slot = &resolution.slots[node - ast->nodes];
+        if (node->type == NODE_SYMBOL) {
+            int param = ast_find_parameter(ast, function, node->value.symbol);
+            if (param >= 0) {
+                *slot = (VariableSlot) {.slot = param, .local = true};
+            } else if (function && locals[node - ast->nodes] >= 0) {
+                *slot = (VariableSlot) {
+                    .slot = ast_count_children(ast, function) + locals[node - ast->nodes],
+                    .local = true
+                };
+            } else {
+                *slot = (VariableSlot) {.slot = symbol_slot(&resolution.globals, arena, node->value.symbol)};
+            }
+        } else if (node->type == NODE_FUNCTION) {
+            *slot = (VariableSlot) {
+                .slot = symbol_slot(&resolution.functions, arena, node->value.symbol),
+                .tail = entry.tail
+            };
+        } else if (node->type == NODE_SHARED && funcdef) {
+            // numbered after the arguments and the variables, like the temps of a chunk
+            VariableSlot* temps = &resolution.slots[funcdef - ast->nodes];
+            resolution.shared[node->value.slot] = (VariableSlot) {
+                .slot = ast_count_children(ast, function) + temps->slot++,
+                .local = true
+            };
+        } else if (node->type == NODE_SHARED) {
+            resolution.shared[node->value.slot] = (VariableSlot) {.slot = node->value.slot};
+        } else if (node->type == NODE_FUNCDEF) {
+            // the parameters are not variables, the body sees them
+            funcdef = node;
+            *slot = (VariableSlot) {.slot = locals[node - ast->nodes]};
+            resolution.slots[child - ast->nodes] = (VariableSlot) {
+                .slot = symbol_slot(&resolution.functions, arena, child->value.symbol)
+            };
+            child = ast_next_sibling(ast, child);
+        }
+
+        for (; child; child = ast_next_sibling(ast, child)) {
+            if (count >= capacity) {
+                capacity *= 2;
+                stack = mem_realloc(stack, capacity * sizeof(ResolveEntry));
+            }
+            stack[count++] = (ResolveEntry) {
+                .node = child,
+                .funcdef = funcdef,
+                .tail = node->type == NODE_FUNCDEF || (entry.tail && ast_is_tail_child(ast, node, child))
+            };
+        }
+    }
+
+    mem_free(stack);
+    return resolution;
+}
@@ -0,0 +1,28 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+#include "./ast.h"
+
+// Where the tree walker keeps a variable, decided before evaluation like the bytecode compiler
+// does: a parameter of the enclosing function is an index in the arguments of the call, a
+// variable of the body (see ast_function_locals()) one after them, any other name is a global.
+// Function names get slots of their own.
+typedef struct {
+    uint32_t slot;
+    bool local;
+    bool tail; // NODE_FUNCTION: the call is the last thing the function it is in does
+} VariableSlot;
+
+typedef struct {
+    // by node index, set for the NODE_SYMBOL and NODE_FUNCTION nodes, and for the NODE_FUNCDEF
+    // nodes to the count of variables and shared values of the body
+    VariableSlot* slots;
+    // by NODE_SHARED slot: local after the arguments of the call in a function body, else global
+    VariableSlot* shared;
+    SymbolTable globals;   // names by slot
+    SymbolTable functions; // names by slot
+} Resolution;
+
+// everything is allocated in arena
+Resolution resolve_variables(const AST* ast, Arena* arena);
+
+#endif // RESOLVE_H
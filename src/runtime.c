@@ -4,28 +4,46 @@
 #include <errno.h>
 
 #include "runtime.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "jit.h"
+#include "optimize.h"
+#include "memo.h"
+#include "bigint.h"
+#include "ast_operations.h"
 
 int GENERATE_GRAPH = 0;
 int DEBUG_MODE = 0;
+int PROFILE_MODE = 0;
+int TREE_WALK_MODE = 0;
+int JIT_MODE = 0;
+int OPTIMIZE_MODE = 1;
+int DUMP_OPTIMIZED = 0;
 
-static const char* NODE_FMT[NODE_COUNT + 1] = {"INT", "FLOAT", "+", "-", "+", "-", "/", "*", "^", "%", "==", "=", "FUNCDEF", "FUNC", "SYMBOL", "Expr", "Program", "!NodeCount!"};
+// owns the tokens, the AST and the scopes of the current evaluation
+static Arena eval_arena = {0};
+// holds the big integer returned by the last evaluation until the next one
+static Arena result_arena = {0};
+
+static const char* NODE_FMT[NODE_COUNT + 1] = {"INT", "FLOAT", "BIG", "+", "-", "+", "-", "/", "*", "^", "%", "==", "=", "FUNCDEF", "FUNC", "SYMBOL", "Expr", "Program", "FuncDef", "If", "Shared", "Reuse", "!NodeCount!"};
 
 static void write_node_label(FILE* f, ASTNode* node) {
     switch (node->type) {
     case NODE_INT: {
-        fprintf(f, "[label=\"%d\"]\n", *((int*) node->value));
+        fprintf(f, "[label=\"%d\"]\n", node->value.vali);
     }
     break;
     case NODE_FLOAT: {
-        fprintf(f, "[label=\"%f\"]\n", *((double*) node->value));
+        fprintf(f, "[label=\"%f\"]\n", node->value.valf);
     }
     break;
+    case NODE_BIG:
     case NODE_SYMBOL: {
-        fprintf(f, "[label=\"%s\"]\n", node->token->value);
+        fprintf(f, "[label=\"" SV_Fmt "\"]\n", SV_Arg(node->token->value));
     }
     break;
     case NODE_FUNCTION: {
-        fprintf(f, "[label=\"Func(%s)\"]\n", node->token->value);
+        fprintf(f, "[label=\"Func(" SV_Fmt ")\"]\n", SV_Arg(node->token->value));
     }
     break;
     case NODE_FUNCDEF: {
@@ -38,28 +56,64 @@ static void write_node_label(FILE* f, ASTNode* node) {
     }
 }
 
-static int _generate_dot(FILE* f, ASTNode* node, int parent, int nextid) {
-    if (node == NULL) {
-        return nextid;
-    }
-    int id = nextid++;
+typedef struct {
+    ASTNode* node;
+    int parent;
+} DotEntry;
 
-    fprintf(f, "\tnode%d", id);
-    write_node_label(f, node);
-    if (parent >= 0) {
-        fprintf(f, "\tnode%d -- node%d\n", parent, id);
-    }
+// Nodes are numbered in depth first order, the walk uses a heap allocated stack. A NODE_REUSE
+// node is drawn as an edge to the NODE_SHARED node it reads, which always comes first.
+static void _generate_dot(FILE* f, const AST* ast, ASTNode* root) {
+    size_t capacity = 64;
+    size_t count = 0;
+    DotEntry* stack = mem_alloc(capacity * sizeof(DotEntry));
+    int* shared_ids = mem_alloc((ast->shared_count + 1) * sizeof(int));
+    stack[count++] = (DotEntry) {
+        .node = root,
+        .parent = -1
+    };
 
-    ASTNode* child = node->children;
-    if (node->children) {
-        for (; child->next; child = child->next) {
-            nextid = _generate_dot(f, child, id, nextid);
+    int nextid = 0;
+    while (count > 0) {
+        DotEntry entry = stack[--count];
+        if (entry.node->type == NODE_REUSE) {
+            fprintf(f, "\tnode%d -- node%d [style=dashed]\n", entry.parent, shared_ids[entry.node->value.slot]);
+            continue;
+        }
+        int id = nextid++;
+        if (entry.node->type == NODE_SHARED) {
+            shared_ids[entry.node->value.slot] = id;
+        }
+
+        fprintf(f, "\tnode%d", id);
+        write_node_label(f, entry.node);
+        if (entry.parent >= 0) {
+            fprintf(f, "\tnode%d -- node%d\n", entry.parent, id);
+        }
+
+        size_t child_count = 0;
+        for (ASTNode* child = ast_first_child(ast, entry.node); child; child = ast_next_sibling(ast, child)) {
+            child_count++;
+        }
+        if (count + child_count > capacity) {
+            capacity = 2 * (count + child_count);
+            stack = mem_realloc(stack, capacity * sizeof(DotEntry));
         }
+        // pushed last to first so the first child gets the next id
+        size_t i = count + child_count;
+        for (ASTNode* child = ast_first_child(ast, entry.node); child; child = ast_next_sibling(ast, child)) {
+            stack[--i] = (DotEntry) {
+                .node = child,
+                .parent = id
+            };
+        }
+        count += child_count;
     }
-    return _generate_dot(f, child, id, nextid);
+    mem_free(shared_ids);
+    mem_free(stack);
 }
 
-static void generate_dot(ASTNode* ast) {
+static void generate_dot(const AST* ast) {
     FILE* fp = fopen("graph.dot", "w+");
     if (fp == NULL) {
         fprintf(stderr, "Could not open file 'graph.dot': %s", strerror(errno));
@@ -67,55 +121,107 @@ static void generate_dot(ASTNode* ast) {
     }
     fprintf(fp, "graph {\n");
     // fprintf(fp, "bgcolor=\"grey\"\n");
-    _generate_dot(fp, ast, -1, 0);
+    _generate_dot(fp, ast, ast_node(ast, ast->root));
     fprintf(fp, "}");
     fclose(fp);
     system("dot -Tsvg graph.dot > graph.svg");
 }
 
-Result evaluate_input(const char* input) {
-    Token* tokens = calloc(1, sizeof(Token));
-    Token* sentinel = tokens;
-    size_t index = 0;
-    while (index < strlen(input)) {
-        tokens->next = next_token(input, &index);
-        tokens = tokens->next;
+static void print_profile(AllocStats before, MemoStats memo_before) {
+    fprintf(stderr, "Profile:\n");
+    fprintf(stderr, "  mallocs: %zu\n", ALLOC_STATS.mallocs - before.mallocs);
+    fprintf(stderr, "  frees:   %zu\n", ALLOC_STATS.frees - before.frees);
+    fprintf(stderr, "  bytes:   %zu\n", ALLOC_STATS.bytes - before.bytes);
+    if (MEMOIZE) {
+        fprintf(stderr, "  memo hits:      %zu\n", MEMO_STATS.hits - memo_before.hits);
+        fprintf(stderr, "  memo misses:    %zu\n", MEMO_STATS.misses - memo_before.misses);
+        fprintf(stderr, "  memo evictions: %zu\n", MEMO_STATS.evictions - memo_before.evictions);
     }
+}
+
+static Result evaluate_lexer(Lexer* lexer) {
+    AllocStats stats_before = ALLOC_STATS;
+    MemoStats memo_before = MEMO_STATS;
+    arena_reset(&result_arena);
+
+    Tokens tokens = {.arena = &eval_arena};
+    tokenize(lexer, &tokens);
     if (DEBUG_MODE) {
         printf("Tokens:\n");
-        for (Token* token = sentinel->next; token; token = token->next) {
-            print_token(stdout, token);
+        for (size_t i = 0; i < tokens.count; i++) {
+            print_token(stdout, &tokens.items[i]);
             printf("\n");
         }
         printf("\n");
     }
 
-    ASTNode* ast = build_AST(&(sentinel->next));
+    AST ast = build_AST(&tokens, &eval_arena);
 
     if (DEBUG_MODE) {
-        print_AST(ast);
+        print_AST(&ast, ast_node(&ast, ast.root));
+        printf("\n\n");
+    }
+    if (OPTIMIZE_MODE) {
+        optimize_ast(&ast);
+    }
+    if (DUMP_OPTIMIZED) {
+        printf("Optimized AST:\n");
+        print_AST(&ast, ast_node(&ast, ast.root));
         printf("\n\n");
     }
     if (GENERATE_GRAPH) {
-        generate_dot(ast);
+        generate_dot(&ast);
     }
 
-    Result result = interpret_ast(ast);
+    Result result;
+    if (TREE_WALK_MODE) {
+        result = interpret_ast(&ast, &eval_arena);
+    } else {
+        Program* program = compile_ast(&ast, &eval_arena);
+        if (DEBUG_MODE) {
+            print_program(stdout, program);
+            printf("\n");
+        }
+        result = JIT_MODE ? jit_run(program, &eval_arena) : vm_run(program, &eval_arena);
+    }
+    if (result.type == RESULT_BIG) {
+        result.valb = big_copy(result.valb, &result_arena);
+    }
+    arena_reset(&eval_arena);
 
-    // tokens are actually freed during free_AST
-    free_AST(ast);
-    free(sentinel);
+    if (PROFILE_MODE) {
+        print_profile(stats_before, memo_before);
+    }
+    return result;
+}
+
+Result evaluate_input(const char* input) {
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    Result result = evaluate_lexer(&lexer);
+    lexer_free(&lexer);
     return result;
 }
 
+// the input is tokenized chunk by chunk as read returns it
+Result evaluate_stream(InputReader read, void* context) {
+    Lexer lexer;
+    lexer_init(&lexer, read, context);
+    Result result = evaluate_lexer(&lexer);
+    lexer_free(&lexer);
+    return result;
+}
+
+static void print_result(Result result) {
+    char* string = ast_result_string(result);
+    printf("%s\n", string);
+    mem_free(string);
+}
+
 void run(const char* input) {
-    Result result = evaluate_input(input);
+    print_result(evaluate_input(input));
+}
 
-    if (result.type == RESULT_INT) {
-        // printf("%s = %d\n", input, result.vali);
-        printf("%d\n", result.vali);
-    } else {
-        // printf("%s = %f\n", input,  result.valf);
-        printf("%.10f\n", result.valf);
-    }
+void run_stream(InputReader read, void* context) {
+    print_result(evaluate_stream(read, context));
 }
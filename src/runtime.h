@@ -6,8 +6,19 @@
 
 extern int GENERATE_GRAPH;
 extern int DEBUG_MODE;
+extern int PROFILE_MODE;
+// evaluate the AST directly instead of compiling it to bytecode for the VM
+extern int TREE_WALK_MODE;
+// translate the bytecode to machine code before running it, see jit.h
+extern int JIT_MODE;
+// fold constants and simplify the AST before running it, see optimize.h
+extern int OPTIMIZE_MODE;
+// print the AST once optimized
+extern int DUMP_OPTIMIZED;
 
 Result evaluate_input(const char* input);
+Result evaluate_stream(InputReader read, void* context);
 void run(const char* input);
+void run_stream(InputReader read, void* context);
 
 #endif /* ! RUNTIME_H */
@@ -0,0 +1,247 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "./scan.h"
+
+typedef size_t (*ScanFn)(const char* str);
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static size_t scan_digits_scalar(const char* str) {
+    size_t len = 0;
+    while (is_digit(str[len])) {
+        len++;
+    }
+    return len;
+}
+
+static size_t scan_letters_scalar(const char* str) {
+    size_t len = 0;
+    while (is_letter(str[len])) {
+        len++;
+    }
+    return len;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static size_t scan_spaces_scalar(const char* str) {
+    size_t len = 0;
+    while (is_space(str[len])) {
+        len++;
+    }
+    return len;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SCAN_SIMD
+
+// Every load is aligned on the vector size so it can never cross a page boundary: reading the
+// bytes that follow the NUL terminator is harmless, it is the same trick libc uses for strlen.
+// Those bytes are out of bounds for ASan though.
+#define SCAN_KERNEL __attribute__((no_sanitize_address))
+#define AVX2_KERNEL __attribute__((no_sanitize_address, target("avx2")))
+
+// Each *_class function returns a vector where bytes of the class are 0xFF.
+// Ranges are checked with a single unsigned compare: c in [lo, lo + n] <=> max(c - lo, n) == n
+static inline __m128i sse2_in_range(__m128i v, char lo, char n) {
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    __m128i bound = _mm_set1_epi8(n);
+    return _mm_cmpeq_epi8(_mm_max_epu8(shifted, bound), bound);
+}
+
+static inline __m128i sse2_digit_class(__m128i v) {
+    return sse2_in_range(v, '0', 9);
+}
+
+static inline __m128i sse2_letter_class(__m128i v) {
+    // setting bit 5 maps upper case letters onto lower case ones
+    return sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+}
+
+static inline __m128i sse2_space_class(__m128i v) {
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    return _mm_or_si128(blank, newline);
+}
+
+#define DEFINE_SSE2_SCAN(name, class)                                               \
+    SCAN_KERNEL static size_t name(const char* str) {                               \
+        uintptr_t offset = (uintptr_t) str & 15;                                    \
+        const __m128i* block = (const __m128i*) (str - offset);                     \
+        uint32_t stop = ~(uint32_t) _mm_movemask_epi8(class(_mm_load_si128(block)));\
+        stop = (stop & 0xFFFF) >> offset;                                           \
+        if (stop) {                                                                 \
+            return __builtin_ctz(stop);                                             \
+        }                                                                           \
+        size_t len = 16 - offset;                                                   \
+        for (;;) {                                                                  \
+            block++;                                                                \
+            stop = ~(uint32_t) _mm_movemask_epi8(class(_mm_load_si128(block)));     \
+            stop &= 0xFFFF;                                                         \
+            if (stop) {                                                             \
+                return len + __builtin_ctz(stop);                                   \
+            }                                                                       \
+            len += 16;                                                              \
+        }                                                                           \
+    }
+
+DEFINE_SSE2_SCAN(scan_digits_sse2, sse2_digit_class)
+DEFINE_SSE2_SCAN(scan_letters_sse2, sse2_letter_class)
+DEFINE_SSE2_SCAN(scan_spaces_sse2, sse2_space_class)
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_in_range(__m256i v, char lo, char n) {
+    __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    __m256i bound = _mm256_set1_epi8(n);
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(shifted, bound), bound);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_digit_class(__m256i v) {
+    return avx2_in_range(v, '0', 9);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_letter_class(__m256i v) {
+    return avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 25);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_space_class(__m256i v) {
+    __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    __m256i newline = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    return _mm256_or_si256(blank, newline);
+}
+
+#define DEFINE_AVX2_SCAN(name, class)                                                   \
+    AVX2_KERNEL static size_t name(const char* str) {                                   \
+        uintptr_t offset = (uintptr_t) str & 31;                                        \
+        const __m256i* block = (const __m256i*) (str - offset);                         \
+        uint32_t stop = ~(uint32_t) _mm256_movemask_epi8(class(_mm256_load_si256(block)));\
+        stop >>= offset;                                                                \
+        if (stop) {                                                                     \
+            return __builtin_ctz(stop);                                                 \
+        }                                                                               \
+        size_t len = 32 - offset;                                                       \
+        for (;;) {                                                                      \
+            block++;                                                                    \
+            stop = ~(uint32_t) _mm256_movemask_epi8(class(_mm256_load_si256(block)));   \
+            if (stop) {                                                                 \
+                return len + __builtin_ctz(stop);                                       \
+            }                                                                           \
+            len += 32;                                                                  \
+        }                                                                               \
+    }
+
+DEFINE_AVX2_SCAN(scan_digits_avx2, avx2_digit_class)
+DEFINE_AVX2_SCAN(scan_letters_avx2, avx2_letter_class)
+DEFINE_AVX2_SCAN(scan_spaces_avx2, avx2_space_class)
+#endif
+
+static const char* SCAN_IMPL_NAMES[SCAN_IMPL_COUNT] = {"scalar", "sse2", "avx2"};
+
+static const ScanFn SCANNERS[SCAN_IMPL_COUNT][3] = {
+    [SCAN_SCALAR] = {scan_digits_scalar, scan_letters_scalar, scan_spaces_scalar},
+#ifdef SCAN_SIMD
+    [SCAN_SSE2] = {scan_digits_sse2, scan_letters_sse2, scan_spaces_sse2},
+    [SCAN_AVX2] = {scan_digits_avx2, scan_letters_avx2, scan_spaces_avx2},
+#endif
+};
+
+static size_t resolve_digits(const char* str);
+static size_t resolve_letters(const char* str);
+static size_t resolve_spaces(const char* str);
+
+// the first call of any scanner picks the implementation for all of them
+static ScanFn scan_digits_impl = resolve_digits;
+static ScanFn scan_letters_impl = resolve_letters;
+static ScanFn scan_spaces_impl = resolve_spaces;
+static ScanImpl current_impl = SCAN_SCALAR;
+
+bool scan_impl_supported(ScanImpl impl) {
+    switch (impl) {
+    case SCAN_SCALAR: {
+        return true;
+    }
+#ifdef SCAN_SIMD
+    case SCAN_SSE2: {
+        // part of the x86-64 baseline
+        return true;
+    }
+    case SCAN_AVX2: {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    default: {
+        return false;
+    }
+    }
+}
+
+ScanImpl scan_best_impl(void) {
+    for (int impl = SCAN_IMPL_COUNT - 1; impl > SCAN_SCALAR; impl--) {
+        if (scan_impl_supported(impl)) {
+            return impl;
+        }
+    }
+    return SCAN_SCALAR;
+}
+
+bool scan_set_impl(ScanImpl impl) {
+    if (!scan_impl_supported(impl)) {
+        return false;
+    }
+    current_impl = impl;
+    scan_digits_impl = SCANNERS[impl][0];
+    scan_letters_impl = SCANNERS[impl][1];
+    scan_spaces_impl = SCANNERS[impl][2];
+    return true;
+}
+
+const char* scan_impl_name(ScanImpl impl) {
+    return SCAN_IMPL_NAMES[impl];
+}
+
+ScanImpl scan_current_impl(void) {
+    if (scan_digits_impl == resolve_digits) {
+        scan_set_impl(scan_best_impl());
+    }
+    return current_impl;
+}
+
+static size_t resolve_digits(const char* str) {
+    scan_set_impl(scan_best_impl());
+    return scan_digits_impl(str);
+}
+
+static size_t resolve_letters(const char* str) {
+    scan_set_impl(scan_best_impl());
+    return scan_letters_impl(str);
+}
+
+static size_t resolve_spaces(const char* str) {
+    scan_set_impl(scan_best_impl());
+    return scan_spaces_impl(str);
+}
+
+#define DEFINE_SCAN(name, impl)       \
+    size_t name(const char* str) {    \
+        return impl(str);             \
+    }
+
+DEFINE_SCAN(scan_digits, scan_digits_impl)
+DEFINE_SCAN(scan_letters, scan_letters_impl)
+DEFINE_SCAN(scan_spaces, scan_spaces_impl)
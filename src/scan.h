@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum {
+    SCAN_SCALAR = 0,
+    SCAN_SSE2,
+    SCAN_AVX2,
+    SCAN_IMPL_COUNT
+} ScanImpl;
+
+// Length of the run of digits / letters / whitespace starting at str.
+// str must be NUL terminated, the terminator always ends a run.
+// On x86-64 these classify 16 or 32 bytes at a time, the implementation is
+// picked from CPUID on first use unless one was forced with scan_set_impl.
+size_t scan_digits(const char* str);
+size_t scan_letters(const char* str);
+size_t scan_spaces(const char* str);
+
+bool scan_impl_supported(ScanImpl impl);
+ScanImpl scan_best_impl(void);
+ScanImpl scan_current_impl(void);
+bool scan_set_impl(ScanImpl impl);
+const char* scan_impl_name(ScanImpl impl);
+
+#endif // SCAN_H
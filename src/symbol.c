@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./symbol.h"
+
+// Names are hashed once, when interned. Afterwards symbols are compared as integers.
+typedef struct {
+    String_View* names;    // by symbol, names[0] is unused
+    uint32_t* hashes;      // by symbol
+    size_t count;          // symbols, 0 included
+    size_t capacity;
+    Symbol* table;         // open addressing, 0 for an empty entry
+    size_t table_capacity; // power of two, at least twice count
+    Arena strings;         // copies of the names, never reset
+} Interner;
+
+static Interner interner = {0};
+
+static uint32_t hash_name(String_View name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < name.count; i++) {
+        hash = (hash ^ (uint8_t) name.data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// multiplying by an odd number spreads consecutive symbols over a power of two table without
+// any collision between them
+static size_t hash_symbol(Symbol symbol) {
+    return (size_t) symbol * 2654435769u;
+}
+
+static void grow_interner_table(void) {
+    size_t capacity = interner.table_capacity ? interner.table_capacity * 2 : 256;
+    Symbol* table = mem_calloc(capacity, sizeof(Symbol));
+    for (Symbol symbol = 1; symbol < interner.count; symbol++) {
+        size_t i = interner.hashes[symbol] & (capacity - 1);
+        while (table[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        table[i] = symbol;
+    }
+    mem_free(interner.table);
+    interner.table = table;
+    interner.table_capacity = capacity;
+}
+
+Symbol intern(String_View name) {
+    if (2 * interner.count >= interner.table_capacity) {
+        grow_interner_table();
+    }
+
+    uint32_t hash = hash_name(name);
+    size_t i = hash & (interner.table_capacity - 1);
+    for (; interner.table[i]; i = (i + 1) & (interner.table_capacity - 1)) {
+        Symbol symbol = interner.table[i];
+        if (interner.hashes[symbol] == hash && sv_eq(interner.names[symbol], name)) {
+            return symbol;
+        }
+    }
+
+    if (interner.count == 0) {
+        interner.count = 1;
+    }
+    if (interner.count >= interner.capacity) {
+        interner.capacity = interner.capacity ? interner.capacity * 2 : 256;
+        interner.names = mem_realloc(interner.names, interner.capacity * sizeof(String_View));
+        interner.hashes = mem_realloc(interner.hashes, interner.capacity * sizeof(uint32_t));
+    }
+    if (interner.count > UINT32_MAX - 1) {
+        fprintf(stderr, "[ERROR] Too many names\n");
+        exit(1);
+    }
+
+    char* data = arena_alloc(&interner.strings, name.count);
+    memcpy(data, name.data, name.count);
+    Symbol symbol = interner.count++;
+    interner.names[symbol] = sv_from_parts(data, name.count);
+    interner.hashes[symbol] = hash;
+    interner.table[i] = symbol;
+    return symbol;
+}
+
+String_View symbol_name(Symbol symbol) {
+    if (symbol == 0 || symbol >= interner.count) {
+        return SV("");
+    }
+    return interner.names[symbol];
+}
+
+static void grow_index(SymbolTable* table, Arena* arena) {
+    size_t capacity = table->index_capacity ? table->index_capacity * 2 : 16;
+    uint32_t* index = arena_alloc(arena, capacity * sizeof(uint32_t));
+    for (size_t slot = 0; slot < table->count; slot++) {
+        size_t i = hash_symbol(table->symbols[slot]) & (capacity - 1);
+        while (index[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        index[i] = slot + 1;
+    }
+    table->index = index;
+    table->index_capacity = capacity;
+}
+
+uint32_t symbol_slot(SymbolTable* table, Arena* arena, Symbol symbol) {
+    if (2 * table->count >= table->index_capacity) {
+        grow_index(table, arena);
+    }
+
+    size_t i = hash_symbol(symbol) & (table->index_capacity - 1);
+    for (; table->index[i]; i = (i + 1) & (table->index_capacity - 1)) {
+        uint32_t slot = table->index[i] - 1;
+        if (table->symbols[slot] == symbol) {
+            return slot;
+        }
+    }
+
+    table->symbols = reserve_item(arena, table->symbols, table->count, &table->capacity, sizeof(Symbol));
+    table->symbols[table->count] = symbol;
+    table->index[i] = ++table->count;
+    return table->count - 1;
+}
+
+void symbol_table_clear(SymbolTable* table) {
+    if (table->index) {
+        memset(table->index, 0, table->index_capacity * sizeof(uint32_t));
+    }
+    table->count = 0;
+}
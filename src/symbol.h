@@ -0,0 +1,30 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+#include <stdint.h>
+#include "./sv.h"
+#include "./memory.h"
+
+// Interned name: two symbols are equal if and only if their names are. Symbols are numbered
+// from 1 in the order their names are first interned, 0 is no symbol.
+typedef uint32_t Symbol;
+
+// the name is copied, it stays valid until the process exits
+Symbol intern(String_View name);
+String_View symbol_name(Symbol symbol);
+
+// Slots numbered from 0 in the order symbols are added, looked up through an open addressing
+// hash table. Everything is allocated in arena.
+typedef struct {
+    Symbol* symbols;       // by slot
+    size_t count;
+    size_t capacity;
+    uint32_t* index;       // slot + 1 of the symbols hashed there, 0 for an empty entry
+    size_t index_capacity; // power of two, at least twice count
+} SymbolTable;
+
+// slot of symbol, a new one is added if it has none
+uint32_t symbol_slot(SymbolTable* table, Arena* arena, Symbol symbol);
+// forgets every symbol, the memory is kept for the next ones
+void symbol_table_clear(SymbolTable* table);
+
+#endif // SYMBOL_H
@@ -1,10 +1,15 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <unistd.h>
 
+#define SV_IMPLEMENTATION
 #include "./token.h"
+#include "./scan.h"
 
 void print_type(FILE* out, int token_type) {
     switch (token_type) {
@@ -77,163 +82,337 @@ void print_token(FILE* out, Token* token) {
         return;
     }
     print_type(out, token->type);
-    fprintf(out, " value: '%s'", token->value);
+    fprintf(out, " value: '" SV_Fmt "'", SV_Arg(token->value));
 }
 
-bool is_digit(char c) {
-    return c >= '0' && c <= '9';
-}
+// The tokenizer is a DFA: every byte is mapped to a character class, and the
+// (state, class) pair gives the next state. A token ends when the transition
+// is LEX_STOP, its type is then given by the state the automaton stopped in.
+typedef enum {
+    CC_OTHER = 0,
+    CC_END,
+    CC_SPACE,
+    CC_DIGIT,
+    CC_DOT,
+    CC_LETTER,
+    // letters of the 'def' keyword
+    CC_D,
+    CC_E,
+    CC_F,
+    CC_PLUS,
+    CC_MINUS,
+    CC_STAR,
+    CC_SLASH,
+    CC_CARET,
+    CC_PERCENT,
+    CC_EQUAL,
+    CC_OPARENTHESIS,
+    CC_CPARENTHESIS,
+    CC_COMMA,
+    CC_SEMICOLON,
+    CC_COUNT
+} CharClass;
 
-bool is_letter(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
-}
+typedef enum {
+    LEX_STOP = 0,
+    LEX_START,
+    LEX_INT,
+    LEX_FLOAT,
+    LEX_SYMBOL,
+    LEX_D,
+    LEX_DE,
+    LEX_DEF,
+    LEX_PLUS,
+    LEX_MINUS,
+    LEX_MULT,
+    LEX_DIV,
+    LEX_EXP,
+    LEX_MOD,
+    LEX_ASSIGN,
+    LEX_EQUALITY,
+    LEX_OPARENTHESIS,
+    LEX_CPARENTHESIS,
+    LEX_COMMA,
+    LEX_SEMICOLON,
+    LEX_STATE_COUNT
+} LexState;
 
-bool is_alpha(char c) {
-    return is_digit(c) || is_letter(c);
-}
+static const unsigned char CHAR_CLASS[256] = {
+    ['\0'] = CC_END, [' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\r'] = CC_SPACE,
+    ['.'] = CC_DOT,
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT, ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    ['a'] = CC_LETTER, ['b'] = CC_LETTER, ['c'] = CC_LETTER, ['g'] = CC_LETTER, ['h'] = CC_LETTER, ['i'] = CC_LETTER, ['j'] = CC_LETTER, ['k'] = CC_LETTER,
+    ['l'] = CC_LETTER, ['m'] = CC_LETTER, ['n'] = CC_LETTER, ['o'] = CC_LETTER, ['p'] = CC_LETTER, ['q'] = CC_LETTER, ['r'] = CC_LETTER, ['s'] = CC_LETTER,
+    ['t'] = CC_LETTER, ['u'] = CC_LETTER, ['v'] = CC_LETTER, ['w'] = CC_LETTER, ['x'] = CC_LETTER, ['y'] = CC_LETTER, ['z'] = CC_LETTER, ['A'] = CC_LETTER,
+    ['B'] = CC_LETTER, ['C'] = CC_LETTER, ['D'] = CC_LETTER, ['E'] = CC_LETTER, ['F'] = CC_LETTER, ['G'] = CC_LETTER, ['H'] = CC_LETTER, ['I'] = CC_LETTER,
+    ['J'] = CC_LETTER, ['K'] = CC_LETTER, ['L'] = CC_LETTER, ['M'] = CC_LETTER, ['N'] = CC_LETTER, ['O'] = CC_LETTER, ['P'] = CC_LETTER, ['Q'] = CC_LETTER,
+    ['R'] = CC_LETTER, ['S'] = CC_LETTER, ['T'] = CC_LETTER, ['U'] = CC_LETTER, ['V'] = CC_LETTER, ['W'] = CC_LETTER, ['X'] = CC_LETTER, ['Y'] = CC_LETTER,
+    ['Z'] = CC_LETTER,
+    ['d'] = CC_D, ['e'] = CC_E, ['f'] = CC_F,
+    ['+'] = CC_PLUS, ['-'] = CC_MINUS, ['*'] = CC_STAR, ['/'] = CC_SLASH,
+    ['^'] = CC_CARET, ['%'] = CC_PERCENT, ['='] = CC_EQUAL,
+    ['('] = CC_OPARENTHESIS, [')'] = CC_CPARENTHESIS, [','] = CC_COMMA, [';'] = CC_SEMICOLON,
+};
+
+// TODO: allow symbols to have alphanumeric chars
+#define SYMBOL_TRANSITIONS(next) [CC_LETTER] = (next), [CC_D] = (next), [CC_E] = (next), [CC_F] = (next)
+
+static const unsigned char TRANSITIONS[LEX_STATE_COUNT][CC_COUNT] = {
+    [LEX_START] = {
+        [CC_SPACE] = LEX_START,
+        [CC_DIGIT] = LEX_INT,
+        [CC_LETTER] = LEX_SYMBOL,
+        [CC_D] = LEX_D,
+        [CC_E] = LEX_SYMBOL,
+        [CC_F] = LEX_SYMBOL,
+        [CC_PLUS] = LEX_PLUS,
+        [CC_MINUS] = LEX_MINUS,
+        [CC_STAR] = LEX_MULT,
+        [CC_SLASH] = LEX_DIV,
+        [CC_CARET] = LEX_EXP,
+        [CC_PERCENT] = LEX_MOD,
+        [CC_EQUAL] = LEX_ASSIGN,
+        [CC_OPARENTHESIS] = LEX_OPARENTHESIS,
+        [CC_CPARENTHESIS] = LEX_CPARENTHESIS,
+        [CC_COMMA] = LEX_COMMA,
+        [CC_SEMICOLON] = LEX_SEMICOLON,
+    },
+    [LEX_INT] = {[CC_DIGIT] = LEX_INT, [CC_DOT] = LEX_FLOAT},
+    [LEX_FLOAT] = {[CC_DIGIT] = LEX_FLOAT},
+    [LEX_SYMBOL] = {SYMBOL_TRANSITIONS(LEX_SYMBOL)},
+    [LEX_D] = {[CC_LETTER] = LEX_SYMBOL, [CC_D] = LEX_SYMBOL, [CC_E] = LEX_DE, [CC_F] = LEX_SYMBOL},
+    [LEX_DE] = {[CC_LETTER] = LEX_SYMBOL, [CC_D] = LEX_SYMBOL, [CC_E] = LEX_SYMBOL, [CC_F] = LEX_DEF},
+    [LEX_DEF] = {SYMBOL_TRANSITIONS(LEX_SYMBOL)},
+    [LEX_ASSIGN] = {[CC_EQUAL] = LEX_EQUALITY},
+};
 
-#define OPERATORS_COUNT 9
-typedef struct {
-    const char* value;
-    const size_t len;
-    const TokenType type;
-} Operator;
-
-// CAREFUL: if an operator is a prefix of another operator it should be placed after because of how
-//          ast_next_operator works
-const Operator operators[OPERATORS_COUNT] = {{"+", 1, TOKEN_PLUS}, {"-", 1, TOKEN_MINUS}, {"*", 1, TOKEN_MULT},
-    {"/", 1, TOKEN_DIV}, {"^", 1, TOKEN_EXP}, {"%", 1, TOKEN_MOD}, {"==", 2, TOKEN_EQUALITY}, {"=", 1, TOKEN_ASSIGN},
-    {"def", 3, TOKEN_FUNCDEF}
+// token type recognised when the automaton stops in a given state
+static const TokenType ACCEPTED_TOKEN[LEX_STATE_COUNT] = {
+    [LEX_INT] = TOKEN_INT,
+    [LEX_FLOAT] = TOKEN_FLOAT,
+    [LEX_SYMBOL] = TOKEN_SYMBOL,
+    [LEX_D] = TOKEN_SYMBOL,
+    [LEX_DE] = TOKEN_SYMBOL,
+    [LEX_DEF] = TOKEN_FUNCDEF,
+    [LEX_PLUS] = TOKEN_PLUS,
+    [LEX_MINUS] = TOKEN_MINUS,
+    [LEX_MULT] = TOKEN_MULT,
+    [LEX_DIV] = TOKEN_DIV,
+    [LEX_EXP] = TOKEN_EXP,
+    [LEX_MOD] = TOKEN_MOD,
+    [LEX_ASSIGN] = TOKEN_ASSIGN,
+    [LEX_EQUALITY] = TOKEN_EQUALITY,
+    [LEX_OPARENTHESIS] = TOKEN_OPARENTHESIS,
+    [LEX_CPARENTHESIS] = TOKEN_CPARENTHESIS,
+    [LEX_COMMA] = TOKEN_COMMA,
+    [LEX_SEMICOLON] = TOKEN_SEMICOLON,
 };
-// const char operators[OPERATORS_COUNT] = {'+', '-', '*', '/', '^', '%', '='};
-bool is_operator(const char* input, size_t index) {
-    bool result;
-    for (size_t i = 0; i < OPERATORS_COUNT; i++) {
-        result = true;
-        for (size_t j = 0; j < operators[i].len; j++) {
-            if (input[index + j] == '\0') {
-                return false;
+
+// runs are only handed to scan.c once that long, shorter ones do not pay for the call
+#define SCAN_BULK_RUN 16
+
+// end of the run of bytes of classes first..last starting at pos
+static inline size_t skip_run(const char* input, size_t pos, CharClass first, CharClass last, size_t (*scan)(const char*)) {
+    for (size_t end = pos + SCAN_BULK_RUN; pos < end; pos++) {
+        CharClass cls = CHAR_CLASS[(unsigned char) input[pos]];
+        if (cls < first || cls > last) {
+            return pos;
+        }
+    }
+    return pos + scan(input + pos);
+}
+
+// fills token with the next token of input, returns false once the end of input is reached
+bool next_token(const char* input, size_t* index, Token* token) {
+    size_t start = *index;
+    size_t pos = start;
+    LexState state = LEX_START;
+
+    for (;;) {
+        LexState next = TRANSITIONS[state][CHAR_CLASS[(unsigned char) input[pos]]];
+        if (next == LEX_STOP) {
+            break;
+        }
+        state = next;
+        pos++;
+
+        // the automaton would loop on the run of digits, letters or spaces that follows, it is
+        // walked without it and the bulk scan only starts past SCAN_BULK_RUN bytes, where it pays
+        if (TRANSITIONS[state][CHAR_CLASS[(unsigned char) input[pos]]] == state) {
+            switch (state) {
+            case LEX_START: {
+                pos = skip_run(input, pos, CC_SPACE, CC_SPACE, scan_spaces);
+            }
+            break;
+            case LEX_INT:
+            case LEX_FLOAT: {
+                pos = skip_run(input, pos, CC_DIGIT, CC_DIGIT, scan_digits);
+            }
+            break;
+            case LEX_SYMBOL: {
+                pos = skip_run(input, pos, CC_LETTER, CC_F, scan_letters);
+            }
+            break;
+            default: {
             }
-            if (input[index + j] != operators[i].value[j]) {
-                result = false;
-                break;
             }
         }
+        if (state == LEX_START) {
+            start = pos;
+        }
+    }
+    *index = pos;
 
-        if (result) {
-            return true;
+    if (state == LEX_START) {
+        if (input[pos] == '\0') {
+            return false;
+        }
+        printf("[ERROR] unknown token starting with char: %d at index %lu\n", (int) input[pos], pos);
+        printf("%s\n", input);
+        for (size_t i = 0; i < pos; i++) {
+            printf(" ");
         }
+        printf("^\n");
+        assert(false);
     }
-    return false;
+
+    token->value = sv_from_parts(input + start, pos - start);
+    token->type = ACCEPTED_TOKEN[state];
+    return true;
 }
 
-Token* create_token(TokenType type, const char* start, size_t length) {
-    Token* token = calloc(1, sizeof(Token));
-    char* value = malloc((length + 1) * sizeof(char));
-    value = memcpy(value, start, length);
-    value[length] = '\0';
-    token->value = value;
-    token->type = type;
-    return token;
+#define LEXER_CHUNK_SIZE (64 * 1024)
+
+struct LexerChunk {
+    struct LexerChunk* next;
+    char data[];
+};
+
+size_t read_memory(void* memory_input, char* buffer, size_t capacity) {
+    MemoryInput* memory = memory_input;
+    size_t count = memory->len - memory->pos;
+    if (count > capacity) {
+        count = capacity;
+    }
+    memcpy(buffer, memory->data + memory->pos, count);
+    memory->pos += count;
+    return count;
 }
 
-Token* token_next_number(const char* input, size_t* index) {
-    char c = input[*index];
-    size_t start = *index;
-    while (c != '\0' && is_digit(c)) {
-        c = input[++(*index)];
+size_t read_file(void* file, char* buffer, size_t capacity) {
+    size_t count = fread(buffer, 1, capacity, (FILE*) file);
+    if (count == 0 && ferror((FILE*) file)) {
+        fprintf(stderr, "[ERROR] Could not read input: %s\n", strerror(errno));
+        exit(1);
     }
+    return count;
+}
 
-    bool is_float = false;
-    if (c != '\0' && c == '.') {
-        is_float = true;
-        c = input[++(*index)];
-        while (c != '\0' && is_digit(c)) {
-            c = input[++(*index)];
-        }
+size_t read_fd(void* fd, char* buffer, size_t capacity) {
+    ssize_t count;
+    do {
+        count = read(*((int*) fd), buffer, capacity);
+    } while (count < 0 && errno == EINTR);
+
+    if (count < 0) {
+        fprintf(stderr, "[ERROR] Could not read input: %s\n", strerror(errno));
+        exit(1);
     }
+    return (size_t) count;
+}
 
-    size_t end = *index;
-    return create_token(is_float ? TOKEN_FLOAT : TOKEN_INT, input + start, end - start);
+void lexer_init(Lexer* lexer, InputReader read, void* context) {
+    *lexer = (Lexer) {
+        .read = read,
+        .context = context,
+        .input = "",
+        .len = 0,
+        .index = 0,
+        .eof = false,
+        .chunks = NULL
+    };
 }
 
-Token* token_next_operator(const char* input, size_t* index) {
-    bool is_op;
-    size_t start = *index;
-    for (size_t i = 0; i < OPERATORS_COUNT; i++) {
-        is_op = true;
-        Operator op = operators[i];
-        for (size_t j = 0; j < op.len; j++) {
-            if (input[*index + j] == '\0') {
-                return NULL;
-            }
-            if (input[*index + j] != op.value[j]) {
-                is_op = false;
-                break;
-            }
-        }
+// the whole input is already in memory, nothing will ever be read
+void lexer_init_string(Lexer* lexer, const char* input) {
+    lexer_init(lexer, NULL, NULL);
+    lexer->input = input;
+    lexer->len = strlen(input);
+    lexer->eof = true;
+}
 
-        if (is_op) {
-            *index += op.len;
-            return create_token(op.type, input + start, op.len);
-        }
+// Reads the next chunk of input. The bytes of the window from keep_from onward are the beginning
+// of a token that has not been entirely read yet, they are moved at the start of the new chunk.
+// Previous chunks are kept alive since tokens point into them.
+static void lexer_refill(Lexer* lexer, size_t keep_from) {
+    size_t kept = lexer->len - keep_from;
+    size_t capacity = LEXER_CHUNK_SIZE;
+    while (capacity < 2 * kept) {
+        capacity *= 2;
     }
-    return NULL;
-}
 
-Token* token_next_symbol(const char* input, size_t* index) {
-    char c = input[*index];
-    size_t start = *index;
-    // TODO: allow symbols to have alphanumeric chars
-    while (c != '\0' && is_letter(c)) {
-        c = input[++(*index)];
+    LexerChunk* chunk = mem_alloc(sizeof(LexerChunk) + capacity + 1);
+    memcpy(chunk->data, lexer->input + keep_from, kept);
+
+    size_t count = lexer->read(lexer->context, chunk->data + kept, capacity - kept);
+    if (count == 0) {
+        lexer->eof = true;
     }
-    size_t end = *index;
-    return create_token(TOKEN_SYMBOL, input + start, end - start);
+    chunk->data[kept + count] = '\0';
+
+    chunk->next = lexer->chunks;
+    lexer->chunks = chunk;
+    lexer->input = chunk->data;
+    lexer->len = kept + count;
+    lexer->index = 0;
 }
 
-Token* next_token(const char* input, size_t* index) {
-    char c = input[*index];
-    Token* tok;
-    while (c != '\0') {
-        if (c == ' ') {
-            (*index)++;
-        } else if (is_digit(c)) {
-            return token_next_number(input, index);
-        } else if ((tok = token_next_operator(input, index)) != NULL) {
-            return tok;
-        } else if (c == '(') {
-            return create_token(TOKEN_OPARENTHESIS, input + (*index)++, 1);
-        } else if (c == ')') {
-            return create_token(TOKEN_CPARENTHESIS, input + (*index)++, 1);
-        } else if (is_letter(c)) {
-            return token_next_symbol(input, index);
-        } else if (c == ',') {
-            return create_token(TOKEN_COMMA, input + (*index)++, 1);
-        } else if (c == ';') {
-            return create_token(TOKEN_SEMICOLON, input + (*index)++, 1);
-        }
-        else {
-            printf("[ERROR] unknown token starting with char: %d at index %lu\n", (int) input[*index], *index);
-            printf("%s\n", input);
-            for (size_t i = 0; i < *index; i++) {
-                printf(" ");
+bool lexer_next_token(Lexer* lexer, Token* token) {
+    for (;;) {
+        bool found = next_token(lexer->input, &lexer->index, token);
+        if (lexer->index < lexer->len) {
+            if (!found) {
+                fprintf(stderr, "[ERROR] Unexpected NUL character in input\n");
+                exit(1);
             }
-            printf("^\n");
-            assert(false);
+            return found;
+        }
+        if (lexer->eof) {
+            return found;
         }
-        c = input[*index];
 
+        // the automaton stopped on the end of the window, the token may go on in the next chunk
+        size_t keep_from = found ? (size_t) (token->value.data - lexer->input) : lexer->len;
+        lexer_refill(lexer, keep_from);
     }
-    return NULL;
 }
 
-void free_tokens(Token* tokens) {
-    if (tokens->next) {
-        free_tokens(tokens->next);
+void lexer_free(Lexer* lexer) {
+    LexerChunk* chunk = lexer->chunks;
+    while (chunk) {
+        LexerChunk* next = chunk->next;
+        mem_free(chunk);
+        chunk = next;
     }
-    if (tokens->value) {
-        free(tokens->value);
+    lexer->chunks = NULL;
+}
+
+void tokenize(Lexer* lexer, Tokens* tokens) {
+    Token token;
+    while (lexer_next_token(lexer, &token)) {
+        tokens_push(tokens, token);
+    }
+}
+
+#define TOKENS_INITIAL_CAPACITY 64
+
+void tokens_push(Tokens* tokens, Token token) {
+    if (tokens->count >= tokens->capacity) {
+        size_t capacity = tokens->capacity == 0 ? TOKENS_INITIAL_CAPACITY : tokens->capacity * 2;
+        // the buffer usually is the last allocation of the arena while tokenizing so it grows in place
+        tokens->items = arena_grow(tokens->arena, tokens->items, tokens->capacity * sizeof(Token),
+                                   capacity * sizeof(Token));
+        tokens->capacity = capacity;
     }
-    free(tokens);
+    tokens->items[tokens->count++] = token;
 }
@@ -1,6 +1,9 @@
 #ifndef TOKEN_H
 #include <stdio.h>
+#include <stdbool.h>
 #define TOKEN_H
+#include "./sv.h"
+#include "./memory.h"
 
 
 typedef enum {
@@ -25,13 +28,57 @@ typedef enum {
     TOKEN_COUNT
 } TokenType;
 
-typedef struct Token {
-    char* value;
+// value is a view into the input string, tokens do not own any memory
+typedef struct {
+    String_View value;
     TokenType type;
-    struct Token* next;
 } Token;
 
+// growable token buffer, the tokens are stored contiguously in arena
+typedef struct {
+    Token* items;
+    size_t count;
+    size_t capacity;
+    Arena* arena;
+} Tokens;
+
+// Refill callback of a Lexer: copies at most capacity bytes of input into buffer
+// and returns how many were written, 0 once the input is exhausted.
+typedef size_t (*InputReader)(void* context, char* buffer, size_t capacity);
+
+typedef struct LexerChunk LexerChunk;
+
+// Tokenizes an input that is read chunk by chunk.
+// Tokens point into the chunks, so the lexer must outlive them.
+typedef struct {
+    InputReader read;
+    void* context;
+    // window being tokenized, always NUL terminated
+    const char* input;
+    size_t len;
+    size_t index;
+    bool eof;
+    LexerChunk* chunks;
+} Lexer;
+
+// context of read_memory
+typedef struct {
+    const char* data;
+    size_t len;
+    size_t pos;
+} MemoryInput;
+
+size_t read_memory(void* memory_input, char* buffer, size_t capacity);
+size_t read_file(void* file, char* buffer, size_t capacity);
+size_t read_fd(void* fd, char* buffer, size_t capacity);
+
+void lexer_init(Lexer* lexer, InputReader read, void* context);
+void lexer_init_string(Lexer* lexer, const char* input);
+bool lexer_next_token(Lexer* lexer, Token* token);
+void lexer_free(Lexer* lexer);
+
 void print_token(FILE* out, Token* token);
-Token* next_token(const char* input, size_t* index);
-void free_tokens(Token* tokens);
+bool next_token(const char* input, size_t* index, Token* token);
+void tokenize(Lexer* lexer, Tokens* tokens);
+void tokens_push(Tokens* tokens, Token token);
 #endif // TOKEN_H
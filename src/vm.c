@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "./vm.h"
+#include "./ast_operations.h"
+#include "./builtins.h"
+#include "./bigint.h"
+
+typedef struct {
+    const Chunk* chunk;
+    const Instruction* ip;
+    size_t base; // index of the first argument on the value stack
+    bool memo;   // the result is cached when the chunk returns, keyed on its arguments
+} CallFrame;
+
+typedef struct {
+    Result* stack;
+    size_t capacity;
+    CallFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+    Result* globals;
+    bool* defined;
+    const Chunk** functions;
+    NativeCode* native;
+    MemoTable* memo;    // NULL when not memoizing
+    size_t outer_depth; // calls running below the first frame, in native code
+} VM;
+
+// makes sure chunk can run with its arguments starting at base, returns the (possibly moved) stack
+Result* reserve_stack(VM* vm, size_t base, const Chunk* chunk) {
+    size_t needed = base + chunk->arity + chunk->temps + chunk->max_stack + 1;
+    if (needed > vm->capacity) {
+        vm->capacity = needed > 2 * vm->capacity ? needed : 2 * vm->capacity;
+        vm->stack = mem_realloc(vm->stack, vm->capacity * sizeof(Result));
+    }
+    return vm->stack;
+}
+
+void push_call_frame(VM* vm, const Chunk* chunk, size_t base) {
+    if (vm->outer_depth + vm->frame_count >= MAX_NESTING_DEPTH) {
+        fprintf(stderr, "[ERROR] Calls nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+        exit(1);
+    }
+    if (vm->frame_count >= vm->frame_capacity) {
+        vm->frame_capacity = vm->frame_capacity ? vm->frame_capacity * 2 : 16;
+        vm->frames = mem_realloc(vm->frames, vm->frame_capacity * sizeof(CallFrame));
+    }
+    vm->frames[vm->frame_count++] = (CallFrame) {
+        .chunk = chunk,
+        .ip = chunk->code,
+        .base = base
+    };
+}
+
+// runs the native code of chunk index on the arguments at base, returns the (possibly moved) stack
+Result* call_native(VM* vm, size_t base, size_t index) {
+    NativeCode* native = vm->native;
+    const Chunk* chunk = &native->program->chunks[index];
+    // the result overwrites the arguments, the key is copied first
+    Result key[MEMO_MAX_ARGS];
+    bool memo = vm->memo && chunk->pure;
+    if (memo) {
+        memcpy(key, vm->stack + base, chunk->arity * sizeof(Result));
+    }
+    if (base + NATIVE_STACK_SIZE > vm->capacity) {
+        vm->capacity = base + NATIVE_STACK_SIZE;
+        vm->stack = mem_realloc(vm->stack, vm->capacity * sizeof(Result));
+    }
+    // the call counts like a frame of the VM
+    if (vm->frame_count >= MAX_NESTING_DEPTH) {
+        fprintf(stderr, "[ERROR] Calls nested deeper than %zu levels\n", MAX_NESTING_DEPTH);
+        exit(1);
+    }
+    native->stack_end = vm->stack + vm->capacity;
+    native->depth = vm->frame_count + 1;
+    native->max_depth = native->depth + NATIVE_MAX_CALL_DEPTH;
+    if (native->max_depth > MAX_NESTING_DEPTH) {
+        native->max_depth = MAX_NESTING_DEPTH;
+    }
+    native->entries[index](native, vm->stack + base);
+    if (memo) {
+        memo_store(vm->memo, index, chunk->arity, key, vm->stack[base]);
+    }
+    return vm->stack;
+}
+
+// the loop is compiled once per dispatch technique
+#define VM_LOOP vm_loop_switch
+#define VM_THREADED 0
+#include "./vm_loop.h"
+#undef VM_LOOP
+#undef VM_THREADED
+
+#ifdef __GNUC__
+#define VM_HAS_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define VM_LOOP vm_loop_threaded
+#define VM_THREADED 1
+#include "./vm_loop.h"
+#undef VM_LOOP
+#undef VM_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+typedef Result (*VmLoop)(VM* vm, const Program* program);
+
+static const char* VM_DISPATCH_NAMES[VM_DISPATCH_COUNT] = {"switch", "threaded"};
+
+static const VmLoop VM_LOOPS[VM_DISPATCH_COUNT] = {
+    [VM_DISPATCH_SWITCH] = vm_loop_switch,
+#ifdef VM_HAS_THREADED
+    [VM_DISPATCH_THREADED] = vm_loop_threaded,
+#endif
+};
+
+static VmDispatch current_dispatch = VM_DISPATCH_COUNT - 1;
+
+bool vm_dispatch_supported(VmDispatch dispatch) {
+    return dispatch < VM_DISPATCH_COUNT && VM_LOOPS[dispatch] != NULL;
+}
+
+VmDispatch vm_best_dispatch(void) {
+    return vm_dispatch_supported(VM_DISPATCH_THREADED) ? VM_DISPATCH_THREADED : VM_DISPATCH_SWITCH;
+}
+
+bool vm_set_dispatch(VmDispatch dispatch) {
+    if (!vm_dispatch_supported(dispatch)) {
+        return false;
+    }
+    current_dispatch = dispatch;
+    return true;
+}
+
+const char* vm_dispatch_name(VmDispatch dispatch) {
+    return VM_DISPATCH_NAMES[dispatch];
+}
+
+Result vm_run(const Program* program, Arena* arena) {
+    return vm_run_native(program, arena, NULL);
+}
+
+Result vm_run_native(const Program* program, Arena* arena, NativeCode* native) {
+    BIG_ARENA = arena;
+    VM vm = {
+        .native = native,
+        .memo = MEMOIZE ? memo_new() : NULL
+    };
+    if (native) {
+        native->memo = vm.memo;
+        vm.globals = native->globals;
+        vm.defined = native->defined;
+        vm.functions = native->functions;
+    } else {
+        vm.globals = arena_alloc(arena, program->globals.count * sizeof(Result));
+        vm.defined = arena_alloc(arena, program->globals.count * sizeof(bool));
+        vm.functions = arena_alloc(arena, program->functions.count * sizeof(Chunk*));
+    }
+    push_call_frame(&vm, &program->chunks[0], 0);
+    reserve_stack(&vm, 0, &program->chunks[0]);
+
+    if (!vm_dispatch_supported(current_dispatch)) {
+        current_dispatch = vm_best_dispatch();
+    }
+    Result result = VM_LOOPS[current_dispatch](&vm, program);
+    mem_free(vm.stack);
+    mem_free(vm.frames);
+    if (vm.memo) {
+        memo_free(vm.memo);
+    }
+    return result;
+}
+
+void vm_call_interpreted(NativeCode* native, uint32_t index, Result* args, size_t depth) {
+    const Chunk* chunk = &native->program->chunks[index];
+    VM vm = {
+        .globals = native->globals,
+        .defined = native->defined,
+        .functions = native->functions,
+        .memo = native->memo,
+        .outer_depth = depth
+    };
+    push_call_frame(&vm, chunk, 0);
+    reserve_stack(&vm, 0, chunk);
+    memcpy(vm.stack, args, chunk->arity * sizeof(Result));
+
+    if (!vm_dispatch_supported(current_dispatch)) {
+        current_dispatch = vm_best_dispatch();
+    }
+    *args = VM_LOOPS[current_dispatch](&vm, native->program);
+    mem_free(vm.stack);
+    mem_free(vm.frames);
+}
@@ -0,0 +1,50 @@
+#ifndef VM_H
+#define VM_H
+#include <stdbool.h>
+#include "./bytecode.h"
+
+typedef enum {
+    VM_DISPATCH_SWITCH = 0,
+    VM_DISPATCH_THREADED,
+    VM_DISPATCH_COUNT
+} VmDispatch;
+
+// Machine code for some of the chunks of a program (see jit.h), the VM calls it instead of
+// interpreting them. The native code works on the VM's value stack and variables.
+typedef struct NativeCode NativeCode;
+typedef void (*NativeFunction)(NativeCode* native, Result* locals);
+
+struct NativeCode {
+    NativeFunction* entries; // indexed like program->chunks, NULL for interpreted chunks
+    const Program* program;
+    Result* globals;
+    bool* defined;
+    const Chunk** functions;
+    MemoTable* memo; // NULL when not memoizing
+    // set by the VM before each call into native code
+    Result* stack_end;
+    size_t depth;
+    size_t max_depth;
+};
+
+// native calls nest on the C stack, they get that many frames and values at most, deeper
+// calls go on on the interpreter
+#define NATIVE_MAX_CALL_DEPTH 10000
+#define NATIVE_STACK_SIZE (1 << 16)
+
+// runs the top level chunk of program, variables and function bindings are allocated in arena
+Result vm_run(const Program* program, Arena* arena);
+// same with the variables of native, whose entries are called instead of interpreting their chunk
+Result vm_run_native(const Program* program, Arena* arena, NativeCode* native);
+// runs chunk index with the variables of native on the interpreter alone, below depth calls,
+// the arguments at args are replaced by the result
+void vm_call_interpreted(NativeCode* native, uint32_t index, Result* args, size_t depth);
+
+// The threaded dispatch jumps from one instruction to the next through a table of label
+// addresses (labels as values), it is only available with GCC compatible compilers.
+bool vm_dispatch_supported(VmDispatch dispatch);
+VmDispatch vm_best_dispatch(void);
+bool vm_set_dispatch(VmDispatch dispatch);
+const char* vm_dispatch_name(VmDispatch dispatch);
+
+#endif // VM_H
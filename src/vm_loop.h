@@ -0,0 +1,340 @@
+// Body of the VM, included by vm.c once per dispatch technique with VM_LOOP naming the
+// function to define and VM_THREADED selecting computed gotos (1) or a switch (0).
+// The running frame is kept in locals, it is written back to vm->frames on calls.
+
+#if VM_THREADED
+// every handler ends with its own indirect jump, which the branch predictor tracks separately
+#define VM_DISPATCH()                                              \
+    do {                                                           \
+        instruction = *ip++;                                       \
+        arg = INSTRUCTION_ARG(instruction);                        \
+        goto *DISPATCH_TABLE[INSTRUCTION_OP(instruction)];         \
+    } while (0)
+#define VM_CASE(op) L_##op
+#define VM_NEXT VM_DISPATCH()
+#else
+#define VM_CASE(op) case op
+#define VM_NEXT break
+#endif
+
+#define VM_BINARY(op, function)                                    \
+    VM_CASE(op): {                                                 \
+        sp--;                                                      \
+        sp[-1] = function(sp[-1], sp[0]);                          \
+    }                                                              \
+    VM_NEXT;
+// the compiler checked the types, the kernels take the values unboxed
+#define VM_TYPED_BINARY(op, kernel, field)                         \
+    VM_CASE(op): {                                                 \
+        sp--;                                                      \
+        sp[-1] = kernel(sp[-1].field, sp[0].field);                \
+    }                                                              \
+    VM_NEXT;
+#define VM_BINARY_CONST(op, function)                              \
+    VM_CASE(op): {                                                 \
+        sp[-1] = function(sp[-1], constants[arg]);                 \
+    }                                                              \
+    VM_NEXT;
+#define VM_LOCAL_BINARY_CONST(op, function)                        \
+    VM_CASE(op): {                                                 \
+        *sp++ = function(locals[PAIR_FIRST(arg)], constants[PAIR_SECOND(arg)]); \
+    }                                                              \
+    VM_NEXT;
+
+static Result VM_LOOP(VM* vm, const Program* program) {
+    const Result* constants = program->constants;
+    Result* globals = vm->globals;
+    bool* defined = vm->defined;
+    const Chunk** functions = vm->functions;
+    Result* stack = vm->stack;
+
+    const Chunk* chunk = vm->frames[0].chunk;
+    const Instruction* ip = vm->frames[0].ip;
+    Result* locals = stack;
+    Result* sp = stack + chunk->arity + chunk->temps;
+    Instruction instruction;
+    uint32_t arg;
+
+#if VM_THREADED
+    static const void* DISPATCH_TABLE[BC_COUNT] = {
+        [BC_CONST] = &&L_BC_CONST,
+        [BC_LOAD_LOCAL] = &&L_BC_LOAD_LOCAL,
+        [BC_STORE_LOCAL] = &&L_BC_STORE_LOCAL,
+        [BC_LOAD_GLOBAL] = &&L_BC_LOAD_GLOBAL,
+        [BC_STORE_GLOBAL] = &&L_BC_STORE_GLOBAL,
+        [BC_NEG] = &&L_BC_NEG,
+        [BC_ADD] = &&L_BC_ADD,
+        [BC_SUB] = &&L_BC_SUB,
+        [BC_MUL] = &&L_BC_MUL,
+        [BC_DIV] = &&L_BC_DIV,
+        [BC_EXP] = &&L_BC_EXP,
+        [BC_MOD] = &&L_BC_MOD,
+        [BC_EQUAL] = &&L_BC_EQUAL,
+        [BC_POP] = &&L_BC_POP,
+        [BC_DEFINE] = &&L_BC_DEFINE,
+        [BC_CALL] = &&L_BC_CALL,
+        [BC_CALL_BUILTIN] = &&L_BC_CALL_BUILTIN,
+        [BC_RETURN] = &&L_BC_RETURN,
+        [BC_TAIL_CALL] = &&L_BC_TAIL_CALL,
+        [BC_JUMP] = &&L_BC_JUMP,
+        [BC_JUMP_IF_FALSE] = &&L_BC_JUMP_IF_FALSE,
+        [BC_ADD_INT] = &&L_BC_ADD_INT,
+        [BC_SUB_INT] = &&L_BC_SUB_INT,
+        [BC_MUL_INT] = &&L_BC_MUL_INT,
+        [BC_DIV_INT] = &&L_BC_DIV_INT,
+        [BC_EXP_INT] = &&L_BC_EXP_INT,
+        [BC_MOD_INT] = &&L_BC_MOD_INT,
+        [BC_EQUAL_INT] = &&L_BC_EQUAL_INT,
+        [BC_ADD_FLOAT] = &&L_BC_ADD_FLOAT,
+        [BC_SUB_FLOAT] = &&L_BC_SUB_FLOAT,
+        [BC_MUL_FLOAT] = &&L_BC_MUL_FLOAT,
+        [BC_DIV_FLOAT] = &&L_BC_DIV_FLOAT,
+        [BC_EXP_FLOAT] = &&L_BC_EXP_FLOAT,
+        [BC_MOD_FLOAT] = &&L_BC_MOD_FLOAT,
+        [BC_EQUAL_FLOAT] = &&L_BC_EQUAL_FLOAT,
+        [BC_CONST_CONST] = &&L_BC_CONST_CONST,
+        [BC_ADD_CONST] = &&L_BC_ADD_CONST,
+        [BC_SUB_CONST] = &&L_BC_SUB_CONST,
+        [BC_MUL_CONST] = &&L_BC_MUL_CONST,
+        [BC_DIV_CONST] = &&L_BC_DIV_CONST,
+        [BC_LOCAL_ADD_CONST] = &&L_BC_LOCAL_ADD_CONST,
+        [BC_LOCAL_SUB_CONST] = &&L_BC_LOCAL_SUB_CONST,
+        [BC_LOCAL_MUL_CONST] = &&L_BC_LOCAL_MUL_CONST,
+        [BC_LOCAL_DIV_CONST] = &&L_BC_LOCAL_DIV_CONST,
+        [BC_MUL_ADD] = &&L_BC_MUL_ADD,
+        [BC_ADD_MUL] = &&L_BC_ADD_MUL,
+    };
+    VM_DISPATCH();
+#else
+    for (;;) {
+        instruction = *ip++;
+        arg = INSTRUCTION_ARG(instruction);
+        switch (INSTRUCTION_OP(instruction)) {
+#endif
+        VM_CASE(BC_CONST): {
+            *sp++ = constants[arg];
+        }
+        VM_NEXT;
+        VM_CASE(BC_LOAD_LOCAL): {
+            *sp++ = locals[arg];
+        }
+        VM_NEXT;
+        VM_CASE(BC_STORE_LOCAL): {
+            locals[arg] = sp[-1];
+        }
+        VM_NEXT;
+        VM_CASE(BC_LOAD_GLOBAL): {
+            if (!defined[arg]) {
+                fprintf(stderr, "[ERROR] Undeclared variable: " SV_Fmt "\n", SV_Arg(symbol_name(program->globals.symbols[arg])));
+                exit(1);
+            }
+            *sp++ = globals[arg];
+        }
+        VM_NEXT;
+        VM_CASE(BC_STORE_GLOBAL): {
+            globals[arg] = sp[-1];
+            defined[arg] = true;
+        }
+        VM_NEXT;
+        VM_CASE(BC_NEG): {
+            sp[-1] = ast_neg(sp[-1]);
+        }
+        VM_NEXT;
+        VM_BINARY(BC_ADD, ast_add)
+        VM_BINARY(BC_SUB, ast_sub)
+        VM_BINARY(BC_MUL, ast_mul)
+        VM_BINARY(BC_DIV, ast_div)
+        VM_BINARY(BC_EXP, ast_exp)
+        VM_BINARY(BC_MOD, ast_mod)
+        VM_BINARY(BC_EQUAL, ast_equal)
+        VM_CASE(BC_POP): {
+            sp--;
+        }
+        VM_NEXT;
+        VM_CASE(BC_DEFINE): {
+            const Chunk* function = &program->chunks[arg];
+            if (functions[function->function_slot] && vm->memo) {
+                memo_clear(vm->memo);
+            }
+            functions[function->function_slot] = function;
+            *sp++ = (Result) {.type = RESULT_INT};
+        }
+        VM_NEXT;
+        VM_CASE(BC_CALL_BUILTIN): {
+            uint32_t argc = CALL_ARGC(arg);
+            sp -= argc;
+            // the arguments are read in place from the stack
+            *sp = BUILTINS[CALL_SLOT(arg)].function(sp);
+            sp++;
+        }
+        VM_NEXT;
+        VM_CASE(BC_CALL): {
+            const Chunk* callee = functions[CALL_SLOT(arg)];
+            uint32_t argc = CALL_ARGC(arg);
+            if (callee == NULL) {
+                fprintf(stderr, "[ERROR] Function '" SV_Fmt "' is not defined", SV_Arg(symbol_name(program->functions.symbols[CALL_SLOT(arg)])));
+                exit(1);
+            }
+            if (argc != callee->arity) {
+                fprintf(stderr, "[ERROR] Invalid number of arguments for function: " SV_Fmt ". Expected %u but got %u",
+                        SV_Arg(callee->name), callee->arity, argc);
+                exit(1);
+            }
+            if (callee->pure && vm->memo) {
+                Result value;
+                if (memo_lookup(vm->memo, callee - program->chunks, argc, sp - argc, &value)) {
+                    sp -= argc;
+                    *sp++ = value;
+                    VM_NEXT;
+                }
+            }
+
+            if (vm->native && vm->native->entries[callee - program->chunks]) {
+                size_t base = sp - stack - argc;
+                stack = call_native(vm, base, callee - program->chunks);
+                locals = stack + vm->frames[vm->frame_count - 1].base;
+                sp = stack + base + 1;
+                VM_NEXT;
+            }
+
+            vm->frames[vm->frame_count - 1].ip = ip;
+            size_t base = sp - stack - argc;
+            push_call_frame(vm, callee, base);
+            vm->frames[vm->frame_count - 1].memo = callee->pure && vm->memo;
+            stack = reserve_stack(vm, base, callee);
+
+            chunk = callee;
+            ip = callee->code;
+            locals = stack + base;
+            sp = locals + argc + callee->temps;
+        }
+        VM_NEXT;
+        VM_CASE(BC_TAIL_CALL): {
+            const Chunk* callee = functions[CALL_SLOT(arg)];
+            uint32_t argc = CALL_ARGC(arg);
+            if (callee == NULL) {
+                fprintf(stderr, "[ERROR] Function '" SV_Fmt "' is not defined", SV_Arg(symbol_name(program->functions.symbols[CALL_SLOT(arg)])));
+                exit(1);
+            }
+            if (argc != callee->arity) {
+                fprintf(stderr, "[ERROR] Invalid number of arguments for function: " SV_Fmt ". Expected %u but got %u",
+                        SV_Arg(callee->name), callee->arity, argc);
+                exit(1);
+            }
+            if (callee->pure && vm->memo) {
+                Result value;
+                if (memo_lookup(vm->memo, callee - program->chunks, argc, sp - argc, &value)) {
+                    sp -= argc;
+                    *sp++ = value;
+                    goto return_result;
+                }
+            }
+
+            // the arguments replace those of the running call, whose result is not cached then
+            memmove(locals, sp - argc, argc * sizeof(Result));
+            size_t base = locals - stack;
+            if (vm->native && vm->native->entries[callee - program->chunks]) {
+                vm->frames[vm->frame_count - 1].memo = false;
+                stack = call_native(vm, base, callee - program->chunks);
+                locals = stack + base;
+                sp = locals + 1;
+                goto return_result;
+            }
+
+            vm->frames[vm->frame_count - 1].chunk = callee;
+            vm->frames[vm->frame_count - 1].memo = callee->pure && vm->memo;
+            stack = reserve_stack(vm, base, callee);
+
+            chunk = callee;
+            ip = callee->code;
+            locals = stack + base;
+            sp = locals + argc + callee->temps;
+        }
+        VM_NEXT;
+        VM_CASE(BC_JUMP): {
+            ip = chunk->code + arg;
+        }
+        VM_NEXT;
+        VM_CASE(BC_JUMP_IF_FALSE): {
+            if (!ast_is_true(*--sp)) {
+                ip = chunk->code + arg;
+            }
+        }
+        VM_NEXT;
+        VM_CASE(BC_RETURN): {
+        return_result:;
+            Result result = sp[-1];
+            vm->frame_count--;
+            if (vm->frame_count == 0) {
+                return result;
+            }
+            if (vm->frames[vm->frame_count].memo) {
+                // a pure chunk does not assign its arguments
+                memo_store(vm->memo, chunk - program->chunks, chunk->arity, locals, result);
+            }
+
+            // the arguments are replaced with the result
+            sp = locals;
+            *sp++ = result;
+
+            CallFrame* caller = &vm->frames[vm->frame_count - 1];
+            chunk = caller->chunk;
+            ip = caller->ip;
+            locals = stack + caller->base;
+        }
+        VM_NEXT;
+        VM_TYPED_BINARY(BC_ADD_INT, ast_add_int, vali)
+        VM_TYPED_BINARY(BC_SUB_INT, ast_sub_int, vali)
+        VM_TYPED_BINARY(BC_MUL_INT, ast_mul_int, vali)
+        VM_TYPED_BINARY(BC_DIV_INT, ast_div_int, vali)
+        VM_TYPED_BINARY(BC_EXP_INT, ast_exp_int, vali)
+        VM_TYPED_BINARY(BC_MOD_INT, ast_mod_int, vali)
+        VM_TYPED_BINARY(BC_EQUAL_INT, ast_equal_int, vali)
+        VM_TYPED_BINARY(BC_ADD_FLOAT, ast_add_float, valf)
+        VM_TYPED_BINARY(BC_SUB_FLOAT, ast_sub_float, valf)
+        VM_TYPED_BINARY(BC_MUL_FLOAT, ast_mul_float, valf)
+        VM_TYPED_BINARY(BC_DIV_FLOAT, ast_div_float, valf)
+        VM_TYPED_BINARY(BC_EXP_FLOAT, ast_exp_float, valf)
+        VM_TYPED_BINARY(BC_MOD_FLOAT, ast_mod_float, valf)
+        VM_TYPED_BINARY(BC_EQUAL_FLOAT, ast_equal_float, valf)
+        VM_CASE(BC_CONST_CONST): {
+            sp[0] = constants[PAIR_FIRST(arg)];
+            sp[1] = constants[PAIR_SECOND(arg)];
+            sp += 2;
+        }
+        VM_NEXT;
+        VM_BINARY_CONST(BC_ADD_CONST, ast_add)
+        VM_BINARY_CONST(BC_SUB_CONST, ast_sub)
+        VM_BINARY_CONST(BC_MUL_CONST, ast_mul)
+        VM_BINARY_CONST(BC_DIV_CONST, ast_div)
+        VM_LOCAL_BINARY_CONST(BC_LOCAL_ADD_CONST, ast_add)
+        VM_LOCAL_BINARY_CONST(BC_LOCAL_SUB_CONST, ast_sub)
+        VM_LOCAL_BINARY_CONST(BC_LOCAL_MUL_CONST, ast_mul)
+        VM_LOCAL_BINARY_CONST(BC_LOCAL_DIV_CONST, ast_div)
+        VM_CASE(BC_MUL_ADD): {
+            sp -= 2;
+            sp[-1] = ast_add(ast_mul(sp[-1], sp[0]), sp[1]);
+        }
+        VM_NEXT;
+        VM_CASE(BC_ADD_MUL): {
+            sp -= 2;
+            sp[-1] = ast_add(sp[-1], ast_mul(sp[0], sp[1]));
+        }
+        VM_NEXT;
+#if !VM_THREADED
+        default: {
+            fprintf(stderr, "[ERROR] Invalid instruction: %u\n", instruction);
+            exit(1);
+        }
+        }
+    }
+#endif
+}
+
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BINARY
+#undef VM_TYPED_BINARY
+#undef VM_BINARY_CONST
+#undef VM_LOCAL_BINARY_CONST
@@ -15,9 +15,12 @@
 #include "src/ast.h"
 #include "src/token.h"
 #include "src/runtime.h"
+#include "src/vm.h"
+#include "src/memo.h"
+#include "src/ast_operations.h"
+#include "src/bytecode.h"
 
 #define UNUSED(x) (void)(x)
-#define FLOAT_STR_LEN 64
 #define INPUT_DELIM '~'
 
 static int fail_count = 0;
@@ -112,22 +115,14 @@ static Testcase *create_testcase(const char *filename, size_t line, FILE *f)
 static int run_testcase(Testcase *test)
 {
     Result result = evaluate_input(test->input);
-    char *str_result = calloc(FLOAT_STR_LEN, 1);
-    if (result.type == RESULT_INT)
-    {
-        snprintf(str_result, FLOAT_STR_LEN, "%d", result.vali);
-    }
-    else
-    {
-        snprintf(str_result, FLOAT_STR_LEN, "%.10f", result.valf);
-    }
+    char *str_result = ast_result_string(result);
 
     char *pos = strstr(test->expected, str_result);
     if (pos == NULL)
     {
         fprintf(stderr, "%s:%zu:0: [FAIL] Expected: %s. Got: %s\n", test->filename, test->line, test->expected, str_result);
         fail_count++;
-        free(str_result);
+        mem_free(str_result);
         return 0;
     }
 
@@ -135,7 +130,7 @@ static int run_testcase(Testcase *test)
         printf("[PASSED] Input: %s. Expected: '%s'.\n", test->input, test->expected);
 
     pass_count++;
-    free(str_result);
+    mem_free(str_result);
     return 1;
 }
 
@@ -205,6 +200,39 @@ static int handle_tree_entry(const char *filepath, const struct stat *info,
     return 0;
 }
 
+// compiles input and checks that the bytecode listing contains expected
+static void check_program_dump(const char *input, const char *expected)
+{
+    Arena arena = {0};
+    Tokens tokens = {.arena = &arena};
+    Lexer lexer;
+    lexer_init_string(&lexer, input);
+    tokenize(&lexer, &tokens);
+    AST ast = build_AST(&tokens, &arena);
+    Program *program = compile_ast(&ast, &arena);
+
+    char *dump = NULL;
+    size_t dump_len = 0;
+    FILE *out = open_memstream(&dump, &dump_len);
+    print_program(out, program);
+    fclose(out);
+
+    if (strstr(dump, expected) == NULL)
+    {
+        fprintf(stderr, "[FAIL] Dump of %s. Expected: %s. Got:\n%s", input, expected, dump);
+        fail_count++;
+    }
+    else
+    {
+        if (verbose_mode)
+            printf("[PASSED] Dump of %s. Expected: '%s'.\n", input, expected);
+        pass_count++;
+    }
+    free(dump);
+    lexer_free(&lexer);
+    arena_free(&arena);
+}
+
 static int test_directory_tree(const char *const dirpath)
 {
     if (dirpath == NULL || *dirpath == '\0')
@@ -221,13 +249,28 @@ static int test_directory_tree(const char *const dirpath)
 int main(int argc, char **argv)
 {
     char c;
-    while ((c = getopt (argc, argv, "v")) != -1)
+    while ((c = getopt (argc, argv, "vtsjm")) != -1)
     {
         switch (c)
         {
         case 'v':
             verbose_mode = 1;
             break;
+        case 't':
+            TREE_WALK_MODE = 1;
+            break;
+        case 's':
+            vm_set_dispatch(VM_DISPATCH_SWITCH);
+            SUPERINSTRUCTIONS = 0;
+            TYPED_INSTRUCTIONS = 0;
+            OPTIMIZE_MODE = 0;
+            break;
+        case 'j':
+            JIT_MODE = 1;
+            break;
+        case 'm':
+            MEMOIZE = 1;
+            break;
         case '?':
             if (isprint(optopt))
                 fprintf(stderr, "Unknown option `-%c'.\n", optopt);
@@ -240,6 +283,7 @@ int main(int argc, char **argv)
     }
 
     test_directory_tree("tests");
+    check_program_dump("x = 2147483648; x + 1.5", "CONST           0 (2147483648)");
     printf("\nNumber of tests passed: %d\n", pass_count);
     printf("Number of tests failed: %d\n", fail_count);
     return 0;